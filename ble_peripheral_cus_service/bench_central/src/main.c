@@ -0,0 +1,722 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Central counterpart of the ble_peripheral_cus_service benchmark mode.
+	Connects to the peripheral, starts a notification stream through the
+	benchmark control characteristic and measures goodput, loss and
+	one-way latency of the received frames.
+*/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/l2cap.h>
+#include <bluetooth/gatt_dm.h>
+#include <bluetooth/scan.h>
+
+#include "my_service.h"
+#include "bench_service.h"
+#include "my_service_codec.h"
+
+#define BT_UUID_MY_SERVICE      BT_UUID_DECLARE_128(MY_SERVICE_UUID)
+#define BT_UUID_MY_SERVICE_TX   BT_UUID_DECLARE_128(TX_CHARACTERISTIC_UUID)
+#define BT_UUID_MY_SERVICE_PSM  BT_UUID_DECLARE_128(L2CAP_PSM_CHARACTERISTIC_UUID)
+#define BT_UUID_MY_SERVICE_CODEC BT_UUID_DECLARE_128(CODEC_CHARACTERISTIC_UUID)
+#define BT_UUID_BENCH_SERVICE   BT_UUID_DECLARE_128(BENCH_SERVICE_UUID)
+#define BT_UUID_BENCH_CTRL      BT_UUID_DECLARE_128(BENCH_CTRL_CHARACTERISTIC_UUID)
+#define BT_UUID_BENCH_STATS     BT_UUID_DECLARE_128(BENCH_STATS_CHARACTERISTIC_UUID)
+
+#if defined(CONFIG_BENCH_PHY_CODED)
+#define BENCH_PHY BT_GAP_LE_PHY_CODED
+#elif defined(CONFIG_BENCH_PHY_2M)
+#define BENCH_PHY BT_GAP_LE_PHY_2M
+#else
+#define BENCH_PHY BT_GAP_LE_PHY_1M
+#endif
+
+#if defined(CONFIG_BENCH_CODEC_DELTA_RLE)
+#define BENCH_CODEC MY_SERVICE_CODEC_DELTA_RLE
+#elif defined(CONFIG_BENCH_CODEC_DELTA)
+#define BENCH_CODEC MY_SERVICE_CODEC_DELTA
+#else
+#define BENCH_CODEC MY_SERVICE_CODEC_RAW
+#endif
+
+static struct bt_conn *default_conn;
+
+static K_SEM_DEFINE(discovered, 0, 1);
+static K_SEM_DEFINE(gatt_done, 0, 1);
+static K_SEM_DEFINE(l2cap_ready, 0, 1);
+
+static struct {
+	uint16_t tx;
+	uint16_t tx_ccc;
+	uint16_t psm;
+	uint16_t codec;
+	uint16_t ctrl;
+	uint16_t stats;
+} handles;
+
+static struct bt_gatt_exchange_params exchange_params;
+static struct bt_gatt_subscribe_params subscribe_params;
+static struct bt_gatt_write_params write_params;
+static struct bt_gatt_read_params read_params;
+static uint8_t gatt_err;
+
+/* Receive side measurements, updated from the BT RX thread */
+static struct {
+	uint32_t frames;
+	uint32_t bytes;
+	uint32_t coded_bytes;
+	uint32_t undecoded;
+	uint32_t lost;
+	uint32_t reordered;
+	uint32_t next_seq;
+	uint32_t first_cyc;
+	uint32_t last_cyc;
+	uint32_t lat_min_us;
+	uint32_t lat_max_us;
+	uint64_t lat_sum_us;
+} rx;
+
+static struct bench_stats peer_stats;
+static uint16_t peer_psm;
+
+/* A read value, in as many pieces as the ATT MTU needs */
+static uint8_t read_buf[sizeof(struct bench_stats)];
+static uint16_t read_len;
+
+static struct my_service_codec rx_codec;
+static uint8_t rx_frame[CONFIG_BENCH_FRAME_LEN];
+
+#if defined(CONFIG_BENCH_L2CAP)
+NET_BUF_POOL_FIXED_DEFINE(l2cap_rx_pool, CONFIG_BENCH_L2CAP_RX_BUF_COUNT,
+			  BT_L2CAP_SDU_BUF_SIZE(CONFIG_BENCH_L2CAP_MTU), 8, NULL);
+
+static struct bt_l2cap_le_chan l2cap_chan;
+#endif
+
+static const struct bt_le_conn_param conn_param =
+	BT_LE_CONN_PARAM_INIT(CONFIG_BENCH_CONN_INTERVAL, CONFIG_BENCH_CONN_INTERVAL,
+			      0, 400);
+
+static void scan_filter_match(struct bt_scan_device_info *device_info,
+			      struct bt_scan_filter_match *filter_match,
+			      bool connectable)
+{
+	char addr[BT_ADDR_LE_STR_LEN];
+
+	bt_addr_le_to_str(device_info->recv_info->addr, addr, sizeof(addr));
+
+	printk("Filters matched. Address: %s connectable: %s\n",
+	       addr, connectable ? "yes" : "no");
+}
+
+static void scan_connecting_error(struct bt_scan_device_info *device_info)
+{
+	printk("Connecting failed\n");
+}
+
+static void scan_connecting(struct bt_scan_device_info *device_info,
+			    struct bt_conn *conn)
+{
+	default_conn = bt_conn_ref(conn);
+}
+
+BT_SCAN_CB_INIT(scan_cb, scan_filter_match, NULL,
+		scan_connecting_error, scan_connecting);
+
+static void bench_discovery_completed(struct bt_gatt_dm *dm, void *context)
+{
+	const struct bt_gatt_dm_attr *chrc;
+	const struct bt_gatt_dm_attr *desc;
+
+	chrc = bt_gatt_dm_char_by_uuid(dm, BT_UUID_BENCH_CTRL);
+	desc = chrc ? bt_gatt_dm_desc_by_uuid(dm, chrc, BT_UUID_BENCH_CTRL) : NULL;
+	handles.ctrl = desc ? desc->handle : 0;
+
+	chrc = bt_gatt_dm_char_by_uuid(dm, BT_UUID_BENCH_STATS);
+	desc = chrc ? bt_gatt_dm_desc_by_uuid(dm, chrc, BT_UUID_BENCH_STATS) : NULL;
+	handles.stats = desc ? desc->handle : 0;
+
+	bt_gatt_dm_data_release(dm);
+
+	if (!handles.ctrl || !handles.stats) {
+		printk("Benchmark characteristics not found\n");
+		return;
+	}
+
+	k_sem_give(&discovered);
+}
+
+static void discovery_service_not_found(struct bt_conn *conn, void *context)
+{
+	printk("The service could not be found during the discovery\n");
+}
+
+static void discovery_error_found(struct bt_conn *conn, int err, void *context)
+{
+	printk("The discovery procedure failed with %d\n", err);
+}
+
+static const struct bt_gatt_dm_cb bench_discovery_cb =
+{
+	.completed = bench_discovery_completed,
+	.service_not_found = discovery_service_not_found,
+	.error_found = discovery_error_found,
+};
+
+static void my_service_discovery_completed(struct bt_gatt_dm *dm, void *context)
+{
+	const struct bt_gatt_dm_attr *chrc;
+	const struct bt_gatt_dm_attr *desc;
+	struct bt_conn *conn = bt_gatt_dm_conn_get(dm);
+	int err;
+
+	chrc = bt_gatt_dm_char_by_uuid(dm, BT_UUID_MY_SERVICE_TX);
+	if (chrc) {
+		desc = bt_gatt_dm_desc_by_uuid(dm, chrc, BT_UUID_MY_SERVICE_TX);
+		handles.tx = desc ? desc->handle : 0;
+		desc = bt_gatt_dm_desc_by_uuid(dm, chrc, BT_UUID_GATT_CCC);
+		handles.tx_ccc = desc ? desc->handle : 0;
+	}
+
+	chrc = bt_gatt_dm_char_by_uuid(dm, BT_UUID_MY_SERVICE_PSM);
+	if (chrc) {
+		desc = bt_gatt_dm_desc_by_uuid(dm, chrc, BT_UUID_MY_SERVICE_PSM);
+		handles.psm = desc ? desc->handle : 0;
+	}
+
+	chrc = bt_gatt_dm_char_by_uuid(dm, BT_UUID_MY_SERVICE_CODEC);
+	if (chrc) {
+		desc = bt_gatt_dm_desc_by_uuid(dm, chrc, BT_UUID_MY_SERVICE_CODEC);
+		handles.codec = desc ? desc->handle : 0;
+	}
+
+	bt_gatt_dm_data_release(dm);
+
+	if (!handles.tx || !handles.tx_ccc) {
+		printk("TX characteristic not found\n");
+		return;
+	}
+
+	err = bt_gatt_dm_start(conn, BT_UUID_BENCH_SERVICE, &bench_discovery_cb, NULL);
+	if (err) {
+		printk("Could not start the discovery procedure (err %d)\n", err);
+	}
+}
+
+static const struct bt_gatt_dm_cb my_service_discovery_cb =
+{
+	.completed = my_service_discovery_completed,
+	.service_not_found = discovery_service_not_found,
+	.error_found = discovery_error_found,
+};
+
+static void exchange_func(struct bt_conn *conn, uint8_t err,
+			  struct bt_gatt_exchange_params *params)
+{
+	printk("MTU exchange %s, MTU %u\n", err == 0 ? "successful" : "failed",
+	       bt_gatt_get_mtu(conn));
+}
+
+static void connected(struct bt_conn *conn, uint8_t conn_err)
+{
+	const struct bt_conn_le_phy_param phy =
+	{
+		.options = BT_CONN_LE_PHY_OPT_NONE,
+		.pref_tx_phy = BENCH_PHY,
+		.pref_rx_phy = BENCH_PHY,
+	};
+	int err;
+
+	if (conn_err) {
+		printk("Connection failed (err %u)\n", conn_err);
+		bt_conn_unref(default_conn);
+		default_conn = NULL;
+		bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+		return;
+	}
+
+	printk("Connected\n");
+
+	err = bt_conn_le_phy_update(conn, &phy);
+	if (err) {
+		printk("PHY update failed (err %d)\n", err);
+	}
+
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		printk("Data length update failed (err %d)\n", err);
+	}
+
+	if (IS_ENABLED(CONFIG_BENCH_MTU_EXCHANGE)) {
+		exchange_params.func = exchange_func;
+		err = bt_gatt_exchange_mtu(conn, &exchange_params);
+		if (err) {
+			printk("MTU exchange failed (err %d)\n", err);
+		}
+	}
+
+	err = bt_gatt_dm_start(conn, BT_UUID_MY_SERVICE, &my_service_discovery_cb, NULL);
+	if (err) {
+		printk("Could not start the discovery procedure (err %d)\n", err);
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	printk("Disconnected (reason %u)\n", reason);
+
+	if (default_conn == conn) {
+		bt_conn_unref(default_conn);
+		default_conn = NULL;
+	}
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	printk("Connection interval %u.%02u ms, latency %u\n",
+	       interval * 5 / 4, (interval * 125) % 100, latency);
+}
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	printk("PHY updated, TX %u RX %u\n", param->tx_phy, param->rx_phy);
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	printk("Data length updated, TX %u bytes RX %u bytes\n",
+	       info->tx_max_len, info->rx_max_len);
+}
+
+static struct bt_conn_cb conn_callbacks =
+{
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+	.le_phy_updated = le_phy_updated,
+	.le_data_len_updated = le_data_len_updated,
+};
+
+/* Account one frame received on either the TX characteristic or the
+ * L2CAP channel.
+ */
+static void bench_rx(const void *data, uint16_t length)
+{
+	const struct bench_hdr *hdr = data;
+	uint32_t now = k_cycle_get_32();
+	uint32_t seq;
+	uint32_t lat_us;
+
+	if (length < sizeof(*hdr)) {
+		return;
+	}
+
+	seq = sys_le32_to_cpu(hdr->seq);
+	lat_us = k_cyc_to_us_floor32(now - sys_le32_to_cpu(hdr->timestamp));
+
+	if (rx.frames == 0) {
+		rx.first_cyc = now;
+		rx.lat_min_us = UINT32_MAX;
+	} else if (seq < rx.next_seq) {
+		rx.reordered++;
+	}
+
+	if (seq > rx.next_seq) {
+		rx.lost += seq - rx.next_seq;
+	}
+
+	rx.next_seq = MAX(rx.next_seq, seq + 1);
+	rx.frames++;
+	rx.bytes += length;
+	rx.last_cyc = now;
+	rx.lat_min_us = MIN(rx.lat_min_us, lat_us);
+	rx.lat_max_us = MAX(rx.lat_max_us, lat_us);
+	rx.lat_sum_us += lat_us;
+}
+
+/* Decode a frame as it arrived, the bytes on air are counted before decoding */
+static void bench_rx_coded(const void *data, uint16_t length)
+{
+	int len;
+
+	rx.coded_bytes += length;
+
+	if (BENCH_CODEC == MY_SERVICE_CODEC_RAW) {
+		bench_rx(data, length);
+		return;
+	}
+
+	len = my_service_codec_decode(&rx_codec, data, length, rx_frame, sizeof(rx_frame));
+	if (len < 0) {
+		/* Lost sync, or a corrupt frame, until the next keyframe */
+		rx.undecoded++;
+		return;
+	}
+
+	bench_rx(rx_frame, len);
+}
+
+static uint8_t on_notify(struct bt_conn *conn,
+			 struct bt_gatt_subscribe_params *params,
+			 const void *data, uint16_t length)
+{
+	if (!data) {
+		params->value_handle = 0;
+		return BT_GATT_ITER_STOP;
+	}
+
+	bench_rx_coded(data, length);
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+#if defined(CONFIG_BENCH_L2CAP)
+static struct net_buf *l2cap_alloc_buf(struct bt_l2cap_chan *chan)
+{
+	return net_buf_alloc(&l2cap_rx_pool, K_FOREVER);
+}
+
+static int l2cap_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	bench_rx_coded(buf->data, buf->len);
+
+	return 0;
+}
+
+static void l2cap_connected(struct bt_l2cap_chan *chan)
+{
+	printk("L2CAP channel connected, RX MTU %u MPS %u\n",
+	       l2cap_chan.rx.mtu, l2cap_chan.rx.mps);
+
+	k_sem_give(&l2cap_ready);
+}
+
+static void l2cap_disconnected(struct bt_l2cap_chan *chan)
+{
+	printk("L2CAP channel disconnected\n");
+}
+
+static const struct bt_l2cap_chan_ops l2cap_ops =
+{
+	.alloc_buf = l2cap_alloc_buf,
+	.recv = l2cap_recv,
+	.connected = l2cap_connected,
+	.disconnected = l2cap_disconnected,
+};
+
+static int bench_l2cap_connect(void)
+{
+	l2cap_chan.chan.ops = &l2cap_ops;
+	l2cap_chan.rx.mtu = CONFIG_BENCH_L2CAP_MTU;
+	/* Enough credits for a full SDU pool, so the peer never stalls on us */
+	l2cap_chan.rx.init_credits = CONFIG_BENCH_L2CAP_RX_BUF_COUNT *
+		DIV_ROUND_UP(CONFIG_BENCH_L2CAP_MTU + 2, BT_L2CAP_RX_MTU);
+
+	return bt_l2cap_chan_connect(default_conn, &l2cap_chan.chan, peer_psm);
+}
+#endif
+
+static void on_write(struct bt_conn *conn, uint8_t err,
+		     struct bt_gatt_write_params *params)
+{
+	gatt_err = err;
+	k_sem_give(&gatt_done);
+}
+
+static uint8_t on_read(struct bt_conn *conn, uint8_t err,
+		       struct bt_gatt_read_params *params,
+		       const void *data, uint16_t length)
+{
+	/* Long values come in pieces, the end is signalled without data */
+	if (!err && data) {
+		if (params->single.offset + length > sizeof(read_buf)) {
+			gatt_err = BT_ATT_ERR_INVALID_ATTRIBUTE_LEN;
+			k_sem_give(&gatt_done);
+			return BT_GATT_ITER_STOP;
+		}
+
+		memcpy(&read_buf[params->single.offset], data, length);
+		read_len = params->single.offset + length;
+		return BT_GATT_ITER_CONTINUE;
+	}
+
+	gatt_err = err;
+
+	if (!err && read_len == sizeof(peer_stats)) {
+		memcpy(&peer_stats, read_buf, sizeof(peer_stats));
+	} else if (!err && read_len == sizeof(peer_psm)) {
+		peer_psm = sys_get_le16(read_buf);
+	} else if (!err) {
+		printk("Read of %u bytes, expected %u or %u\n", read_len,
+		       (unsigned int)sizeof(peer_stats), (unsigned int)sizeof(peer_psm));
+		gatt_err = BT_ATT_ERR_INVALID_ATTRIBUTE_LEN;
+	}
+
+	k_sem_give(&gatt_done);
+
+	return BT_GATT_ITER_STOP;
+}
+
+static int bench_ctrl_write(uint8_t op)
+{
+	static struct bench_ctrl ctrl;
+	int err;
+
+	ctrl.op = op;
+	ctrl.len = sys_cpu_to_le16(CONFIG_BENCH_FRAME_LEN);
+	ctrl.rate_hz = sys_cpu_to_le16(CONFIG_BENCH_RATE_HZ);
+	ctrl.count = 0;
+
+	write_params.func = on_write;
+	write_params.handle = handles.ctrl;
+	write_params.offset = 0;
+	write_params.data = &ctrl;
+	write_params.length = sizeof(ctrl);
+
+	err = bt_gatt_write(default_conn, &write_params);
+	if (err) {
+		return err;
+	}
+
+	k_sem_take(&gatt_done, K_FOREVER);
+
+	return gatt_err ? -EIO : 0;
+}
+
+static int bench_codec_write(void)
+{
+	static struct my_service_codec_ctrl ctrl;
+	int err;
+
+	ctrl.mode = BENCH_CODEC;
+	ctrl.keyframe_interval = CONFIG_BENCH_CODEC_KEYFRAME_INTERVAL;
+
+	write_params.func = on_write;
+	write_params.handle = handles.codec;
+	write_params.offset = 0;
+	write_params.data = &ctrl;
+	write_params.length = sizeof(ctrl);
+
+	err = bt_gatt_write(default_conn, &write_params);
+	if (err) {
+		return err;
+	}
+
+	k_sem_take(&gatt_done, K_FOREVER);
+
+	return gatt_err ? -EIO : 0;
+}
+
+static int bench_read(uint16_t handle)
+{
+	int err;
+
+	read_params.func = on_read;
+	read_params.handle_count = 1;
+	read_params.single.handle = handle;
+	read_params.single.offset = 0;
+	read_len = 0;
+
+	err = bt_gatt_read(default_conn, &read_params);
+	if (err) {
+		return err;
+	}
+
+	k_sem_take(&gatt_done, K_FOREVER);
+
+	return gatt_err ? -EIO : 0;
+}
+
+static void bench_report(void)
+{
+	struct bt_conn_info info;
+	uint32_t codec_frames;
+	uint32_t codec_in;
+	uint32_t codec_out;
+	uint32_t elapsed_us = k_cyc_to_us_floor32(rx.last_cyc - rx.first_cyc);
+	uint32_t goodput_bps = elapsed_us ?
+		(uint32_t)(((uint64_t)rx.bytes * 8U * USEC_PER_SEC) / elapsed_us) : 0;
+
+	bt_conn_get_info(default_conn, &info);
+
+	printk("BENCH CONFIG: path=%s%s phy=%u mtu=%u interval=%u len=%u rate=%u\n",
+	       IS_ENABLED(CONFIG_BENCH_L2CAP) ? "l2cap" : "gatt",
+	       IS_ENABLED(CONFIG_BENCH_INDICATE) ? "-indicate" : "",
+	       BENCH_PHY, bt_gatt_get_mtu(default_conn), info.le.interval,
+	       CONFIG_BENCH_FRAME_LEN, CONFIG_BENCH_RATE_HZ);
+	printk("BENCH RX: frames=%u bytes=%u coded_bytes=%u lost=%u reordered=%u goodput_bps=%u\n",
+	       rx.frames, rx.bytes, rx.coded_bytes, rx.lost, rx.reordered, goodput_bps);
+	printk("BENCH LATENCY: min_us=%u avg_us=%u max_us=%u\n",
+	       rx.frames ? rx.lat_min_us : 0,
+	       rx.frames ? (uint32_t)(rx.lat_sum_us / rx.frames) : 0,
+	       rx.lat_max_us);
+	printk("BENCH PEER: frames=%u sent=%u dropped=%u enomem=%u bytes=%u elapsed_ms=%u\n",
+	       sys_le32_to_cpu(peer_stats.frames), sys_le32_to_cpu(peer_stats.sent),
+	       sys_le32_to_cpu(peer_stats.dropped), sys_le32_to_cpu(peer_stats.enomem),
+	       sys_le32_to_cpu(peer_stats.bytes), sys_le32_to_cpu(peer_stats.elapsed_ms));
+	printk("BENCH PATH: gatt_bytes=%u l2cap_bytes=%u\n",
+	       sys_le32_to_cpu(peer_stats.gatt_bytes), sys_le32_to_cpu(peer_stats.l2cap_bytes));
+	printk("BENCH INDICATE: retries=%u timeouts=%u failed=%u\n",
+	       sys_le32_to_cpu(peer_stats.ind_retries), sys_le32_to_cpu(peer_stats.ind_timeouts),
+	       sys_le32_to_cpu(peer_stats.ind_failed));
+	printk("BENCH BOOT: adv_us=%u\n", sys_le32_to_cpu(peer_stats.boot_adv_us));
+
+	codec_frames = sys_le32_to_cpu(peer_stats.codec_frames);
+	codec_in = sys_le32_to_cpu(peer_stats.codec_in_bytes);
+	codec_out = sys_le32_to_cpu(peer_stats.codec_out_bytes);
+
+	printk("BENCH CODEC: mode=%u frames=%u keyframes=%u in_bytes=%u out_bytes=%u "
+	       "ratio_pct=%u undecoded=%u\n",
+	       sys_le32_to_cpu(peer_stats.codec_mode), codec_frames,
+	       sys_le32_to_cpu(peer_stats.codec_keyframes), codec_in, codec_out,
+	       codec_in ? (uint32_t)((uint64_t)codec_out * 100U / codec_in) : 100U,
+	       rx.undecoded);
+	printk("BENCH CODEC CPU: cycles_per_frame=%u cycles_max=%u cycles_per_sec=%u\n",
+	       codec_frames ? sys_le32_to_cpu(peer_stats.codec_cycles) / codec_frames : 0,
+	       sys_le32_to_cpu(peer_stats.codec_cycles_max),
+	       sys_le32_to_cpu(peer_stats.codec_cycles_per_sec));
+
+	if (sys_le32_to_cpu(peer_stats.cycles_per_sec) != sys_clock_hw_cycles_per_sec()) {
+		printk("Warning, peer timestamps use a different clock, latency is invalid\n");
+	}
+}
+
+static void scan_init(void)
+{
+	struct bt_scan_init_param param =
+	{
+		.scan_param = NULL,
+		.conn_param = &conn_param,
+		.connect_if_match = 1,
+	};
+	int err;
+
+	bt_scan_init(&param);
+	bt_scan_cb_register(&scan_cb);
+
+	err = bt_scan_filter_add(BT_SCAN_FILTER_TYPE_UUID, BT_UUID_MY_SERVICE);
+	if (err) {
+		printk("Scanning filters cannot be set (err %d)\n", err);
+		return;
+	}
+
+	err = bt_scan_filter_enable(BT_SCAN_UUID_FILTER, false);
+	if (err) {
+		printk("Filters cannot be turned on (err %d)\n", err);
+	}
+}
+
+void main(void)
+{
+	int err;
+
+	printk("Starting benchmark central\n");
+
+	bt_conn_cb_register(&conn_callbacks);
+
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	scan_init();
+
+	err = bt_scan_start(BT_SCAN_TYPE_SCAN_ACTIVE);
+	if (err) {
+		printk("Scanning failed to start (err %d)\n", err);
+		return;
+	}
+
+	k_sem_take(&discovered, K_FOREVER);
+
+	/* Let the PHY, data length and MTU procedures settle first */
+	k_sleep(K_MSEC(500));
+
+	my_service_codec_init(&rx_codec, BENCH_CODEC, 1);
+
+	/* The codec applies from the next frame, so it is set before subscribing */
+	if (BENCH_CODEC != MY_SERVICE_CODEC_RAW) {
+		if (!handles.codec) {
+			printk("Peer does not offer a codec\n");
+			return;
+		}
+
+		err = bench_codec_write();
+		if (err) {
+			printk("Could not set the codec (err %d)\n", err);
+			return;
+		}
+	}
+
+	subscribe_params.notify = on_notify;
+	subscribe_params.value = IS_ENABLED(CONFIG_BENCH_INDICATE) ?
+				 BT_GATT_CCC_INDICATE : BT_GATT_CCC_NOTIFY;
+	subscribe_params.value_handle = handles.tx;
+	subscribe_params.ccc_handle = handles.tx_ccc;
+	atomic_set_bit(subscribe_params.flags, BT_GATT_SUBSCRIBE_FLAG_VOLATILE);
+
+	err = bt_gatt_subscribe(default_conn, &subscribe_params);
+	if (err) {
+		printk("Subscribe failed (err %d)\n", err);
+		return;
+	}
+
+#if defined(CONFIG_BENCH_L2CAP)
+	if (!handles.psm || bench_read(handles.psm) || !peer_psm) {
+		printk("Peer does not offer an L2CAP channel\n");
+		return;
+	}
+
+	err = bench_l2cap_connect();
+	if (err) {
+		printk("L2CAP connect failed (err %d)\n", err);
+		return;
+	}
+
+	k_sem_take(&l2cap_ready, K_FOREVER);
+#endif
+
+	err = bench_ctrl_write(BENCH_OP_START);
+	if (err) {
+		printk("Could not start the stream (err %d)\n", err);
+		return;
+	}
+
+	k_sleep(K_SECONDS(CONFIG_BENCH_DURATION_SEC));
+
+	err = bench_ctrl_write(BENCH_OP_STOP);
+	if (err) {
+		printk("Could not stop the stream (err %d)\n", err);
+	}
+
+	/* Frames already queued in the peer are still counted */
+	k_sleep(K_MSEC(500));
+
+	err = bench_read(handles.stats);
+	if (err) {
+		printk("Could not read peer stats (err %d)\n", err);
+	}
+
+	bench_report();
+
+	bt_conn_disconnect(default_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Receiver of the ble_peripheral_cus_service periodic advertising
+	broadcast. Scans for the broadcaster, syncs to its periodic
+	advertising train, reassembles the fragmented messages and reports
+	the delivered rate and the messages lost.
+*/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#include "pa_stream.h"
+
+static K_SEM_DEFINE(found, 0, 1);
+static K_SEM_DEFINE(synced, 0, 1);
+static K_SEM_DEFINE(sync_lost, 0, 1);
+
+static bt_addr_le_t found_addr;
+static uint8_t found_sid;
+static bool found_pending;
+
+/* Reassembly state and counters, updated from the BT RX thread */
+static struct {
+	bool started;
+	uint16_t seq;
+	uint8_t frag_count;
+	uint32_t frag_mask;
+	uint16_t msg_len;
+	uint32_t messages;
+	uint32_t bytes;
+	uint32_t lost;
+	uint32_t incomplete;
+	uint32_t fragments;
+	uint32_t repeated;
+	uint32_t truncated;
+	uint32_t reported_messages;
+	uint32_t reported_bytes;
+} rx;
+
+static bool name_cb(struct bt_data *data, void *user_data)
+{
+	char *name = user_data;
+
+	if (data->type == BT_DATA_NAME_COMPLETE || data->type == BT_DATA_NAME_SHORTENED) {
+		memcpy(name, data->data, MIN(data->data_len, 31));
+		return false;
+	}
+
+	return true;
+}
+
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *buf)
+{
+	char name[32] = { 0 };
+
+	/* Only advertisers with a periodic advertising train */
+	if (!info->interval || found_pending) {
+		return;
+	}
+
+	bt_data_parse(buf, name_cb, name);
+	if (strcmp(name, CONFIG_PA_RECEIVER_NAME)) {
+		return;
+	}
+
+	bt_addr_le_copy(&found_addr, info->addr);
+	found_sid = info->sid;
+	found_pending = true;
+	k_sem_give(&found);
+}
+
+static struct bt_le_scan_cb scan_callbacks =
+{
+	.recv = scan_recv,
+};
+
+/* Set in frag_mask once the message has been counted as delivered */
+#define MSG_DELIVERED BIT(31)
+
+static void rx_message_done(void)
+{
+	if (!(rx.frag_mask & MSG_DELIVERED)) {
+		rx.incomplete++;
+	}
+}
+
+static void rx_fragment(const struct pa_stream_hdr *hdr, uint16_t len)
+{
+	uint16_t seq = sys_le16_to_cpu(hdr->seq);
+
+	if (hdr->frag >= hdr->frag_count || hdr->frag_count > 31) {
+		return;
+	}
+
+	if (rx.started && seq == rx.seq) {
+		if (rx.frag_mask & BIT(hdr->frag)) {
+			/* Broadcaster had nothing new for this event */
+			rx.repeated++;
+			return;
+		}
+	} else {
+		if (rx.started) {
+			rx_message_done();
+			rx.lost += (uint16_t)(seq - rx.seq - 1);
+		}
+
+		rx.started = true;
+		rx.seq = seq;
+		rx.frag_count = hdr->frag_count;
+		rx.frag_mask = 0;
+		rx.msg_len = 0;
+	}
+
+	rx.fragments++;
+	rx.frag_mask |= BIT(hdr->frag);
+	rx.msg_len += len;
+
+	/* Count the message as soon as it is complete */
+	if (rx.frag_mask == BIT_MASK(rx.frag_count)) {
+		rx.messages++;
+		rx.bytes += rx.msg_len;
+		rx.frag_mask |= MSG_DELIVERED;
+	}
+}
+
+static bool pa_data_cb(struct bt_data *data, void *user_data)
+{
+	const struct pa_stream_hdr *hdr = (const struct pa_stream_hdr *)data->data;
+
+	if (data->type != BT_DATA_MANUFACTURER_DATA || data->data_len < sizeof(*hdr) ||
+	    sys_le16_to_cpu(hdr->company_id) != PA_STREAM_COMPANY_ID) {
+		return true;
+	}
+
+	rx_fragment(hdr, data->data_len - sizeof(*hdr));
+
+	return false;
+}
+
+static void sync_synced(struct bt_le_per_adv_sync *sync,
+			struct bt_le_per_adv_sync_synced_info *info)
+{
+	printk("PA synced, interval %u us, phy %u\n", info->interval * 1250, info->phy);
+	k_sem_give(&synced);
+}
+
+static void sync_term(struct bt_le_per_adv_sync *sync,
+		      const struct bt_le_per_adv_sync_term_info *info)
+{
+	printk("PA sync lost (reason %u)\n", info->reason);
+	k_sem_give(&sync_lost);
+}
+
+static void sync_recv(struct bt_le_per_adv_sync *sync,
+		      const struct bt_le_per_adv_sync_recv_info *info,
+		      struct net_buf_simple *buf)
+{
+	if (info->data_status != BT_HCI_LE_ADV_EVT_TYPE_DATA_STATUS_COMPLETE) {
+		rx.truncated++;
+		return;
+	}
+
+	bt_data_parse(buf, pa_data_cb, NULL);
+}
+
+static struct bt_le_per_adv_sync_cb sync_callbacks =
+{
+	.synced = sync_synced,
+	.term = sync_term,
+	.recv = sync_recv,
+};
+
+static void report(uint32_t elapsed_ms)
+{
+	uint32_t messages = rx.messages;
+	uint32_t bytes = rx.bytes;
+
+	printk("PA RX: msgs=%u bytes=%u lost=%u incomplete=%u fragments=%u repeated=%u "
+	       "truncated=%u msg_rate=%u rate_bps=%u\n",
+	       messages, bytes, rx.lost, rx.incomplete, rx.fragments, rx.repeated,
+	       rx.truncated,
+	       (messages - rx.reported_messages) * 1000 / elapsed_ms,
+	       (uint32_t)((uint64_t)(bytes - rx.reported_bytes) * 8 * 1000 / elapsed_ms));
+
+	rx.reported_messages = messages;
+	rx.reported_bytes = bytes;
+}
+
+static int sync_to_broadcaster(struct bt_le_per_adv_sync **sync)
+{
+	struct bt_le_per_adv_sync_param param = { 0 };
+	int err;
+
+	memset(&rx, 0, sizeof(rx));
+	found_pending = false;
+	k_sem_reset(&found);
+	k_sem_reset(&synced);
+	k_sem_reset(&sync_lost);
+
+	err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, NULL);
+	if (err) {
+		printk("Scanning failed to start (err %d)\n", err);
+		return err;
+	}
+
+	printk("Scanning for %s\n", CONFIG_PA_RECEIVER_NAME);
+	k_sem_take(&found, K_FOREVER);
+
+	bt_addr_le_copy(&param.addr, &found_addr);
+	param.sid = found_sid;
+	param.skip = 0;
+	param.timeout = CONFIG_PA_RECEIVER_SYNC_TIMEOUT;
+
+	err = bt_le_per_adv_sync_create(&param, sync);
+	if (!err) {
+		err = k_sem_take(&synced, K_MSEC(CONFIG_PA_RECEIVER_SYNC_TIMEOUT * 10 * 5));
+		if (err) {
+			printk("Sync timed out\n");
+			bt_le_per_adv_sync_delete(*sync);
+		}
+	} else {
+		printk("Sync create failed (err %d)\n", err);
+	}
+
+	bt_le_scan_stop();
+
+	return err;
+}
+
+void main(void)
+{
+	struct bt_le_per_adv_sync *sync;
+	int64_t last_ms;
+	int err;
+
+	printk("Starting periodic advertising receiver\n");
+
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	bt_le_scan_cb_register(&scan_callbacks);
+	bt_le_per_adv_sync_cb_register(&sync_callbacks);
+
+	for (;;) {
+		if (sync_to_broadcaster(&sync)) {
+			k_sleep(K_SECONDS(1));
+			continue;
+		}
+
+		last_ms = k_uptime_get();
+
+		while (k_sem_take(&sync_lost, K_SECONDS(CONFIG_PA_RECEIVER_REPORT_SEC))) {
+			int64_t now = k_uptime_get();
+
+			report((uint32_t)(now - last_ms));
+			last_ms = now;
+		}
+	}
+}
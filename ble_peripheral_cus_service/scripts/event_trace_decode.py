@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2022 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+#
+
+"""Decode the event trace recorded by src/event_trace.c.
+
+Reads either a console log with "TRC <hex>" lines (the console backend,
+other lines are ignored) or a raw binary dump of the RTT trace channel
+(--binary), and prints one line per event with its time since the trace
+started. Keep EVENTS in sync with enum event_trace_id.
+"""
+
+import argparse
+import struct
+import sys
+
+RECORD = struct.Struct('<IBBHII')
+
+ADV_PHASES = {1: 'directed', 2: 'fast', 3: 'slow'}
+
+# Order of MY_SERVICE_STREAMS in services/my_service.h
+STREAMS = {0: 'data', 1: 'status', 2: 'log'}
+
+# id: (name, formatter of arg0/arg1)
+EVENTS = {
+    0x01: ('START', lambda a0, a1: f'cycles_per_sec={a0}'),
+    0x02: ('OVERFLOW', lambda a0, a1: f'lost={a0}'),
+    0x10: ('CONNECTED', lambda a0, a1: f'err={a0} interval={a1 & 0xffff} latency={a1 >> 16}'),
+    0x11: ('DISCONNECTED', lambda a0, a1: f'reason=0x{a0:02x}'),
+    0x12: ('PARAM_UPDATED', lambda a0, a1: f'interval={a0 & 0xffff} latency={a0 >> 16} timeout={a1}'),
+    0x13: ('RECONNECT', lambda a0, a1: f'gap_ms={a0} phase={ADV_PHASES.get(a1, a1)}'),
+    0x20: ('NOTIFY_SENT', lambda a0, a1: f'pending={a0} stream={STREAMS.get(a1, a1)}'),
+    0x21: ('SEND_ERR', lambda a0, a1: f'err={signed(a0)} len={a1}'),
+    0x22: ('RX', lambda a0, a1: f'len={a0} head=0x{a1:08x}'),
+    0x23: ('CCC', lambda a0, a1: f'value=0x{a0:04x} stream={STREAMS.get(a1, a1)}'),
+    0x30: ('SAMPLE', lambda a0, a1: f'seq={a0} jitter_cyc={signed(a1)}'),
+}
+
+
+def signed(value):
+    return value - (1 << 32) if value & (1 << 31) else value
+
+
+def records_from_console(stream):
+    for line in stream:
+        line = line.strip()
+        pos = line.find('TRC ')
+        if pos < 0:
+            continue
+        try:
+            raw = bytes.fromhex(line[pos + 4:pos + 4 + RECORD.size * 2])
+        except ValueError:
+            continue
+        if len(raw) == RECORD.size:
+            yield RECORD.unpack(raw)
+
+
+def records_from_binary(stream):
+    while True:
+        raw = stream.read(RECORD.size)
+        if len(raw) < RECORD.size:
+            return
+        yield RECORD.unpack(raw)
+
+
+def decode(records, cycles_per_sec):
+    start = None
+    last = 0
+    elapsed = 0
+    expected_seq = None
+
+    for timestamp, event_id, _, seq, arg0, arg1 in records:
+        if event_id == 0x01:
+            cycles_per_sec = arg0
+            start = timestamp
+            last = timestamp
+            elapsed = 0
+            expected_seq = None
+
+        if start is None:
+            start = last = timestamp
+
+        # The cycle counter is 32 bits wide, accumulate deltas across wraps
+        elapsed += (timestamp - last) & 0xffffffff
+        last = timestamp
+
+        if expected_seq is not None and seq != expected_seq:
+            print(f'# {(seq - expected_seq) & 0xffff} events lost')
+        expected_seq = (seq + 1) & 0xffff
+
+        name, fmt = EVENTS.get(event_id, (f'0x{event_id:02x}', lambda a0, a1: f'{a0:#x} {a1:#x}'))
+        usec = elapsed * 1000000 // cycles_per_sec
+        print(f'{usec // 1000000:6d}.{usec % 1000000:06d} {seq:5d} {name:<14} {fmt(arg0, arg1)}')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('file', nargs='?', help='log or dump to decode, stdin if omitted')
+    parser.add_argument('--binary', action='store_true',
+                        help='input is a raw dump of the RTT trace channel')
+    parser.add_argument('--cycles-per-sec', type=int, default=32768,
+                        help='cycle counter frequency until a START event is seen')
+    args = parser.parse_args()
+
+    if args.binary:
+        stream = open(args.file, 'rb') if args.file else sys.stdin.buffer
+        records = records_from_binary(stream)
+    else:
+        stream = open(args.file, 'r', errors='replace') if args.file else sys.stdin
+        records = records_from_console(stream)
+
+    decode(records, args.cycles_per_sec)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,301 @@
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "my_service.h"
+#include "bench_service.h"
+#include "../src/boot_time.h"
+
+#define BT_UUID_BENCH_SERVICE   BT_UUID_DECLARE_128(BENCH_SERVICE_UUID)
+#define BT_UUID_BENCH_CTRL      BT_UUID_DECLARE_128(BENCH_CTRL_CHARACTERISTIC_UUID)
+#define BT_UUID_BENCH_STATS     BT_UUID_DECLARE_128(BENCH_STATS_CHARACTERISTIC_UUID)
+
+/* Frames can be as large as an L2CAP SDU when the peer opened the channel */
+#if defined(CONFIG_MY_SERVICE_L2CAP)
+#define BENCH_FRAME_MAX MAX(244, CONFIG_MY_SERVICE_L2CAP_MTU)
+#else
+#define BENCH_FRAME_MAX 244
+#endif
+
+static K_SEM_DEFINE(bench_start, 0, 1);
+
+/* Stream request, written from the BT RX thread and consumed by bench_thread */
+static struct bt_conn *bench_conn;
+static uint16_t bench_len;
+static uint16_t bench_rate_hz;
+static uint32_t bench_count;
+static atomic_t bench_running;
+/* Set from START until bench_thread has released bench_conn, a STOP only
+ * clears bench_running and the thread may still be using the connection.
+ */
+static atomic_t bench_busy;
+
+/* Stream results */
+static uint32_t bench_frames;
+static uint32_t bench_bytes;
+static uint32_t bench_missed;
+static int64_t bench_start_ms;
+static int64_t bench_stop_ms;
+
+static uint8_t frame[BENCH_FRAME_MAX];
+
+bool bench_service_running(void)
+{
+	return atomic_get(&bench_running);
+}
+
+static void bench_reset(void)
+{
+	my_service_stats_reset();
+	bench_frames = 0;
+	bench_bytes = 0;
+	bench_missed = 0;
+	bench_start_ms = k_uptime_get();
+	bench_stop_ms = bench_start_ms;
+}
+
+static ssize_t on_ctrl_write(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr,
+			     const void *buf,
+			     uint16_t len,
+			     uint16_t offset,
+			     uint8_t flags)
+{
+	const uint8_t *ctrl = buf;
+	uint16_t frame_len;
+
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (len < 1) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	switch (ctrl[0]) {
+	case BENCH_OP_START:
+		if (len != sizeof(struct bench_ctrl)) {
+			return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+		}
+
+		frame_len = sys_get_le16(&ctrl[offsetof(struct bench_ctrl, len)]);
+		if (frame_len < sizeof(struct bench_hdr)) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+
+		/* Refused until the previous stream has fully wound down */
+		if (!atomic_cas(&bench_busy, false, true)) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+
+		bench_len = frame_len;
+		bench_rate_hz = sys_get_le16(&ctrl[offsetof(struct bench_ctrl, rate_hz)]);
+		bench_count = sys_get_le32(&ctrl[offsetof(struct bench_ctrl, count)]);
+		bench_conn = bt_conn_ref(conn);
+		atomic_set(&bench_running, true);
+		k_sem_give(&bench_start);
+		break;
+
+	case BENCH_OP_STOP:
+		atomic_set(&bench_running, false);
+		break;
+
+	case BENCH_OP_RESET:
+		if (atomic_get(&bench_busy)) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+		bench_reset();
+		break;
+
+	default:
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	return len;
+}
+
+static ssize_t on_stats_read(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr,
+			     void *buf,
+			     uint16_t len,
+			     uint16_t offset)
+{
+	struct my_service_stats tx;
+	struct my_service_codec_stats codec;
+	struct bench_stats stats;
+	int64_t stop_ms = atomic_get(&bench_running) ? k_uptime_get() : bench_stop_ms;
+
+	my_service_stats_get(&tx);
+	my_service_codec_stats_get(&codec);
+
+	stats.frames         = sys_cpu_to_le32(bench_frames);
+	stats.sent           = sys_cpu_to_le32(tx.sent);
+	stats.dropped        = sys_cpu_to_le32(tx.dropped + bench_missed);
+	stats.enomem         = sys_cpu_to_le32(tx.enomem);
+	stats.bytes          = sys_cpu_to_le32(bench_bytes);
+	stats.elapsed_ms     = sys_cpu_to_le32((uint32_t)(stop_ms - bench_start_ms));
+	stats.cycles_per_sec = sys_cpu_to_le32(sys_clock_hw_cycles_per_sec());
+	stats.gatt_bytes     = sys_cpu_to_le32(tx.gatt_bytes);
+	stats.l2cap_bytes    = sys_cpu_to_le32(tx.l2cap_bytes);
+	stats.ind_retries    = sys_cpu_to_le32(tx.ind_retries);
+	stats.ind_timeouts   = sys_cpu_to_le32(tx.ind_timeouts);
+	stats.ind_failed     = sys_cpu_to_le32(tx.ind_failed);
+	stats.boot_adv_us    = sys_cpu_to_le32(boot_time_us(BOOT_STAGE_ADV_START));
+	stats.codec_mode           = sys_cpu_to_le32(codec.mode);
+	stats.codec_frames         = sys_cpu_to_le32(codec.frames);
+	stats.codec_keyframes      = sys_cpu_to_le32(codec.keyframes);
+	stats.codec_in_bytes       = sys_cpu_to_le32(codec.in_bytes);
+	stats.codec_out_bytes      = sys_cpu_to_le32(codec.out_bytes);
+	stats.codec_cycles         = sys_cpu_to_le32(codec.cycles);
+	stats.codec_cycles_max     = sys_cpu_to_le32(codec.cycles_max);
+	stats.codec_cycles_per_sec = sys_cpu_to_le32(codec.cycles_per_sec);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats, sizeof(stats));
+}
+
+BT_GATT_SERVICE_DEFINE(bench_service,
+BT_GATT_PRIMARY_SERVICE(BT_UUID_BENCH_SERVICE),
+BT_GATT_CHARACTERISTIC(BT_UUID_BENCH_CTRL,
+		       BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+		       BT_GATT_PERM_WRITE,
+		       NULL, on_ctrl_write, NULL),
+BT_GATT_CHARACTERISTIC(BT_UUID_BENCH_STATS,
+		       BT_GATT_CHRC_READ,
+		       BT_GATT_PERM_READ,
+		       on_stats_read, NULL, NULL),
+);
+
+static uint32_t bench_bps(uint32_t bytes, int64_t elapsed_ms)
+{
+	return elapsed_ms > 0 ? (uint32_t)((uint64_t)bytes * 8U * MSEC_PER_SEC / elapsed_ms) : 0;
+}
+
+static void bench_report(void)
+{
+	struct my_service_stats tx;
+	struct my_service_codec_stats codec;
+	int64_t elapsed_ms = bench_stop_ms - bench_start_ms;
+
+	my_service_stats_get(&tx);
+	my_service_codec_stats_get(&codec);
+
+	printk("Bench: stream stopped after %u frames in %u ms, %u periods missed\n",
+	       bench_frames, (uint32_t)elapsed_ms, bench_missed);
+	printk("Bench: GATT %u bytes %u bps, L2CAP %u bytes %u bps\n",
+	       tx.gatt_bytes, bench_bps(tx.gatt_bytes, elapsed_ms),
+	       tx.l2cap_bytes, bench_bps(tx.l2cap_bytes, elapsed_ms));
+
+	if (codec.frames) {
+		printk("Bench: codec %u, %u -> %u bytes, %u cycles/frame (max %u at %u Hz)\n",
+		       codec.mode, codec.in_bytes, codec.out_bytes,
+		       codec.cycles / codec.frames, codec.cycles_max, codec.cycles_per_sec);
+	}
+}
+
+/* Slowly varying 16 bit channels, like a sensor vector, so the codec is
+ * measured on realistic data instead of a constant fill.
+ */
+static void bench_fill(uint8_t *buf, uint16_t len, uint32_t seq)
+{
+	for (uint16_t i = 0; i + 1 < len; i += 2) {
+		uint16_t channel = i / 2;
+
+		sys_put_le16(1000U * channel + seq * (channel % 4 + 1) / 8, &buf[i]);
+	}
+
+	if (len & 1) {
+		buf[len - 1] = (uint8_t)seq;
+	}
+}
+
+static void bench_stream(void)
+{
+	struct bench_hdr *hdr = (struct bench_hdr *)frame;
+	struct k_timer period;
+	uint16_t len = MIN(MIN(bench_len, sizeof(frame)),
+			   my_service_max_payload(bench_conn));
+	uint32_t seq = 0;
+	int err;
+
+	printk("Bench: streaming %u byte frames at %u Hz\n", len, bench_rate_hz);
+
+	bench_reset();
+
+	/* The k_timer keeps the frame rate independent of the time spent in
+	 * my_service_send(); missed periods are accounted as dropped frames.
+	 */
+	k_timer_init(&period, NULL, NULL);
+	if (bench_rate_hz) {
+		k_timer_start(&period, K_NO_WAIT, K_USEC(USEC_PER_SEC / bench_rate_hz));
+	}
+
+	while (atomic_get(&bench_running)) {
+		if (bench_count && seq >= bench_count) {
+			break;
+		}
+
+		if (bench_rate_hz) {
+			uint32_t expired = k_timer_status_sync(&period);
+
+			if (expired > 1) {
+				seq += expired - 1;
+				bench_frames += expired - 1;
+				bench_missed += expired - 1;
+			}
+		}
+
+		bench_fill(&frame[sizeof(*hdr)], len - sizeof(*hdr), seq);
+		hdr->seq = sys_cpu_to_le32(seq);
+		hdr->timestamp = sys_cpu_to_le32(k_cycle_get_32());
+
+		err = my_service_send(bench_conn, frame, len);
+		seq++;
+		bench_frames++;
+
+		if (!err) {
+			bench_bytes += len;
+		} else if (err == -ENOMEM) {
+			/* Give the stack a chance to free TX buffers */
+			if (!bench_rate_hz) {
+				k_sleep(K_MSEC(1));
+			}
+		} else if (err == -ENOTCONN || err == -EACCES) {
+			break;
+		}
+	}
+
+	k_timer_stop(&period);
+	bench_stop_ms = k_uptime_get();
+	atomic_set(&bench_running, false);
+
+	bench_report();
+}
+
+static void bench_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;) {
+		k_sem_take(&bench_start, K_FOREVER);
+
+		bench_stream();
+
+		bt_conn_unref(bench_conn);
+		bench_conn = NULL;
+		atomic_set(&bench_busy, false);
+	}
+}
+
+K_THREAD_DEFINE(bench_tid, CONFIG_BENCH_SERVICE_STACK_SIZE, bench_thread,
+		NULL, NULL, NULL, CONFIG_BENCH_SERVICE_THREAD_PRIORITY, 0, 0);
@@ -0,0 +1,94 @@
+#ifndef BENCH_SERVICE_H_
+#define BENCH_SERVICE_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+
+#define BENCH_SERVICE_UUID 0x3e, 0x51, 0x0b, 0x8a, 0x2d, 0x47, 0x4c, 0x1f, \
+			   0x9a, 0x63, 0x5e, 0x21, 0x10, 0xb0, 0x7c, 0x94
+
+#define BENCH_CTRL_CHARACTERISTIC_UUID  0x3e, 0x51, 0x0b, 0x8a, 0x2d, 0x47, 0x4c, 0x1f, \
+					0x9a, 0x63, 0x5e, 0x21, 0x11, 0xb0, 0x7c, 0x94
+
+#define BENCH_STATS_CHARACTERISTIC_UUID 0x3e, 0x51, 0x0b, 0x8a, 0x2d, 0x47, 0x4c, 0x1f, \
+					0x9a, 0x63, 0x5e, 0x21, 0x12, 0xb0, 0x7c, 0x94
+
+/** @brief Operations accepted by the control characteristic. */
+enum bench_op
+{
+	BENCH_OP_STOP  = 0x00,
+	BENCH_OP_START = 0x01,
+	BENCH_OP_RESET = 0x02,
+};
+
+/** @brief Control characteristic write format (little endian).
+ *
+ *  @c len is the notification payload size including the frame header,
+ *  @c rate_hz is the number of frames per second (0 streams as fast as
+ *  the stack accepts them) and @c count stops the stream after that many
+ *  frames (0 runs until BENCH_OP_STOP).
+ */
+struct bench_ctrl
+{
+	uint8_t  op;
+	uint16_t len;
+	uint16_t rate_hz;
+	uint32_t count;
+} __packed;
+
+/** @brief Header at the start of every benchmark notification. */
+struct bench_hdr
+{
+	/** Frame sequence number, gaps mean frames were dropped. */
+	uint32_t seq;
+	/** k_cycle_get_32() when the frame was handed to the stack. */
+	uint32_t timestamp;
+} __packed;
+
+/** @brief Stats characteristic read format (little endian). */
+struct bench_stats
+{
+	/** Frames generated by the stream, including dropped ones. */
+	uint32_t frames;
+	/** Notifications reported sent by the stack. */
+	uint32_t sent;
+	/** Frames that could not be queued, excluding -ENOMEM, and missed periods. */
+	uint32_t dropped;
+	/** Frames rejected with -ENOMEM. */
+	uint32_t enomem;
+	/** Payload bytes handed to the stack. */
+	uint32_t bytes;
+	/** Duration of the last (or running) stream. */
+	uint32_t elapsed_ms;
+	/** Frequency of the timestamp in struct bench_hdr. */
+	uint32_t cycles_per_sec;
+	/** Payload bytes sent as notifications. */
+	uint32_t gatt_bytes;
+	/** Payload bytes sent on the L2CAP channel. */
+	uint32_t l2cap_bytes;
+	/** Indication submissions retried. */
+	uint32_t ind_retries;
+	/** Indications that timed out or were confirmed late. */
+	uint32_t ind_timeouts;
+	/** Indications the stack refused. */
+	uint32_t ind_failed;
+	/** Time from kernel start until advertising started, in us. */
+	uint32_t boot_adv_us;
+	/** DATA stream codec negotiated by the central, see my_service_codec.h. */
+	uint32_t codec_mode;
+	/** Frames coded, and of those keyframes. */
+	uint32_t codec_frames;
+	uint32_t codec_keyframes;
+	/** Bytes before and after coding. */
+	uint32_t codec_in_bytes;
+	uint32_t codec_out_bytes;
+	/** Coding time in cycles of codec_cycles_per_sec, total and slowest frame. */
+	uint32_t codec_cycles;
+	uint32_t codec_cycles_max;
+	uint32_t codec_cycles_per_sec;
+} __packed;
+
+/** @brief Returns true while a benchmark stream is running. */
+bool bench_service_running(void);
+
+#endif /* BENCH_SERVICE_H_ */
@@ -6,6 +6,9 @@
 #include <sys/byteorder.h>
 #include <zephyr.h>
 #include <soc.h>
+#if defined(CONFIG_TIMING_FUNCTIONS)
+#include <timing/timing.h>
+#endif
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -15,16 +18,56 @@
 #include <bluetooth/gatt.h>
 
 #include "my_service.h"
+#include "my_service_l2cap.h"
+#include "my_service_indicate.h"
+#include "my_service_streams.h"
+#include "my_service_codec.h"
+#include "../src/event_trace.h"
+#include "../src/conn_policy.h"
 
 #define BT_UUID_MY_SERVICE      BT_UUID_DECLARE_128(MY_SERVICE_UUID)
 #define BT_UUID_MY_SERVICE_RX   BT_UUID_DECLARE_128(RX_CHARACTERISTIC_UUID)
 #define BT_UUID_MY_SERVICE_TX   BT_UUID_DECLARE_128(TX_CHARACTERISTIC_UUID)
+#define BT_UUID_MY_SERVICE_PSM  BT_UUID_DECLARE_128(L2CAP_PSM_CHARACTERISTIC_UUID)
+#define BT_UUID_MY_SERVICE_CODEC BT_UUID_DECLARE_128(CODEC_CHARACTERISTIC_UUID)
 
-#define MAX_TRANSMIT_SIZE 240//TODO figure this out
+/* Largest frame my_service_send() accepts, an SDU on the L2CAP channel */
+#if defined(CONFIG_MY_SERVICE_L2CAP)
+#define CODEC_FRAME_MAX MAX(MAX_TRANSMIT_SIZE, CONFIG_MY_SERVICE_L2CAP_MTU)
+#else
+#define CODEC_FRAME_MAX MAX_TRANSMIT_SIZE
+#endif
+
+/*
+	Attribute table: 0 = Primary service, then per stream 3 attributes
+	(characteristic declaration, value, CCC), then the PSM characteristic.
+	The value attribute of each stream is resolved from its index here.
+*/
+#define STREAM_ATTR_INDEX(stream)   (2 + 3 * (stream))
+#define STREAM_ATTR(stream)         (&my_service.attrs[STREAM_ATTR_INDEX(stream)])
+#define STREAM_OF_CCC(attr)         (((attr) - my_service.attrs - 3) / 3)
 
 uint8_t data_rx[MAX_TRANSMIT_SIZE];
 uint8_t data_tx[MAX_TRANSMIT_SIZE];
 
+/* TX counters, updated from the sending thread and from the BT TX callback */
+static atomic_t stat_queued;
+static atomic_t stat_sent;
+static atomic_t stat_dropped;
+static atomic_t stat_enomem;
+static atomic_t stat_gatt_bytes;
+static atomic_t stat_l2cap_bytes;
+
+/* Notifications queued in the stack and not yet reported sent */
+static atomic_t tx_pending;
+
+/* DATA stream encoder, negotiated by the Client. The lock also keeps the
+   reference frame in step with the order frames are queued in. */
+static struct my_service_codec tx_codec;
+static struct my_service_codec_stats codec_stats;
+static uint8_t codec_buf[MY_SERVICE_CODEC_MAX_LEN(CODEC_FRAME_MAX)];
+static K_MUTEX_DEFINE(codec_lock);
+
 int my_service_init(void)
 {
     int err = 0;
@@ -32,9 +75,169 @@ int my_service_init(void)
     memset(&data_rx, 0, MAX_TRANSMIT_SIZE);
     memset(&data_tx, 0, MAX_TRANSMIT_SIZE);
 
+#if defined(CONFIG_TIMING_FUNCTIONS)
+    if (IS_ENABLED(CONFIG_MY_SERVICE_CODEC))
+    {
+        timing_init();
+        timing_start();
+    }
+#endif
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_L2CAP))
+    {
+        err = my_service_l2cap_init();
+    }
+
     return err;
 }
 
+void my_service_stats_get(struct my_service_stats *stats)
+{
+    stats->queued  = atomic_get(&stat_queued);
+    stats->sent    = atomic_get(&stat_sent);
+    stats->dropped = atomic_get(&stat_dropped);
+    stats->enomem  = atomic_get(&stat_enomem);
+    stats->gatt_bytes  = atomic_get(&stat_gatt_bytes);
+    stats->l2cap_bytes = atomic_get(&stat_l2cap_bytes);
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_INDICATE))
+    {
+        struct my_service_indicate_stats ind;
+
+        my_service_indicate_stats_get(&ind);
+        stats->ind_retries  = ind.retries;
+        stats->ind_timeouts = ind.timeouts;
+        stats->ind_failed   = ind.failed;
+    }
+    else
+    {
+        stats->ind_retries  = 0;
+        stats->ind_timeouts = 0;
+        stats->ind_failed   = 0;
+    }
+}
+
+void my_service_stats_reset(void)
+{
+    atomic_clear(&stat_queued);
+    atomic_clear(&stat_sent);
+    atomic_clear(&stat_dropped);
+    atomic_clear(&stat_enomem);
+    atomic_clear(&stat_gatt_bytes);
+    atomic_clear(&stat_l2cap_bytes);
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_INDICATE))
+    {
+        my_service_indicate_stats_reset();
+    }
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_CODEC))
+    {
+        k_mutex_lock(&codec_lock, K_FOREVER);
+        memset(&codec_stats, 0, sizeof(codec_stats));
+        k_mutex_unlock(&codec_lock);
+    }
+}
+
+/* Coding time is measured with the CPU cycle counter where there is one,
+   the system clock is too coarse for a single frame. */
+static uint32_t codec_clock(void)
+{
+#if defined(CONFIG_TIMING_FUNCTIONS)
+    return (uint32_t)timing_counter_get();
+#else
+    return k_cycle_get_32();
+#endif
+}
+
+static uint32_t codec_clock_hz(void)
+{
+#if defined(CONFIG_TIMING_FUNCTIONS)
+    return (uint32_t)timing_freq_get();
+#else
+    return sys_clock_hw_cycles_per_sec();
+#endif
+}
+
+void my_service_codec_stats_get(struct my_service_codec_stats *stats)
+{
+    k_mutex_lock(&codec_lock, K_FOREVER);
+    *stats = codec_stats;
+    stats->mode = tx_codec.mode;
+    k_mutex_unlock(&codec_lock);
+
+    stats->cycles_per_sec = codec_clock_hz();
+}
+
+/* The next frame on the DATA stream has to be a keyframe */
+static void codec_resync(void)
+{
+    k_mutex_lock(&codec_lock, K_FOREVER);
+    my_service_codec_resync(&tx_codec);
+    k_mutex_unlock(&codec_lock);
+}
+
+/* Sent callbacks of notifications still queued at disconnect never arrive */
+static void on_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    atomic_clear(&tx_pending);
+    my_service_streams_flush();
+
+    // The next Client negotiates its own codec
+    if (IS_ENABLED(CONFIG_MY_SERVICE_CODEC))
+    {
+        k_mutex_lock(&codec_lock, K_FOREVER);
+        my_service_codec_init(&tx_codec, MY_SERVICE_CODEC_RAW, 1);
+        k_mutex_unlock(&codec_lock);
+    }
+}
+
+BT_CONN_CB_DEFINE(my_service_conn_callbacks) =
+{
+    .disconnected = on_disconnected,
+};
+
+uint32_t my_service_tx_pending(void)
+{
+    uint32_t pending = atomic_get(&tx_pending) + my_service_streams_queued();
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_L2CAP))
+    {
+        pending += my_service_l2cap_pending();
+    }
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_INDICATE))
+    {
+        pending += my_service_indicate_pending();
+    }
+
+    return pending;
+}
+
+uint16_t my_service_max_payload(struct bt_conn *conn)
+{
+    uint16_t codec_hdr = 0;
+
+    /* Coded frames are at most the header longer, RLE is dropped when it doesn't pay off */
+    if (IS_ENABLED(CONFIG_MY_SERVICE_CODEC))
+    {
+        k_mutex_lock(&codec_lock, K_FOREVER);
+        if (tx_codec.mode != MY_SERVICE_CODEC_RAW)
+        {
+            codec_hdr = sizeof(struct my_service_codec_hdr);
+        }
+        k_mutex_unlock(&codec_lock);
+    }
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_L2CAP) && my_service_l2cap_ready(conn))
+    {
+        return my_service_l2cap_mtu() - codec_hdr;
+    }
+
+    /* ATT notification header is 3 bytes (opcode + handle) */
+    return MIN(bt_gatt_get_mtu(conn) - 3, MAX_TRANSMIT_SIZE) - codec_hdr;
+}
+
 /* This function is called whenever the RX Characteristic has been written to by a Client */
 static ssize_t on_receive(struct bt_conn *conn,
 			  const struct bt_gatt_attr *attr,
@@ -44,35 +247,133 @@ static ssize_t on_receive(struct bt_conn *conn,
 			  uint8_t flags)
 {
     const uint8_t * buffer = buf;
-    
-	printk("Received data, handle %d, conn %p, data: 0x", attr->handle, conn);
-    for(uint8_t i = 0; i < len; i++){
-        printk("%02X", buffer[i]);
+
+    if (IS_ENABLED(CONFIG_CALLBACK_PRINTK))
+    {
+        printk("Received data, handle %d, conn %p, data: 0x", attr->handle, conn);
+        for(uint16_t i = 0; i < len; i++){
+            printk("%02X", buffer[i]);
+        }
+        printk("\n");
     }
-    printk("\n");
 
 	return len;
 }
 
-/* This function is called whenever a Notification has been sent by the TX Characteristic */
+/* This function is called whenever a Notification has been sent by one of the stream Characteristics */
 static void on_sent(struct bt_conn *conn, void *user_data)
 {
-	ARG_UNUSED(user_data);
+    enum my_service_stream stream = POINTER_TO_UINT(user_data);
 
-    const bt_addr_le_t * addr = bt_conn_get_dst(conn);
-        
-	printk("Data sent to Address 0x %02X %02X %02X %02X %02X %02X \n", addr->a.val[0]
-                                                                    , addr->a.val[1]
-                                                                    , addr->a.val[2]
-                                                                    , addr->a.val[3]
-                                                                    , addr->a.val[4]
-                                                                    , addr->a.val[5]);
+    atomic_inc(&stat_sent);
+    atomic_dec(&tx_pending);
+    my_service_streams_on_sent(stream);
+    conn_policy_tx_changed();
+
+    event_trace(EVENT_TRACE_NOTIFY_SENT, atomic_get(&tx_pending), stream);
+
+    if (IS_ENABLED(CONFIG_CALLBACK_PRINTK))
+    {
+        const bt_addr_le_t * addr = bt_conn_get_dst(conn);
+
+        printk("Data sent to Address 0x %02X %02X %02X %02X %02X %02X \n", addr->a.val[0]
+                                                                        , addr->a.val[1]
+                                                                        , addr->a.val[2]
+                                                                        , addr->a.val[3]
+                                                                        , addr->a.val[4]
+                                                                        , addr->a.val[5]);
+    }
+}
+
+void my_service_on_l2cap_sent(void)
+{
+    atomic_inc(&stat_sent);
+    conn_policy_tx_changed();
 }
 
+void my_service_on_indicate_confirmed(void)
+{
+    atomic_inc(&stat_sent);
+    conn_policy_tx_changed();
+}
+
+#if defined(CONFIG_MY_SERVICE_L2CAP)
+/* This function is called whenever the L2CAP PSM Characteristic is read by a Client */
+static ssize_t on_psm_read(struct bt_conn *conn,
+			   const struct bt_gatt_attr *attr,
+			   void *buf,
+			   uint16_t len,
+			   uint16_t offset)
+{
+    uint16_t psm = sys_cpu_to_le16(CONFIG_MY_SERVICE_L2CAP_PSM);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &psm, sizeof(psm));
+}
+#endif
+
+#if defined(CONFIG_MY_SERVICE_CODEC)
+/* This function is called whenever the codec Characteristic is read by a Client */
+static ssize_t on_codec_read(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr,
+			     void *buf,
+			     uint16_t len,
+			     uint16_t offset)
+{
+    struct my_service_codec_ctrl ctrl;
+
+    k_mutex_lock(&codec_lock, K_FOREVER);
+    ctrl.mode = tx_codec.mode;
+    ctrl.keyframe_interval = tx_codec.keyframe_interval;
+    k_mutex_unlock(&codec_lock);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &ctrl, sizeof(ctrl));
+}
+
+/* This function is called whenever the codec Characteristic has been written to by a Client.
+   The codec applies from the next frame, so it should be chosen before subscribing. */
+static ssize_t on_codec_write(struct bt_conn *conn,
+			      const struct bt_gatt_attr *attr,
+			      const void *buf,
+			      uint16_t len,
+			      uint16_t offset,
+			      uint8_t flags)
+{
+    const struct my_service_codec_ctrl *ctrl = buf;
+    uint32_t head = 0;
+
+    memcpy(&head, buf, MIN(len, sizeof(head)));
+    event_trace(EVENT_TRACE_RX, len, sys_le32_to_cpu(head));
+
+    if (offset != 0)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    if (len != sizeof(*ctrl))
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    if (ctrl->mode > MY_SERVICE_CODEC_DELTA_RLE)
+    {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+
+    k_mutex_lock(&codec_lock, K_FOREVER);
+    my_service_codec_init(&tx_codec, ctrl->mode,
+                          ctrl->keyframe_interval ? ctrl->keyframe_interval :
+                                                    CONFIG_MY_SERVICE_CODEC_KEYFRAME_INTERVAL);
+    k_mutex_unlock(&codec_lock);
+
+    return len;
+}
+#endif
+
 /* This function is called whenever the CCCD register has been changed by the client*/
 void on_cccd_changed(const struct bt_gatt_attr *attr, uint16_t value)
 {
-    ARG_UNUSED(attr);
+    event_trace(EVENT_TRACE_CCC, value, STREAM_OF_CCC(attr));
+
     switch(value)
     {
         case BT_GATT_CCC_NOTIFY: 
@@ -81,6 +382,10 @@ void on_cccd_changed(const struct bt_gatt_attr *attr, uint16_t value)
 
         case BT_GATT_CCC_INDICATE: 
             // Start sending stuff via indications
+            if (!IS_ENABLED(CONFIG_MY_SERVICE_INDICATE))
+            {
+                printk("Warning, indications are not supported\n");
+            }
             break;
 
         case 0: 
@@ -93,51 +398,265 @@ void on_cccd_changed(const struct bt_gatt_attr *attr, uint16_t value)
 }
                         
 
+/* Indications are only supported on the DATA stream */
+#define STREAM_PROPS(name) \
+    (BT_GATT_CHRC_NOTIFY | BT_GATT_CHRC_READ | \
+     ((MY_SERVICE_STREAM_##name == MY_SERVICE_STREAM_DATA && \
+       IS_ENABLED(CONFIG_MY_SERVICE_INDICATE)) ? BT_GATT_CHRC_INDICATE : 0))
+
+#define STREAM_ATTRS(name, uuid, priority, weight) \
+BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(uuid), \
+			       STREAM_PROPS(name), \
+			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE, \
+                   NULL, NULL, NULL), \
+BT_GATT_CCC(on_cccd_changed, \
+        BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+
 /* LED Button Service Declaration and Registration */
 BT_GATT_SERVICE_DEFINE(my_service,
 BT_GATT_PRIMARY_SERVICE(BT_UUID_MY_SERVICE),
-BT_GATT_CHARACTERISTIC(BT_UUID_MY_SERVICE_TX,
-			       BT_GATT_CHRC_NOTIFY | BT_GATT_CHRC_READ,
+MY_SERVICE_STREAMS(STREAM_ATTRS)
+IF_ENABLED(CONFIG_MY_SERVICE_L2CAP, (
+BT_GATT_CHARACTERISTIC(BT_UUID_MY_SERVICE_PSM,
+			       BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ,
+                   on_psm_read, NULL, NULL),
+))
+IF_ENABLED(CONFIG_MY_SERVICE_CODEC, (
+BT_GATT_CHARACTERISTIC(BT_UUID_MY_SERVICE_CODEC,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
 			       BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-                   NULL, NULL, NULL),
-BT_GATT_CCC(on_cccd_changed,
-        BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+                   on_codec_read, on_codec_write, NULL),
+))
 );
 
-/* This function sends a notification to a Client with the provided data,
-given that the Client Characteristic Control Descripter has been set to Notify (0x1).
-It also calls the on_sent() callback if successful*/
-void my_service_send(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+BUILD_ASSERT(ARRAY_SIZE(attr_my_service) ==
+             1 + 3 * MY_SERVICE_STREAM_COUNT + (IS_ENABLED(CONFIG_MY_SERVICE_L2CAP) ? 2 : 0) +
+             (IS_ENABLED(CONFIG_MY_SERVICE_CODEC) ? 2 : 0),
+             "STREAM_ATTR() no longer matches the attribute table");
+
+/* Send the data as one SDU on the L2CAP channel the peer opened */
+static int my_service_send_l2cap(const uint8_t *data, uint16_t len)
+{
+    int err = my_service_l2cap_send(data, len);
+
+    if (err)
+    {
+        atomic_inc(err == -ENOMEM ? &stat_enomem : &stat_dropped);
+        return err;
+    }
+
+    atomic_inc(&stat_queued);
+    atomic_add(&stat_l2cap_bytes, len);
+    return 0;
+}
+
+/* Queue the data as an indication, confirmed by the Client */
+static int my_service_send_indication(struct bt_conn *conn,
+                                      const struct bt_gatt_attr *attr,
+                                      const uint8_t *data, uint16_t len)
+{
+    int err = my_service_indicate(conn, attr, data, len);
+
+    if (err)
+    {
+        atomic_inc(err == -ENOMEM ? &stat_enomem : &stat_dropped);
+        return err;
+    }
+
+    atomic_inc(&stat_queued);
+    atomic_add(&stat_gatt_bytes, len);
+    return 0;
+}
+
+uint32_t my_service_notify_in_flight(void)
+{
+    return atomic_get(&tx_pending);
+}
+
+/* Called by the stream scheduler for every queued notification */
+int my_service_stream_notify(struct bt_conn *conn, enum my_service_stream stream,
+                             const uint8_t *data, uint16_t len)
 {
-    /* 
-    The attribute for the TX characteristic is used with bt_gatt_is_subscribed 
-    to check whether notification has been enabled by the peer or not.
-    Attribute table: 0 = Service, 1 = Primary service, 2 = RX, 3 = TX, 4 = CCC.
-    */
-    const struct bt_gatt_attr *attr = &my_service.attrs[2]; 
+    int err;
 
     struct bt_gatt_notify_params params = 
     {
-        .uuid   = BT_UUID_MY_SERVICE_TX,
-        .attr   = attr,
-        .data   = data,
-        .len    = len,
-        .func   = on_sent
+        .attr      = STREAM_ATTR(stream),
+        .data      = data,
+        .len       = len,
+        .func      = on_sent,
+        .user_data = UINT_TO_POINTER(stream)
     };
 
+    // Count it as pending first, on_sent() may run before the call returns
+    atomic_inc(&tx_pending);
+
+    // Send the notification
+    err = bt_gatt_notify_cb(conn, &params);
+    if(err){
+        atomic_dec(&tx_pending);
+        atomic_inc(err == -ENOMEM ? &stat_enomem : &stat_dropped);
+        event_trace(EVENT_TRACE_SEND_ERR, err, len);
+
+        // The Client never gets the frame the next delta would refer to
+        if (IS_ENABLED(CONFIG_MY_SERVICE_CODEC) && stream == MY_SERVICE_STREAM_DATA)
+        {
+            codec_resync();
+        }
+
+        if (IS_ENABLED(CONFIG_CALLBACK_PRINTK))
+        {
+            printk("Error, unable to send notification. Error %d\n", err);
+        }
+        return err;
+    }
+
+    atomic_inc(&stat_queued);
+    atomic_add(&stat_gatt_bytes, len);
+    return 0;
+}
+
+void my_service_stream_stats_get(enum my_service_stream stream,
+                                 struct my_service_stream_stats *stats)
+{
+    my_service_streams_stats_get(stream, stats);
+}
+
+bool my_service_stream_subscribed(struct bt_conn *conn, enum my_service_stream stream)
+{
+    return stream < MY_SERVICE_STREAM_COUNT &&
+           bt_gatt_is_subscribed(conn, STREAM_ATTR(stream), BT_GATT_CCC_NOTIFY);
+}
+
+/* This function queues a notification of the given stream, given that the
+Client Characteristic Control Descripter of the stream has been set to Notify (0x1).
+The stream scheduler hands it to the stack and on_sent() is called once it is sent.
+If the Client has only enabled indications (0x2) on the DATA stream, the data is
+queued as an indication instead, and if it has opened the L2CAP channel DATA is
+sent there.
+Returns 0 if the data was queued, a negative error code otherwise. */
+static int stream_send_frame(struct bt_conn *conn, enum my_service_stream stream,
+                             const uint8_t *data, uint16_t len)
+{
+    int err;
+
+    if (conn == NULL || stream >= MY_SERVICE_STREAM_COUNT)
+    {
+        atomic_inc(&stat_dropped);
+        return conn ? -EINVAL : -ENOTCONN;
+    }
+
+    if (stream == MY_SERVICE_STREAM_DATA &&
+        IS_ENABLED(CONFIG_MY_SERVICE_L2CAP) && my_service_l2cap_ready(conn))
+    {
+        return my_service_send_l2cap(data, len);
+    }
+
+    const struct bt_gatt_attr *attr = STREAM_ATTR(stream);
+
     // Check whether notifications are enabled or not
     if(bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) 
     {
-        // Send the notification
-	    int err = bt_gatt_notify_cb(conn, &params);
+        // my_service_stream_notify() counts its own errors
+        if (my_service_streams_send_direct(conn, stream, data, len, &err))
+        {
+            return err;
+        }
+
+        err = my_service_streams_queue(conn, stream, data, len);
         if(err){
-            printk("Error, unable to send notification. Error %d\n", err);
+            atomic_inc(err == -ENOMEM ? &stat_enomem : &stat_dropped);
+            event_trace(EVENT_TRACE_SEND_ERR, err, len);
         }
-            
-        
+        return err;
+    }
+    else if(stream == MY_SERVICE_STREAM_DATA &&
+            IS_ENABLED(CONFIG_MY_SERVICE_INDICATE) &&
+            bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_INDICATE))
+    {
+        return my_service_send_indication(conn, attr, data, len);
+    }
+    else
+    {
+        atomic_inc(&stat_dropped);
+        event_trace(EVENT_TRACE_SEND_ERR, -EACCES, len);
+        if (IS_ENABLED(CONFIG_CALLBACK_PRINTK))
+        {
+            printk("Warning, notification not enabled on the selected attribute\n");
+        }
+        return -EACCES;
+    }
+}
+
+/* Code a DATA frame with the negotiated codec. The reference frame only moves
+on once the frame is queued, so a rejected frame is coded again next time. */
+static int stream_send_coded(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+    uint32_t start;
+    uint32_t cycles;
+    uint16_t coded_len;
+    int err;
+
+    if (len > CODEC_FRAME_MAX)
+    {
+        atomic_inc(&stat_dropped);
+        return -EMSGSIZE;
+    }
+
+    k_mutex_lock(&codec_lock, K_FOREVER);
+
+    if (tx_codec.mode == MY_SERVICE_CODEC_RAW)
+    {
+        k_mutex_unlock(&codec_lock);
+        return stream_send_frame(conn, MY_SERVICE_STREAM_DATA, data, len);
+    }
+
+    start = codec_clock();
+    coded_len = my_service_codec_encode(&tx_codec, data, len, codec_buf);
+    cycles = codec_clock() - start;
+
+    err = stream_send_frame(conn, MY_SERVICE_STREAM_DATA, codec_buf, coded_len);
+    if (!err)
+    {
+        codec_stats.frames++;
+        codec_stats.keyframes += my_service_codec_was_key(&tx_codec);
+        codec_stats.in_bytes += len;
+        codec_stats.out_bytes += coded_len;
+        codec_stats.cycles += cycles;
+        codec_stats.cycles_max = MAX(codec_stats.cycles_max, cycles);
+
+        my_service_codec_commit(&tx_codec, data, len);
+    }
+
+    k_mutex_unlock(&codec_lock);
+
+    return err;
+}
+
+int my_service_stream_send(struct bt_conn *conn, enum my_service_stream stream,
+                           const uint8_t *data, uint16_t len)
+{
+    int err;
+
+    if (IS_ENABLED(CONFIG_MY_SERVICE_CODEC) && stream == MY_SERVICE_STREAM_DATA)
+    {
+        err = stream_send_coded(conn, data, len);
     }
     else
     {
-        printk("Warning, notification not enabled on the selected attribute\n");
+        err = stream_send_frame(conn, stream, data, len);
+    }
+
+    if (!err)
+    {
+        conn_policy_tx_changed();
     }
-}
\ No newline at end of file
+
+    return err;
+}
+
+int my_service_send(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+    return my_service_stream_send(conn, MY_SERVICE_STREAM_DATA, data, len);
+}
@@ -1,3 +1,6 @@
+#ifndef MY_SERVICE_H_
+#define MY_SERVICE_H_
+
 #include <zephyr/types.h>
 #include <stddef.h>
 #include <string.h>
@@ -20,6 +23,41 @@
 #define TX_CHARACTERISTIC_UUID  0xED, 0xAA, 0x20, 0x11, 0x92, 0xE7, 0x43, 0x5A, \
 			                    0xAA, 0xE9, 0x94, 0x43, 0x35, 0x6A, 0xD4, 0xD3
 
+#define L2CAP_PSM_CHARACTERISTIC_UUID  0x5C, 0x0F, 0x7B, 0x31, 0x8E, 0x16, 0x4D, 0x02, \
+			                           0xB1, 0x6A, 0x2F, 0x93, 0xE4, 0x58, 0x0D, 0xC7
+
+#define STATUS_CHARACTERISTIC_UUID  0x2B, 0x90, 0x61, 0xE4, 0x3C, 0x5D, 0x4A, 0x87, \
+			                        0x9E, 0x14, 0xD6, 0x0A, 0x71, 0xC3, 0x58, 0xB2
+
+#define LOG_CHARACTERISTIC_UUID  0x2B, 0x90, 0x61, 0xE4, 0x3C, 0x5D, 0x4A, 0x87, \
+			                     0x9E, 0x14, 0xD6, 0x0A, 0x72, 0xC3, 0x58, 0xB2
+
+#define CODEC_CHARACTERISTIC_UUID  0x2B, 0x90, 0x61, 0xE4, 0x3C, 0x5D, 0x4A, 0x87, \
+			                       0x9E, 0x14, 0xD6, 0x0A, 0x73, 0xC3, 0x58, 0xB2
+
+/*
+	Notification streams, one characteristic with its own CCC each, in
+	attribute table order: X(name, uuid, priority, weight).
+
+	Queued notifications are handed to the stack by priority (0 first),
+	and streams of the same priority share the TX budget by weight. DATA
+	is the original TX Characteristic and also carries indications and
+	the L2CAP channel. STATUS is small and latency sensitive, LOG is bulk.
+*/
+#define MY_SERVICE_STREAMS(X) \
+	X(DATA,   TX_CHARACTERISTIC_UUID,     1, 3) \
+	X(STATUS, STATUS_CHARACTERISTIC_UUID, 0, 1) \
+	X(LOG,    LOG_CHARACTERISTIC_UUID,    1, 1)
+
+#define MY_SERVICE_STREAM_ENUM(name, uuid, priority, weight) MY_SERVICE_STREAM_##name,
+
+/** @brief Stream ids, generated from MY_SERVICE_STREAMS. */
+enum my_service_stream
+{
+	MY_SERVICE_STREAMS(MY_SERVICE_STREAM_ENUM)
+	MY_SERVICE_STREAM_COUNT
+};
+
 /** @brief Callback type for when new data is received. */
 typedef void (*data_rx_cb_t)(uint8_t *data, uint8_t length);
 
@@ -30,6 +68,103 @@ struct my_service_cb
 	data_rx_cb_t    data_rx_cb;
 };
 
+/** @brief TX counters kept by the my_service Service. */
+struct my_service_stats
+{
+	/** Notifications, indications and SDUs handed to the stack. */
+	uint32_t queued;
+	/** Notifications and SDUs reported sent, indications confirmed. */
+	uint32_t sent;
+	/** Sends rejected for any reason other than -ENOMEM. */
+	uint32_t dropped;
+	/** Sends rejected because the stack was out of buffers. */
+	uint32_t enomem;
+	/** Payload bytes queued as notifications. */
+	uint32_t gatt_bytes;
+	/** Payload bytes queued on the L2CAP channel. */
+	uint32_t l2cap_bytes;
+	/** Indication submissions repeated because the stack was out of buffers. */
+	uint32_t ind_retries;
+	/** Indications that timed out or were confirmed late. */
+	uint32_t ind_timeouts;
+	/** Indications the stack refused. */
+	uint32_t ind_failed;
+};
+
+/** @brief Per stream counters. */
+struct my_service_stream_stats
+{
+	/** Notifications queued for the scheduler or sent directly. */
+	uint32_t queued;
+	/** Notifications reported sent by the stack. */
+	uint32_t sent;
+	/** Notifications rejected, because the stream queue was full or the
+	 *  stack refused them.
+	 */
+	uint32_t dropped;
+};
+
+/** @brief DATA stream codec counters, see my_service_codec.h. */
+struct my_service_codec_stats
+{
+	/** enum my_service_codec_mode negotiated by the Client. */
+	uint32_t mode;
+	/** Frames coded and accepted for sending. */
+	uint32_t frames;
+	/** Of which keyframes. */
+	uint32_t keyframes;
+	/** Bytes before and after coding, header included. */
+	uint32_t in_bytes;
+	uint32_t out_bytes;
+	/** Time spent coding, in cycles of cycles_per_sec. */
+	uint32_t cycles;
+	uint32_t cycles_max;
+	uint32_t cycles_per_sec;
+};
+
 int my_service_init(void);
 
-void my_service_send(struct bt_conn *conn, const uint8_t *data, uint16_t len);
\ No newline at end of file
+/** @brief Send data to the Client.
+ *
+ *  Uses the L2CAP channel if the Client has opened it, notifications on the
+ *  TX Characteristic otherwise. Same as my_service_stream_send() on
+ *  MY_SERVICE_STREAM_DATA, which is coded first if the Client enabled a
+ *  codec through the codec Characteristic.
+ */
+int my_service_send(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+/** @brief Queue data as a notification of stream @p stream.
+ *
+ *  When no stream has anything queued the data goes straight to the
+ *  stack, otherwise it is copied and handed to the stack by the stream
+ *  scheduler.
+ *
+ *  @return 0 if queued, -ENOMEM if the stream queue or the stack is full,
+ *          -EACCES if the Client has not subscribed to the stream.
+ */
+int my_service_stream_send(struct bt_conn *conn, enum my_service_stream stream,
+                           const uint8_t *data, uint16_t len);
+
+void my_service_stream_stats_get(enum my_service_stream stream,
+                                 struct my_service_stream_stats *stats);
+
+/** @brief Whether the Client enabled notifications of stream @p stream. */
+bool my_service_stream_subscribed(struct bt_conn *conn, enum my_service_stream stream);
+
+/** @brief Largest payload a single my_service_send() can carry on @p conn,
+ *  leaving room for the codec header when the Client enabled a codec.
+ */
+uint16_t my_service_max_payload(struct bt_conn *conn);
+
+/** @brief Number of notifications (queued in the streams or in the stack),
+ *  SDUs and indications not yet sent or confirmed.
+ */
+uint32_t my_service_tx_pending(void);
+
+void my_service_stats_get(struct my_service_stats *stats);
+
+void my_service_stats_reset(void);
+
+void my_service_codec_stats_get(struct my_service_codec_stats *stats);
+
+#endif /* MY_SERVICE_H_ */
@@ -0,0 +1,288 @@
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/util.h>
+
+#include "my_service_codec.h"
+
+/* Shorter runs cost as much as literals */
+#define RLE_RUN_MIN     3
+#define RLE_RUN_MAX     (255 - 125)
+#define RLE_LITERAL_MAX 128
+
+void my_service_codec_init(struct my_service_codec *codec, uint8_t mode,
+			   uint8_t keyframe_interval)
+{
+	memset(codec, 0, sizeof(*codec));
+	codec->mode = mode;
+	codec->keyframe_interval = MAX(keyframe_interval, 1);
+	codec->force_key = true;
+}
+
+/* Returns 0 instead of exceeding max, the frame then goes out without RLE */
+static uint16_t rle_flush(const uint8_t *in, uint16_t from, uint16_t to,
+			  uint8_t *out, uint16_t o, uint16_t max)
+{
+	while (from < to)
+	{
+		uint16_t n = MIN(to - from, RLE_LITERAL_MAX);
+
+		if (o + 1 + n > max)
+		{
+			return 0;
+		}
+
+		out[o++] = n - 1;
+		memcpy(&out[o], &in[from], n);
+		o += n;
+		from += n;
+	}
+
+	return o;
+}
+
+static uint16_t rle_encode(const uint8_t *in, uint16_t len, uint8_t *out, uint16_t max)
+{
+	uint16_t literal = 0;
+	uint16_t o = 0;
+	uint16_t i = 0;
+
+	while (i < len)
+	{
+		uint16_t run = 1;
+
+		while (i + run < len && run < RLE_RUN_MAX && in[i + run] == in[i])
+		{
+			run++;
+		}
+
+		if (run < RLE_RUN_MIN)
+		{
+			i += run;
+			continue;
+		}
+
+		o = rle_flush(in, literal, i, out, o, max);
+		if ((literal < i && !o) || o + 2 > max)
+		{
+			return 0;
+		}
+
+		out[o++] = run + 125;
+		out[o++] = in[i];
+		i += run;
+		literal = i;
+	}
+
+	if (literal < len)
+	{
+		o = rle_flush(in, literal, len, out, o, max);
+	}
+
+	return o;
+}
+
+static int rle_decode(const uint8_t *in, uint16_t len, uint8_t *out, uint16_t max)
+{
+	uint16_t o = 0;
+	uint16_t i = 0;
+
+	while (i < len)
+	{
+		uint8_t c = in[i++];
+
+		if (c < RLE_LITERAL_MAX)
+		{
+			uint16_t n = c + 1;
+
+			if (i + n > len)
+			{
+				return -EBADMSG;
+			}
+			if (o + n > max)
+			{
+				return -ENOMEM;
+			}
+
+			memcpy(&out[o], &in[i], n);
+			i += n;
+			o += n;
+		}
+		else
+		{
+			uint16_t n = c - 125;
+
+			if (i >= len)
+			{
+				return -EBADMSG;
+			}
+			if (o + n > max)
+			{
+				return -ENOMEM;
+			}
+
+			memset(&out[o], in[i++], n);
+			o += n;
+		}
+	}
+
+	return o;
+}
+
+uint16_t my_service_codec_encode(struct my_service_codec *codec,
+				 const uint8_t *in, uint16_t len, uint8_t *out)
+{
+	struct my_service_codec_hdr *hdr = (struct my_service_codec_hdr *)out;
+	uint8_t *payload = out + sizeof(*hdr);
+	uint8_t delta[MY_SERVICE_CODEC_FRAME_MAX];
+	const uint8_t *src = in;
+	uint16_t coded = 0;
+	bool key;
+
+	key = codec->force_key || len != codec->ref_len ||
+	      codec->since_key >= codec->keyframe_interval;
+
+	if (!key)
+	{
+		/* Unchanged bytes become 0, slowly varying ones small values */
+		for (uint16_t i = 0; i < len; i++)
+		{
+			delta[i] = in[i] - codec->ref[i];
+		}
+		src = delta;
+	}
+
+	codec->flags = key ? MY_SERVICE_CODEC_FLAG_KEY : 0;
+
+	/* Only worth it if it saves at least one byte */
+	if (codec->mode == MY_SERVICE_CODEC_DELTA_RLE)
+	{
+		coded = rle_encode(src, len, payload, len - 1);
+	}
+
+	if (coded)
+	{
+		codec->flags |= MY_SERVICE_CODEC_FLAG_RLE;
+	}
+	else
+	{
+		memcpy(payload, src, len);
+		coded = len;
+	}
+
+	hdr->flags = codec->flags;
+	hdr->seq = codec->seq;
+
+	return sizeof(*hdr) + coded;
+}
+
+void my_service_codec_commit(struct my_service_codec *codec,
+			     const uint8_t *in, uint16_t len)
+{
+	if (len <= sizeof(codec->ref))
+	{
+		memcpy(codec->ref, in, len);
+		codec->ref_len = len;
+		codec->force_key = false;
+	}
+	else
+	{
+		codec->force_key = true;
+	}
+
+	codec->since_key = (codec->flags & MY_SERVICE_CODEC_FLAG_KEY) ? 0 : codec->since_key + 1;
+	codec->seq++;
+}
+
+void my_service_codec_resync(struct my_service_codec *codec)
+{
+	codec->force_key = true;
+}
+
+bool my_service_codec_was_key(const struct my_service_codec *codec)
+{
+	return codec->flags & MY_SERVICE_CODEC_FLAG_KEY;
+}
+
+int my_service_codec_decode(struct my_service_codec *codec,
+			    const uint8_t *in, uint16_t len,
+			    uint8_t *out, uint16_t out_max)
+{
+	const struct my_service_codec_hdr *hdr = (const struct my_service_codec_hdr *)in;
+	const uint8_t *payload = in + sizeof(*hdr);
+	uint16_t payload_len;
+	bool key;
+	int n;
+
+	if (codec->mode == MY_SERVICE_CODEC_RAW)
+	{
+		if (len > out_max)
+		{
+			return -ENOMEM;
+		}
+
+		memcpy(out, in, len);
+		return len;
+	}
+
+	if (len < sizeof(*hdr))
+	{
+		return -EBADMSG;
+	}
+
+	payload_len = len - sizeof(*hdr);
+	key = hdr->flags & MY_SERVICE_CODEC_FLAG_KEY;
+
+	/* A delta is only valid against the frame right before it */
+	if (!key && (!codec->synced || hdr->seq != codec->seq))
+	{
+		codec->synced = false;
+		return -EAGAIN;
+	}
+
+	if (hdr->flags & MY_SERVICE_CODEC_FLAG_RLE)
+	{
+		n = rle_decode(payload, payload_len, out, out_max);
+		if (n < 0)
+		{
+			codec->synced = false;
+			return n;
+		}
+	}
+	else
+	{
+		if (payload_len > out_max)
+		{
+			codec->synced = false;
+			return -ENOMEM;
+		}
+
+		memcpy(out, payload, payload_len);
+		n = payload_len;
+	}
+
+	if (!key)
+	{
+		if (n != codec->ref_len)
+		{
+			codec->synced = false;
+			return -EBADMSG;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			out[i] += codec->ref[i];
+		}
+	}
+
+	codec->synced = (uint16_t)n <= sizeof(codec->ref);
+	if (codec->synced)
+	{
+		memcpy(codec->ref, out, n);
+		codec->ref_len = n;
+	}
+	codec->seq = hdr->seq + 1;
+
+	return n;
+}
@@ -0,0 +1,124 @@
+#ifndef MY_SERVICE_CODEC_H_
+#define MY_SERVICE_CODEC_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <sys/util.h>
+
+/*
+	Payload codec of the DATA stream, negotiated through the codec
+	Characteristic. Plain C without kernel calls, so the central links the
+	same file to decode.
+
+	Every coded frame starts with struct my_service_codec_hdr. A delta
+	frame holds the byte-wise difference (mod 256) to the previous frame,
+	so the slowly varying bytes of a sensor vector turn into runs of zeros
+	and small values. The RLE step then packs runs of equal bytes:
+
+	  control c < 128:  c + 1 literal bytes follow
+	  control c >= 128: the next byte repeats c - 125 times (3..130)
+
+	A keyframe is coded against nothing, and is sent every keyframe
+	interval, whenever the frame length changes and after a frame the
+	Client may have missed. A receiver that sees a gap in the sequence
+	numbers drops delta frames until the next keyframe.
+*/
+
+/** @brief Largest frame kept as the delta reference, the notification
+ *  payload at an ATT MTU of 247. Longer frames are always keyframes.
+ */
+#define MY_SERVICE_CODEC_FRAME_MAX 244
+
+/** @brief Worst case coded size of a @p len byte frame. */
+#define MY_SERVICE_CODEC_MAX_LEN(len) \
+	(sizeof(struct my_service_codec_hdr) + (len) + ((len) + 127) / 128)
+
+/** @brief Values of the codec Characteristic mode byte. */
+enum my_service_codec_mode
+{
+	/** Frames are sent as they are, without a header. */
+	MY_SERVICE_CODEC_RAW       = 0x00,
+	/** Delta to the previous frame. */
+	MY_SERVICE_CODEC_DELTA     = 0x01,
+	/** Delta to the previous frame, then RLE. */
+	MY_SERVICE_CODEC_DELTA_RLE = 0x02,
+};
+
+#define MY_SERVICE_CODEC_FLAG_KEY BIT(0)
+#define MY_SERVICE_CODEC_FLAG_RLE BIT(1)
+
+/** @brief Header of every coded frame. */
+struct my_service_codec_hdr
+{
+	/** MY_SERVICE_CODEC_FLAG_* */
+	uint8_t flags;
+	/** Frame sequence number, wraps at 256. */
+	uint8_t seq;
+} __packed;
+
+/** @brief Codec Characteristic read and write format. */
+struct my_service_codec_ctrl
+{
+	/** enum my_service_codec_mode */
+	uint8_t mode;
+	/** Delta frames between keyframes, 0 for the default interval. */
+	uint8_t keyframe_interval;
+} __packed;
+
+/** @brief Encoder or decoder state, one per direction and connection. */
+struct my_service_codec
+{
+	uint8_t ref[MY_SERVICE_CODEC_FRAME_MAX];
+	uint16_t ref_len;
+	uint8_t mode;
+	uint8_t keyframe_interval;
+	uint8_t seq;
+	uint8_t since_key;
+	/** Encoder: flags of the last encoded frame. */
+	uint8_t flags;
+	/** Encoder: the next frame has to be a keyframe. */
+	bool force_key;
+	/** Decoder: the reference matches the sender's. */
+	bool synced;
+};
+
+/** @brief Reset @p codec, the next frame is a keyframe.
+ *
+ *  @p keyframe_interval is the number of delta frames after each keyframe,
+ *  and has to be at least 1.
+ */
+void my_service_codec_init(struct my_service_codec *codec, uint8_t mode,
+			   uint8_t keyframe_interval);
+
+/** @brief Code @p len bytes into @p out, which holds
+ *  MY_SERVICE_CODEC_MAX_LEN(len) bytes. Not used in MY_SERVICE_CODEC_RAW.
+ *
+ *  The reference frame is left alone until my_service_codec_commit(), so a
+ *  frame that could not be sent is simply encoded again.
+ *
+ *  @return Coded length, header included.
+ */
+uint16_t my_service_codec_encode(struct my_service_codec *codec,
+				 const uint8_t *in, uint16_t len, uint8_t *out);
+
+/** @brief Make the last encoded frame the reference, once it is sent. */
+void my_service_codec_commit(struct my_service_codec *codec,
+			     const uint8_t *in, uint16_t len);
+
+/** @brief Force a keyframe, after a committed frame was lost. */
+void my_service_codec_resync(struct my_service_codec *codec);
+
+/** @brief Whether the last encoded frame was a keyframe. */
+bool my_service_codec_was_key(const struct my_service_codec *codec);
+
+/** @brief Decode one coded frame into @p out.
+ *
+ *  @return Decoded length, -EAGAIN for a delta frame received while out of
+ *          sync (wait for the next keyframe), -EBADMSG for a malformed
+ *          frame, -ENOMEM if @p out_max is too small.
+ */
+int my_service_codec_decode(struct my_service_codec *codec,
+			    const uint8_t *in, uint16_t len,
+			    uint8_t *out, uint16_t out_max);
+
+#endif /* MY_SERVICE_CODEC_H_ */
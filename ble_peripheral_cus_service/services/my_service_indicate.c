@@ -0,0 +1,194 @@
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <sys/slist.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+#include "my_service_indicate.h"
+
+/* Largest indication payload the ATT MTU allows */
+#define INDICATE_MAX_LEN (CONFIG_BT_L2CAP_TX_MTU - 3)
+
+/*
+	ATT allows a single outstanding indication per bearer, but the stack
+	keeps further requests queued and sends the next one from the RX
+	thread as soon as the confirmation arrives. Keeping a few indications
+	encoded and submitted ahead therefore lets reliable mode run at close
+	to one indication per connection event, instead of waiting for the
+	application to react to every confirmation.
+*/
+struct indicate_slot
+{
+	sys_snode_t node;
+	struct bt_gatt_indicate_params params;
+	struct bt_conn *conn;
+	/* When bt_gatt_indicate() accepted the slot */
+	int64_t accept_ms;
+	uint8_t retries;
+	uint8_t data[INDICATE_MAX_LEN];
+};
+
+K_MEM_SLAB_DEFINE(indicate_slab, sizeof(struct indicate_slot),
+		  CONFIG_MY_SERVICE_INDICATE_QUEUE_LEN, 4);
+
+/* Slots waiting to be handed to the stack, in order */
+static sys_slist_t submit_list = SYS_SLIST_STATIC_INIT(&submit_list);
+static K_MUTEX_DEFINE(submit_lock);
+
+static atomic_t stat_confirmed;
+static atomic_t stat_retries;
+static atomic_t stat_timeouts;
+static atomic_t stat_failed;
+static atomic_t stat_max_rtt_ms;
+
+/* Last confirmation, only touched from the BT RX thread */
+static int64_t last_rsp_ms;
+
+static void indicate_retry(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(retry_work, indicate_retry);
+
+static void indicate_slot_free(struct indicate_slot *slot)
+{
+	bt_conn_unref(slot->conn);
+	k_mem_slab_free(&indicate_slab, (void **)&slot);
+}
+
+static void on_indicate_rsp(struct bt_conn *conn,
+			    struct bt_gatt_indicate_params *params,
+			    uint8_t err)
+{
+	struct indicate_slot *slot = CONTAINER_OF(params, struct indicate_slot, params);
+	int64_t now = k_uptime_get();
+	/* The stack holds an accepted indication back until the previous one
+	 * is confirmed, so its round trip only starts then.
+	 */
+	uint32_t rtt_ms = (uint32_t)(now - MAX(slot->accept_ms, last_rsp_ms));
+
+	last_rsp_ms = now;
+
+	if (err) {
+		/* Only raised on ATT timeout or disconnect, the bearer is gone */
+		atomic_inc(&stat_timeouts);
+		return;
+	}
+
+	if (rtt_ms > CONFIG_MY_SERVICE_INDICATE_TIMEOUT_MS) {
+		atomic_inc(&stat_timeouts);
+	}
+
+	if (rtt_ms > (uint32_t)atomic_get(&stat_max_rtt_ms)) {
+		atomic_set(&stat_max_rtt_ms, rtt_ms);
+	}
+
+	atomic_inc(&stat_confirmed);
+	my_service_on_indicate_confirmed();
+}
+
+static void on_indicate_destroy(struct bt_gatt_indicate_params *params)
+{
+	indicate_slot_free(CONTAINER_OF(params, struct indicate_slot, params));
+}
+
+/* Hand queued slots to the stack until the list is empty or the stack runs
+ * out of buffers, in which case the head is retried later so the order of
+ * indications is kept.
+ */
+static void indicate_submit_pending(void)
+{
+	struct indicate_slot *slot;
+	sys_snode_t *node;
+	int err;
+
+	k_mutex_lock(&submit_lock, K_FOREVER);
+
+	while ((node = sys_slist_peek_head(&submit_list)) != NULL) {
+		slot = CONTAINER_OF(node, struct indicate_slot, node);
+		/* Set ahead, the response may arrive before the call returns */
+		slot->accept_ms = k_uptime_get();
+
+		err = bt_gatt_indicate(slot->conn, &slot->params);
+		if (err == -ENOMEM && slot->retries < CONFIG_MY_SERVICE_INDICATE_RETRIES) {
+			slot->retries++;
+			atomic_inc(&stat_retries);
+			k_work_reschedule(&retry_work, K_MSEC(CONFIG_MY_SERVICE_INDICATE_RETRY_MS));
+			break;
+		}
+
+		sys_slist_get_not_empty(&submit_list);
+
+		if (err) {
+			printk("Error, unable to send indication. Error %d\n", err);
+			atomic_inc(&stat_failed);
+			indicate_slot_free(slot);
+		}
+	}
+
+	k_mutex_unlock(&submit_lock);
+}
+
+static void indicate_retry(struct k_work *work)
+{
+	indicate_submit_pending();
+}
+
+int my_service_indicate(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			const uint8_t *data, uint16_t len)
+{
+	struct indicate_slot *slot;
+
+	if (len > INDICATE_MAX_LEN) {
+		return -EMSGSIZE;
+	}
+
+	if (k_mem_slab_alloc(&indicate_slab, (void **)&slot, K_NO_WAIT)) {
+		return -ENOMEM;
+	}
+
+	memcpy(slot->data, data, len);
+	memset(&slot->params, 0, sizeof(slot->params));
+	slot->params.attr    = attr;
+	slot->params.data    = slot->data;
+	slot->params.len     = len;
+	slot->params.func    = on_indicate_rsp;
+	slot->params.destroy = on_indicate_destroy;
+	slot->conn    = bt_conn_ref(conn);
+	slot->retries = 0;
+
+	k_mutex_lock(&submit_lock, K_FOREVER);
+	sys_slist_append(&submit_list, &slot->node);
+	k_mutex_unlock(&submit_lock);
+
+	indicate_submit_pending();
+
+	return 0;
+}
+
+uint32_t my_service_indicate_pending(void)
+{
+	return k_mem_slab_num_used_get(&indicate_slab);
+}
+
+void my_service_indicate_stats_get(struct my_service_indicate_stats *stats)
+{
+	stats->confirmed  = atomic_get(&stat_confirmed);
+	stats->retries    = atomic_get(&stat_retries);
+	stats->timeouts   = atomic_get(&stat_timeouts);
+	stats->failed     = atomic_get(&stat_failed);
+	stats->max_rtt_ms = atomic_get(&stat_max_rtt_ms);
+}
+
+void my_service_indicate_stats_reset(void)
+{
+	atomic_clear(&stat_confirmed);
+	atomic_clear(&stat_retries);
+	atomic_clear(&stat_timeouts);
+	atomic_clear(&stat_failed);
+	atomic_clear(&stat_max_rtt_ms);
+}
@@ -0,0 +1,53 @@
+#ifndef MY_SERVICE_INDICATE_H_
+#define MY_SERVICE_INDICATE_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+/*
+	Pipelined indications on the TX Characteristic. Internal to the
+	my_service Service.
+*/
+
+/** @brief Acknowledged delivery counters. */
+struct my_service_indicate_stats
+{
+	/** Indications confirmed by the Client. */
+	uint32_t confirmed;
+	/** Submissions repeated because the stack was out of buffers. */
+	uint32_t retries;
+	/** Indications that timed out at the ATT layer, or were confirmed
+	 *  later than CONFIG_MY_SERVICE_INDICATE_TIMEOUT_MS after the stack
+	 *  could send them.
+	 */
+	uint32_t timeouts;
+	/** Indications the stack refused, after any retries. */
+	uint32_t failed;
+	/** Slowest confirmation seen, in milliseconds. */
+	uint32_t max_rtt_ms;
+};
+
+/** @brief Queue an indication of @p attr.
+ *
+ *  The data is copied into a free queue slot and submitted behind the
+ *  indications still waiting for confirmation, so the stack can send it as
+ *  soon as the previous confirmation arrives.
+ *
+ *  @return 0 if queued, -ENOMEM if all CONFIG_MY_SERVICE_INDICATE_QUEUE_LEN
+ *          slots are in use, another negative error code otherwise.
+ */
+int my_service_indicate(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			const uint8_t *data, uint16_t len);
+
+/** @brief Indications queued and not yet confirmed. */
+uint32_t my_service_indicate_pending(void);
+
+void my_service_indicate_stats_get(struct my_service_indicate_stats *stats);
+
+void my_service_indicate_stats_reset(void);
+
+/** @brief Called for every confirmed indication. */
+void my_service_on_indicate_confirmed(void);
+
+#endif /* MY_SERVICE_INDICATE_H_ */
@@ -0,0 +1,148 @@
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/l2cap.h>
+
+#include "my_service_l2cap.h"
+
+/* Whole SDUs are handed to the stack, which segments them into PDUs of the
+ * peer's MPS and sends them as the peer hands out credits. Once the credits
+ * and the SDU pool are used up, my_service_l2cap_send() returns -ENOMEM just
+ * like a notification that can't get an ATT buffer.
+ */
+NET_BUF_POOL_FIXED_DEFINE(l2cap_tx_pool, CONFIG_MY_SERVICE_L2CAP_TX_BUF_COUNT,
+			  BT_L2CAP_SDU_BUF_SIZE(CONFIG_MY_SERVICE_L2CAP_MTU),
+			  CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+static struct bt_l2cap_le_chan l2cap_chan;
+static atomic_t l2cap_connected;
+static atomic_t l2cap_pending;
+static bool l2cap_registered;
+
+static void l2cap_chan_connected(struct bt_l2cap_chan *chan)
+{
+	printk("L2CAP channel connected, TX MTU %u MPS %u\n",
+	       l2cap_chan.tx.mtu, l2cap_chan.tx.mps);
+
+	atomic_clear(&l2cap_pending);
+	atomic_set(&l2cap_connected, true);
+}
+
+static void l2cap_chan_disconnected(struct bt_l2cap_chan *chan)
+{
+	printk("L2CAP channel disconnected\n");
+
+	/* SDUs still queued are freed by the stack without a sent callback */
+	atomic_set(&l2cap_connected, false);
+	atomic_clear(&l2cap_pending);
+}
+
+static void l2cap_chan_sent(struct bt_l2cap_chan *chan)
+{
+	atomic_dec(&l2cap_pending);
+	my_service_on_l2cap_sent();
+}
+
+static int l2cap_chan_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	/* The channel is TX only, anything from the peer is discarded */
+	return 0;
+}
+
+static const struct bt_l2cap_chan_ops l2cap_chan_ops =
+{
+	.connected = l2cap_chan_connected,
+	.disconnected = l2cap_chan_disconnected,
+	.sent = l2cap_chan_sent,
+	.recv = l2cap_chan_recv,
+};
+
+static int l2cap_accept(struct bt_conn *conn, struct bt_l2cap_chan **chan)
+{
+	if (atomic_get(&l2cap_connected)) {
+		return -ENOMEM;
+	}
+
+	memset(&l2cap_chan, 0, sizeof(l2cap_chan));
+	l2cap_chan.chan.ops = &l2cap_chan_ops;
+
+	*chan = &l2cap_chan.chan;
+
+	return 0;
+}
+
+static struct bt_l2cap_server l2cap_server =
+{
+	.psm = CONFIG_MY_SERVICE_L2CAP_PSM,
+	.sec_level = BT_SECURITY_L1,
+	.accept = l2cap_accept,
+};
+
+int my_service_l2cap_init(void)
+{
+	int err;
+
+	if (l2cap_registered) {
+		return 0;
+	}
+
+	err = bt_l2cap_server_register(&l2cap_server);
+	if (err) {
+		printk("L2CAP server registration failed (err %d)\n", err);
+		return err;
+	}
+
+	l2cap_registered = true;
+
+	return 0;
+}
+
+bool my_service_l2cap_ready(struct bt_conn *conn)
+{
+	return atomic_get(&l2cap_connected) && l2cap_chan.chan.conn == conn;
+}
+
+uint16_t my_service_l2cap_mtu(void)
+{
+	return MIN(l2cap_chan.tx.mtu, CONFIG_MY_SERVICE_L2CAP_MTU);
+}
+
+uint32_t my_service_l2cap_pending(void)
+{
+	return atomic_get(&l2cap_pending);
+}
+
+int my_service_l2cap_send(const uint8_t *data, uint16_t len)
+{
+	struct net_buf *buf;
+	int err;
+
+	if (len > my_service_l2cap_mtu()) {
+		return -EMSGSIZE;
+	}
+
+	buf = net_buf_alloc(&l2cap_tx_pool, K_NO_WAIT);
+	if (!buf) {
+		return -ENOMEM;
+	}
+
+	net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+	net_buf_add_mem(buf, data, len);
+
+	atomic_inc(&l2cap_pending);
+
+	err = bt_l2cap_chan_send(&l2cap_chan.chan, buf);
+	if (err < 0) {
+		atomic_dec(&l2cap_pending);
+		net_buf_unref(buf);
+		return err;
+	}
+
+	return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MY_SERVICE_L2CAP_H_
+#define MY_SERVICE_L2CAP_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <bluetooth/conn.h>
+
+/*
+	L2CAP connection-oriented channel used by my_service_send() as an
+	alternative to the TX characteristic. Internal to the my_service Service.
+*/
+
+/** @brief Register the L2CAP server on CONFIG_MY_SERVICE_L2CAP_PSM. */
+int my_service_l2cap_init(void);
+
+/** @brief Returns true if the peer on @p conn has the channel open. */
+bool my_service_l2cap_ready(struct bt_conn *conn);
+
+/** @brief Send one SDU of up to my_service_l2cap_mtu() bytes. */
+int my_service_l2cap_send(const uint8_t *data, uint16_t len);
+
+/** @brief SDU size accepted by the peer. */
+uint16_t my_service_l2cap_mtu(void);
+
+/** @brief SDUs queued on the channel and not yet sent. */
+uint32_t my_service_l2cap_pending(void);
+
+/** @brief Called by the channel for every SDU that has been sent. */
+void my_service_on_l2cap_sent(void);
+
+#endif /* MY_SERVICE_L2CAP_H_ */
@@ -0,0 +1,310 @@
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <sys/slist.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include "my_service_streams.h"
+
+#define BUDGET  CONFIG_MY_SERVICE_TX_BUDGET
+#define RESERVE CONFIG_MY_SERVICE_STREAM_RESERVE
+
+BUILD_ASSERT(RESERVE < BUDGET, "The reserve must leave budget for the other streams");
+
+/*
+	Scheduling, each time the stack has room for another notification:
+
+	- the lowest priority number with something queued goes first,
+	- streams of the same priority take turns in proportion to their
+	  weight (each gets weight credits per round, one credit per
+	  notification),
+	- the last CONFIG_MY_SERVICE_STREAM_RESERVE notifications of the
+	  budget are only used by the highest priority streams, so a bulk
+	  stream that keeps the stack full still leaves room for them.
+
+	Each stream also has its own queue limit, so one stream can't use up
+	the buffers of the others either.
+*/
+struct stream_buf
+{
+	sys_snode_t node;
+	struct bt_conn *conn;
+	uint16_t len;
+	uint8_t data[MAX_TRANSMIT_SIZE];
+};
+
+struct stream_cfg
+{
+	uint8_t priority;
+	uint8_t weight;
+};
+
+struct stream_state
+{
+	sys_slist_t queue;
+	uint32_t count;
+	int32_t credit;
+	atomic_t stat_queued;
+	atomic_t stat_sent;
+	atomic_t stat_dropped;
+};
+
+#define STREAM_CFG(name, uuid, prio, wght) { .priority = (prio), .weight = (wght) },
+
+static const struct stream_cfg stream_cfg[MY_SERVICE_STREAM_COUNT] =
+{
+	MY_SERVICE_STREAMS(STREAM_CFG)
+};
+
+K_MEM_SLAB_DEFINE(stream_slab, sizeof(struct stream_buf),
+		  MY_SERVICE_STREAM_COUNT * CONFIG_MY_SERVICE_STREAM_QUEUE_LEN, 4);
+
+/* A zeroed sys_slist_t is an empty list */
+static struct stream_state streams[MY_SERVICE_STREAM_COUNT];
+static struct k_spinlock streams_lock;
+
+static K_SEM_DEFINE(sched_sem, 0, 1);
+
+static void stream_buf_free(struct stream_buf *buf)
+{
+	bt_conn_unref(buf->conn);
+	k_mem_slab_free(&stream_slab, (void **)&buf);
+}
+
+int my_service_streams_queue(struct bt_conn *conn, enum my_service_stream stream,
+			     const uint8_t *data, uint16_t len)
+{
+	struct stream_state *state = &streams[stream];
+	struct stream_buf *buf;
+	k_spinlock_key_t key;
+
+	if (len > MAX_TRANSMIT_SIZE)
+	{
+		atomic_inc(&state->stat_dropped);
+		return -EMSGSIZE;
+	}
+
+	key = k_spin_lock(&streams_lock);
+	if (state->count >= CONFIG_MY_SERVICE_STREAM_QUEUE_LEN ||
+	    k_mem_slab_alloc(&stream_slab, (void **)&buf, K_NO_WAIT))
+	{
+		k_spin_unlock(&streams_lock, key);
+		atomic_inc(&state->stat_dropped);
+		return -ENOMEM;
+	}
+	/* Reserve the slot now, the buffer is filled outside of the lock */
+	state->count++;
+	k_spin_unlock(&streams_lock, key);
+
+	buf->conn = bt_conn_ref(conn);
+	buf->len = len;
+	memcpy(buf->data, data, len);
+
+	key = k_spin_lock(&streams_lock);
+	sys_slist_append(&state->queue, &buf->node);
+	k_spin_unlock(&streams_lock, key);
+
+	atomic_inc(&state->stat_queued);
+	k_sem_give(&sched_sem);
+
+	return 0;
+}
+
+/* Whether @p stream may have another notification in the stack */
+static bool stream_in_budget(int stream, uint32_t in_flight)
+{
+	uint8_t top_priority = UINT8_MAX;
+
+	for (int i = 0; i < MY_SERVICE_STREAM_COUNT; i++)
+	{
+		top_priority = MIN(top_priority, stream_cfg[i].priority);
+	}
+
+	if (in_flight >= BUDGET)
+	{
+		return false;
+	}
+
+	return stream_cfg[stream].priority == top_priority || in_flight < BUDGET - RESERVE;
+}
+
+bool my_service_streams_send_direct(struct bt_conn *conn, enum my_service_stream stream,
+				    const uint8_t *data, uint16_t len, int *err)
+{
+	struct stream_state *state = &streams[stream];
+
+	/* Anything queued, even a buffer still being filled, goes first. A
+	 * concurrent sender may still take the last budget slot, which only
+	 * lets the stack hold one notification more than the budget.
+	 */
+	if (k_mem_slab_num_used_get(&stream_slab) != 0 ||
+	    !stream_in_budget(stream, my_service_notify_in_flight()))
+	{
+		return false;
+	}
+
+	*err = my_service_stream_notify(conn, stream, data, len);
+	atomic_inc(*err ? &state->stat_dropped : &state->stat_queued);
+
+	return true;
+}
+
+static int stream_pick(uint32_t in_flight)
+{
+	int best = -1;
+
+	for (int i = 0; i < MY_SERVICE_STREAM_COUNT; i++)
+	{
+		/* count also includes buffers still being filled */
+		if (sys_slist_is_empty(&streams[i].queue))
+		{
+			continue;
+		}
+
+		if (!stream_in_budget(i, in_flight))
+		{
+			continue;
+		}
+
+		if (best < 0 || stream_cfg[i].priority < stream_cfg[best].priority ||
+		    (stream_cfg[i].priority == stream_cfg[best].priority &&
+		     streams[i].credit > streams[best].credit))
+		{
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+/* Pop the next notification to send, NULL if there is none or no budget for it */
+static struct stream_buf *stream_next(enum my_service_stream *stream)
+{
+	struct stream_buf *buf = NULL;
+	uint32_t in_flight = my_service_notify_in_flight();
+	k_spinlock_key_t key;
+	int best;
+
+	if (in_flight >= BUDGET)
+	{
+		return NULL;
+	}
+
+	key = k_spin_lock(&streams_lock);
+
+	best = stream_pick(in_flight);
+	if (best >= 0 && streams[best].credit <= 0)
+	{
+		/* Every stream of this priority used its share, start a new
+		 * round. Credits are capped so an idle stream can't save up a
+		 * burst.
+		 */
+		for (int i = 0; i < MY_SERVICE_STREAM_COUNT; i++)
+		{
+			if (stream_cfg[i].priority == stream_cfg[best].priority)
+			{
+				streams[i].credit = MIN(streams[i].credit + stream_cfg[i].weight,
+							stream_cfg[i].weight);
+			}
+		}
+
+		best = stream_pick(in_flight);
+	}
+
+	if (best >= 0)
+	{
+		buf = CONTAINER_OF(sys_slist_get_not_empty(&streams[best].queue),
+				   struct stream_buf, node);
+		streams[best].count--;
+		streams[best].credit--;
+		*stream = best;
+	}
+
+	k_spin_unlock(&streams_lock, key);
+
+	return buf;
+}
+
+void my_service_streams_flush(void)
+{
+	struct stream_buf *buf;
+	sys_snode_t *node;
+	k_spinlock_key_t key;
+
+	for (int i = 0; i < MY_SERVICE_STREAM_COUNT; i++)
+	{
+		for (;;)
+		{
+			key = k_spin_lock(&streams_lock);
+			node = sys_slist_get(&streams[i].queue);
+			if (node)
+			{
+				streams[i].count--;
+			}
+			k_spin_unlock(&streams_lock, key);
+
+			if (!node)
+			{
+				break;
+			}
+
+			buf = CONTAINER_OF(node, struct stream_buf, node);
+			atomic_inc(&streams[i].stat_dropped);
+			stream_buf_free(buf);
+		}
+	}
+}
+
+uint32_t my_service_streams_queued(void)
+{
+	return k_mem_slab_num_used_get(&stream_slab);
+}
+
+void my_service_streams_on_sent(enum my_service_stream stream)
+{
+	atomic_inc(&streams[stream].stat_sent);
+
+	/* Budget freed up */
+	k_sem_give(&sched_sem);
+}
+
+void my_service_streams_stats_get(enum my_service_stream stream,
+				  struct my_service_stream_stats *stats)
+{
+	stats->queued  = atomic_get(&streams[stream].stat_queued);
+	stats->sent    = atomic_get(&streams[stream].stat_sent);
+	stats->dropped = atomic_get(&streams[stream].stat_dropped);
+}
+
+static void stream_thread(void *p1, void *p2, void *p3)
+{
+	enum my_service_stream stream;
+	struct stream_buf *buf;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;)
+	{
+		k_sem_take(&sched_sem, K_FOREVER);
+
+		while ((buf = stream_next(&stream)) != NULL)
+		{
+			if (my_service_stream_notify(buf->conn, stream, buf->data, buf->len))
+			{
+				atomic_inc(&streams[stream].stat_dropped);
+			}
+
+			stream_buf_free(buf);
+		}
+	}
+}
+
+K_THREAD_DEFINE(my_service_stream_tid, CONFIG_MY_SERVICE_STREAM_STACK_SIZE, stream_thread,
+		NULL, NULL, NULL, CONFIG_MY_SERVICE_STREAM_THREAD_PRIORITY, 0, 0);
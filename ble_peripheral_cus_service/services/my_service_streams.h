@@ -0,0 +1,56 @@
+#ifndef MY_SERVICE_STREAMS_H_
+#define MY_SERVICE_STREAMS_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/conn.h>
+
+#include "my_service.h"
+
+/*
+	Stream scheduler. Notifications of every stream are queued here and
+	handed to the stack by priority and weight, keeping at most
+	CONFIG_MY_SERVICE_TX_BUDGET notifications in the stack. Internal to
+	the my_service Service.
+*/
+
+/* Largest notification payload, the ATT MTU less the 3 byte header */
+#define MAX_TRANSMIT_SIZE (CONFIG_BT_L2CAP_TX_MTU - 3)
+
+/** @brief Copy @p data into the queue of @p stream.
+ *
+ *  @return 0 if queued, -ENOMEM if the stream already has
+ *          CONFIG_MY_SERVICE_STREAM_QUEUE_LEN notifications queued.
+ */
+int my_service_streams_queue(struct bt_conn *conn, enum my_service_stream stream,
+			     const uint8_t *data, uint16_t len);
+
+/** @brief Hand @p data straight to the stack, without a copy or a trip
+ *  through the scheduler thread, when no stream has anything queued and
+ *  the budget of @p stream allows it.
+ *
+ *  @return true if sent or refused by the stack, with the result in
+ *          @p err, false if the data has to be queued instead.
+ */
+bool my_service_streams_send_direct(struct bt_conn *conn, enum my_service_stream stream,
+				    const uint8_t *data, uint16_t len, int *err);
+
+/** @brief Drop everything queued, called on disconnect. */
+void my_service_streams_flush(void);
+
+/** @brief Notifications queued in all streams. */
+uint32_t my_service_streams_queued(void);
+
+/** @brief Called for every notification the stack reports sent. */
+void my_service_streams_on_sent(enum my_service_stream stream);
+
+void my_service_streams_stats_get(enum my_service_stream stream,
+				  struct my_service_stream_stats *stats);
+
+/** @brief Hand one notification to the stack, implemented by the service. */
+int my_service_stream_notify(struct bt_conn *conn, enum my_service_stream stream,
+			     const uint8_t *data, uint16_t len);
+
+/** @brief Notifications in the stack not yet reported sent. */
+uint32_t my_service_notify_in_flight(void);
+
+#endif /* MY_SERVICE_STREAMS_H_ */
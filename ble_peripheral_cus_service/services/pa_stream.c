@@ -0,0 +1,195 @@
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/gap.h>
+
+#include "pa_stream.h"
+
+#define FRAG_LEN  CONFIG_PA_STREAM_FRAG_LEN
+#define MAX_FRAGS CONFIG_PA_STREAM_MAX_FRAGS
+
+/* Data update period, every other periodic advertising interval (1.25 ms units) */
+#define UPDATE_PERIOD_US (2 * CONFIG_PA_STREAM_INTERVAL * 1250)
+
+/* AD structure length and type, then the fragment header */
+BUILD_ASSERT(2 + sizeof(struct pa_stream_hdr) + FRAG_LEN <= 252,
+	     "A fragment must fit in the periodic advertising data of one event");
+BUILD_ASSERT(MAX_FRAGS <= CONFIG_PA_STREAM_QUEUE_LEN,
+	     "A full size message must fit in the fragment queue");
+
+struct pa_stream_frag
+{
+	struct pa_stream_hdr hdr;
+	uint8_t data[FRAG_LEN];
+	uint8_t len;
+} __packed;
+
+K_MSGQ_DEFINE(frag_queue, sizeof(struct pa_stream_frag), CONFIG_PA_STREAM_QUEUE_LEN, 1);
+
+static struct bt_le_ext_adv *adv;
+static uint16_t msg_seq;
+
+static atomic_t stat_messages;
+static atomic_t stat_dropped;
+static atomic_t stat_fragments;
+static atomic_t stat_idle;
+static atomic_t stat_errors;
+
+static void pa_stream_update(struct k_work *work);
+static void pa_stream_tick(struct k_timer *timer);
+
+static K_WORK_DEFINE(update_work, pa_stream_update);
+static K_TIMER_DEFINE(update_timer, pa_stream_tick, NULL);
+
+/*
+	The controller repeats the last periodic advertising data in every
+	event until it is replaced. An update that lands twice in the same
+	event overwrites the first fragment before it was sent, which
+	receivers see as a lost message. The k_timer is not locked to the
+	radio, and the work queue adds latency, so updating once per interval
+	would drift into that case. The data is replaced every other interval
+	instead, which leaves a full event of margin for every fragment.
+*/
+static void pa_stream_update(struct k_work *work)
+{
+	static struct pa_stream_frag frag;
+	struct bt_data ad;
+	int err;
+
+	if (k_msgq_get(&frag_queue, &frag, K_NO_WAIT))
+	{
+		// Receivers drop the repeated fragment by its sequence number
+		atomic_inc(&stat_idle);
+		return;
+	}
+
+	ad.type = BT_DATA_MANUFACTURER_DATA;
+	ad.data_len = sizeof(frag.hdr) + frag.len;
+	ad.data = (const uint8_t *)&frag;
+
+	err = bt_le_per_adv_set_data(adv, &ad, 1);
+	if (err)
+	{
+		atomic_inc(&stat_errors);
+		return;
+	}
+
+	atomic_inc(&stat_fragments);
+}
+
+static void pa_stream_tick(struct k_timer *timer)
+{
+	k_work_submit(&update_work);
+}
+
+int pa_stream_start(void)
+{
+	struct bt_le_per_adv_param per_param =
+		BT_LE_PER_ADV_PARAM_INIT(CONFIG_PA_STREAM_INTERVAL,
+					 CONFIG_PA_STREAM_INTERVAL,
+					 BT_LE_PER_ADV_OPT_NONE);
+	int err;
+
+	err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN_NAME, NULL, &adv);
+	if (err)
+	{
+		printk("Failed to create advertising set (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_per_adv_set_param(adv, &per_param);
+	if (err)
+	{
+		printk("Failed to set periodic advertising parameters (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_per_adv_start(adv);
+	if (err)
+	{
+		printk("Failed to start periodic advertising (err %d)\n", err);
+		return err;
+	}
+
+	err = bt_le_ext_adv_start(adv, BT_LE_EXT_ADV_START_DEFAULT);
+	if (err)
+	{
+		printk("Failed to start extended advertising (err %d)\n", err);
+		return err;
+	}
+
+	k_timer_start(&update_timer, K_USEC(UPDATE_PERIOD_US), K_USEC(UPDATE_PERIOD_US));
+
+	printk("Periodic advertising started, interval %u us, update every %u us\n",
+	       CONFIG_PA_STREAM_INTERVAL * 1250, UPDATE_PERIOD_US);
+
+	return 0;
+}
+
+/* Only called from the producer thread, so the free space can't shrink
+ * between the check and the puts.
+ */
+int pa_stream_send(const uint8_t *data, uint16_t len)
+{
+	struct pa_stream_frag frag;
+	uint8_t count = DIV_ROUND_UP(len, FRAG_LEN);
+
+	if (adv == NULL)
+	{
+		atomic_inc(&stat_dropped);
+		return -EAGAIN;
+	}
+
+	if (len == 0 || count > MAX_FRAGS)
+	{
+		atomic_inc(&stat_dropped);
+		return -EMSGSIZE;
+	}
+
+	if (k_msgq_num_free_get(&frag_queue) < count)
+	{
+		atomic_inc(&stat_dropped);
+		return -ENOMEM;
+	}
+
+	frag.hdr.company_id = sys_cpu_to_le16(PA_STREAM_COMPANY_ID);
+	frag.hdr.seq = sys_cpu_to_le16(msg_seq);
+	frag.hdr.frag_count = count;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		frag.hdr.frag = i;
+		frag.len = MIN(len, FRAG_LEN);
+		memcpy(frag.data, data, frag.len);
+
+		k_msgq_put(&frag_queue, &frag, K_NO_WAIT);
+
+		data += frag.len;
+		len -= frag.len;
+	}
+
+	msg_seq++;
+	atomic_inc(&stat_messages);
+
+	return 0;
+}
+
+uint16_t pa_stream_max_len(void)
+{
+	return FRAG_LEN * MAX_FRAGS;
+}
+
+void pa_stream_stats_get(struct pa_stream_stats *stats)
+{
+	stats->messages  = atomic_get(&stat_messages);
+	stats->dropped   = atomic_get(&stat_dropped);
+	stats->fragments = atomic_get(&stat_fragments);
+	stats->idle      = atomic_get(&stat_idle);
+	stats->errors    = atomic_get(&stat_errors);
+}
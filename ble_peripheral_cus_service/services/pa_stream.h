@@ -0,0 +1,56 @@
+#ifndef PA_STREAM_H_
+#define PA_STREAM_H_
+
+#include <zephyr/types.h>
+
+/*
+	Connectionless broadcast of the data stream on a periodic advertising
+	train, for any number of receivers. Each message handed to
+	pa_stream_send() is split into fragments and one fragment is carried
+	per periodic advertising event, as manufacturer specific data starting
+	with struct pa_stream_hdr.
+*/
+
+/** @brief Company id in front of every fragment (Nordic Semiconductor). */
+#define PA_STREAM_COMPANY_ID 0x0059
+
+/** @brief Header of every fragment (little endian). */
+struct pa_stream_hdr
+{
+	uint16_t company_id;
+	/** Message sequence number, gaps mean messages were lost. */
+	uint16_t seq;
+	/** Index of this fragment within the message. */
+	uint8_t  frag;
+	/** Fragments the message was split into. */
+	uint8_t  frag_count;
+} __packed;
+
+/** @brief Broadcast counters. */
+struct pa_stream_stats
+{
+	/** Messages queued for broadcast. */
+	uint32_t messages;
+	/** Messages rejected because the fragment queue was full. */
+	uint32_t dropped;
+	/** Fragments handed to the controller. */
+	uint32_t fragments;
+	/** Data updates with no new fragment to send. */
+	uint32_t idle;
+	/** Periodic advertising data updates the controller rejected. */
+	uint32_t errors;
+};
+
+/** @brief Create the advertising set and start the periodic advertising train. */
+int pa_stream_start(void);
+
+/** @brief Queue one message, returns -ENOMEM if its fragments don't fit. */
+int pa_stream_send(const uint8_t *data, uint16_t len);
+
+/** @brief Largest message pa_stream_send() accepts. */
+uint16_t pa_stream_max_len(void);
+
+/** @brief Copy the broadcast counters. */
+void pa_stream_stats_get(struct pa_stream_stats *stats);
+
+#endif /* PA_STREAM_H_ */
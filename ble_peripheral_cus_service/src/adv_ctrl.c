@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Bond-aware advertising.
+
+	After a disconnect the peripheral first uses high duty cycle directed
+	advertising toward the last bonded central, which a central that is
+	looking for it connects to within a few ms. The controller stops
+	directed advertising after 1.28 s, after which undirected advertising
+	runs at the fast interval for CONFIG_ADV_CTRL_FAST_SEC and then at the
+	slow interval until a central connects. When a bonded central is back,
+	encryption is restored from the stored LTK without pairing again.
+
+	Directed advertising is sent to the identity address of the central,
+	so a central using a resolvable private address needs controller
+	based privacy to be found.
+*/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <zephyr.h>
+#include <settings/settings.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/hci.h>
+
+#include "adv_ctrl.h"
+#include "event_trace.h"
+
+/* Retry period while the stack still holds the previous connection object */
+#define RESTART_RETRY_MS 10
+
+static const struct bt_le_adv_param fast_param =
+	BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME,
+			     IS_ENABLED(CONFIG_FAST_START) ? BT_GAP_ADV_FAST_INT_MIN_1 :
+							     BT_GAP_ADV_FAST_INT_MIN_2,
+			     IS_ENABLED(CONFIG_FAST_START) ? BT_GAP_ADV_FAST_INT_MAX_1 :
+							     BT_GAP_ADV_FAST_INT_MAX_2,
+			     NULL);
+
+static const struct bt_le_adv_param slow_param =
+	BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME,
+			     BT_GAP_ADV_SLOW_INT_MIN,
+			     BT_GAP_ADV_SLOW_INT_MAX,
+			     NULL);
+
+static const struct bt_data *adv_ad;
+static size_t adv_ad_len;
+static const struct bt_data *adv_sd;
+static size_t adv_sd_len;
+
+static enum adv_ctrl_mode mode;
+static enum adv_ctrl_mode restart_mode;
+
+/* Last central the link was encrypted with, persisted in settings */
+static bt_addr_le_t last_peer;
+static bool last_peer_valid;
+
+/* Reconnect measurement, from the disconnect until connected and encrypted */
+static bool reconnecting;
+static bool encrypt_pending;
+static int64_t disconnect_ms;
+
+static struct adv_ctrl_stats stats;
+
+static void adv_ctrl_restart(struct k_work *work);
+static void adv_ctrl_slow_down(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(restart_work, adv_ctrl_restart);
+static K_WORK_DELAYABLE_DEFINE(slow_work, adv_ctrl_slow_down);
+
+#if defined(CONFIG_SETTINGS)
+static int adv_ctrl_settings_set(const char *name, size_t len,
+				 settings_read_cb read_cb, void *cb_arg)
+{
+	if (strcmp(name, "peer") || len != sizeof(last_peer)) {
+		return -ENOENT;
+	}
+
+	if (read_cb(cb_arg, &last_peer, sizeof(last_peer)) == sizeof(last_peer)) {
+		last_peer_valid = true;
+	}
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(adv_ctrl, "adv_ctrl", NULL, adv_ctrl_settings_set, NULL, NULL);
+#endif
+
+static void bond_match(const struct bt_bond_info *info, void *user_data)
+{
+	bool *found = user_data;
+
+	if (!bt_addr_le_cmp(&info->addr, &last_peer)) {
+		*found = true;
+	}
+}
+
+/* The bond may have been removed since the address was saved */
+static bool last_peer_bonded(void)
+{
+	bool found = false;
+
+	if (!IS_ENABLED(CONFIG_ADV_CTRL_DIRECTED) || !last_peer_valid) {
+		return false;
+	}
+
+	bt_foreach_bond(BT_ID_DEFAULT, bond_match, &found);
+
+	return found;
+}
+
+static int adv_ctrl_advertise(enum adv_ctrl_mode next)
+{
+	struct bt_le_adv_param dir_param =
+		BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME,
+				     0, 0, &last_peer);
+	int err;
+
+	k_work_cancel_delayable(&slow_work);
+	bt_le_adv_stop();
+
+	switch (next) {
+	case ADV_CTRL_DIRECTED:
+		err = bt_le_adv_start(&dir_param, NULL, 0, NULL, 0);
+		break;
+	case ADV_CTRL_FAST:
+		err = bt_le_adv_start(&fast_param, adv_ad, adv_ad_len, adv_sd, adv_sd_len);
+		if (!err) {
+			k_work_reschedule(&slow_work, K_SECONDS(CONFIG_ADV_CTRL_FAST_SEC));
+		}
+		break;
+	default:
+		err = bt_le_adv_start(&slow_param, adv_ad, adv_ad_len, adv_sd, adv_sd_len);
+		break;
+	}
+
+	if (!err) {
+		mode = next;
+	}
+
+	return err;
+}
+
+static void adv_ctrl_restart(struct k_work *work)
+{
+	int err = adv_ctrl_advertise(restart_mode);
+
+	if (err == -ENOMEM) {
+		/* The disconnected connection object is not released yet */
+		k_work_reschedule(&restart_work, K_MSEC(RESTART_RETRY_MS));
+	} else if (err) {
+		printk("Advertising failed to restart (err %d)\n", err);
+	}
+}
+
+static void adv_ctrl_slow_down(struct k_work *work)
+{
+	int err;
+
+	if (mode != ADV_CTRL_FAST) {
+		return;
+	}
+
+	err = adv_ctrl_advertise(ADV_CTRL_SLOW);
+	if (err) {
+		printk("Slow advertising failed to start (err %d)\n", err);
+	}
+}
+
+static void adv_ctrl_schedule(enum adv_ctrl_mode next)
+{
+	restart_mode = next;
+	k_work_reschedule(&restart_work, K_NO_WAIT);
+}
+
+int adv_ctrl_start(const struct bt_data *ad, size_t ad_len,
+		   const struct bt_data *sd, size_t sd_len)
+{
+	adv_ad = ad;
+	adv_ad_len = ad_len;
+	adv_sd = sd;
+	adv_sd_len = sd_len;
+
+	/* Called from bt_ready(), so advertise right away rather than from the workqueue */
+	if (last_peer_bonded() && !adv_ctrl_advertise(ADV_CTRL_DIRECTED)) {
+		return 0;
+	}
+
+	return adv_ctrl_advertise(ADV_CTRL_FAST);
+}
+
+void adv_ctrl_connected(struct bt_conn *conn, uint8_t err)
+{
+	uint32_t gap_ms;
+
+	if (err) {
+		if (mode == ADV_CTRL_DIRECTED) {
+			/* BT_HCI_ERR_ADV_TIMEOUT, the central didn't come back in time */
+			stats.directed_timeouts++;
+			adv_ctrl_schedule(ADV_CTRL_FAST);
+		} else {
+			adv_ctrl_schedule(mode == ADV_CTRL_SLOW ? ADV_CTRL_SLOW : ADV_CTRL_FAST);
+		}
+		return;
+	}
+
+	k_work_cancel_delayable(&slow_work);
+	k_work_cancel_delayable(&restart_work);
+
+	if (reconnecting) {
+		gap_ms = (uint32_t)(k_uptime_get() - disconnect_ms);
+
+		stats.reconnects[mode]++;
+		stats.last_ms = gap_ms;
+		stats.max_ms = MAX(stats.max_ms, gap_ms);
+		stats.total_ms += gap_ms;
+
+		event_trace(EVENT_TRACE_RECONNECT, gap_ms, mode);
+		printk("Reconnected after %u ms (advertising phase %u)\n", gap_ms, mode);
+
+		reconnecting = false;
+		encrypt_pending = true;
+	}
+
+	mode = ADV_CTRL_NONE;
+
+	/* A bonded central gets the link encrypted from the stored LTK straight away */
+	if (!bt_addr_le_cmp(bt_conn_get_dst(conn), &last_peer) && last_peer_bonded()) {
+		bt_conn_set_security(conn, BT_SECURITY_L2);
+	}
+}
+
+void adv_ctrl_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	disconnect_ms = k_uptime_get();
+	reconnecting = true;
+	encrypt_pending = false;
+
+	adv_ctrl_schedule(last_peer_bonded() ? ADV_CTRL_DIRECTED : ADV_CTRL_FAST);
+}
+
+void adv_ctrl_security_changed(struct bt_conn *conn, bt_security_t level,
+			       enum bt_security_err err)
+{
+	const bt_addr_le_t *dst = bt_conn_get_dst(conn);
+
+	if (err || level < BT_SECURITY_L2) {
+		return;
+	}
+
+	if (encrypt_pending) {
+		stats.last_encrypt_ms = (uint32_t)(k_uptime_get() - disconnect_ms);
+		encrypt_pending = false;
+
+		printk("Encrypted again after %u ms\n", stats.last_encrypt_ms);
+	}
+
+	/* Whether it bonded is checked when the address is used */
+	if (!last_peer_valid || bt_addr_le_cmp(dst, &last_peer)) {
+		bt_addr_le_copy(&last_peer, dst);
+		last_peer_valid = true;
+
+		if (IS_ENABLED(CONFIG_SETTINGS)) {
+			settings_save_one("adv_ctrl/peer", &last_peer, sizeof(last_peer));
+		}
+	}
+}
+
+enum adv_ctrl_mode adv_ctrl_mode_get(void)
+{
+	return mode;
+}
+
+void adv_ctrl_stats_get(struct adv_ctrl_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,60 @@
+#ifndef ADV_CTRL_H_
+#define ADV_CTRL_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+/** @brief Advertising phases, in the order they are tried after a disconnect. */
+enum adv_ctrl_mode
+{
+	/** Not advertising, a central is connected. */
+	ADV_CTRL_NONE,
+	/** High duty cycle directed advertising toward the last bonded central. */
+	ADV_CTRL_DIRECTED,
+	/** Undirected advertising at the fast interval. */
+	ADV_CTRL_FAST,
+	/** Undirected advertising at the slow interval. */
+	ADV_CTRL_SLOW,
+};
+
+/** @brief Reconnection counters, times from the disconnect in ms. */
+struct adv_ctrl_stats
+{
+	/** Reconnections, counted per phase that got the central back. */
+	uint32_t reconnects[ADV_CTRL_SLOW + 1];
+	/** Directed advertising runs that timed out without a connection. */
+	uint32_t directed_timeouts;
+	/** Last and longest time until connected again. */
+	uint32_t last_ms;
+	uint32_t max_ms;
+	/** Sum of all reconnect times, for the average. */
+	uint32_t total_ms;
+	/** Last time until the link was encrypted again. */
+	uint32_t last_encrypt_ms;
+};
+
+/** @brief Start advertising @p ad / @p sd, directed first if a bonded
+ *  central is known.
+ */
+int adv_ctrl_start(const struct bt_data *ad, size_t ad_len,
+		   const struct bt_data *sd, size_t sd_len);
+
+/** @brief Report a connection, or a failed one (directed advertising timeout). */
+void adv_ctrl_connected(struct bt_conn *conn, uint8_t err);
+
+/** @brief Report a disconnection, restarts advertising. */
+void adv_ctrl_disconnected(struct bt_conn *conn, uint8_t reason);
+
+/** @brief Report a change of the link security level. */
+void adv_ctrl_security_changed(struct bt_conn *conn, bt_security_t level,
+			       enum bt_security_err err);
+
+/** @brief Phase currently advertising in. */
+enum adv_ctrl_mode adv_ctrl_mode_get(void);
+
+/** @brief Copy the reconnection counters. */
+void adv_ctrl_stats_get(struct adv_ctrl_stats *stats);
+
+#endif /* ADV_CTRL_H_ */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Boot stage timestamps. The cycle counter starts with the system timer
+	early in the kernel init, so each timestamp is the time since roughly
+	kernel start. Time spent before that (reset, clock startup) is not
+	included.
+*/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <sys/printk.h>
+#include <init.h>
+#include <zephyr.h>
+
+#include "boot_time.h"
+
+static uint32_t stage_cyc[BOOT_STAGE_COUNT];
+static bool stage_set[BOOT_STAGE_COUNT];
+
+static const char *const stage_name[BOOT_STAGE_COUNT] =
+{
+	[BOOT_STAGE_KERNEL]       = "kernel",
+	[BOOT_STAGE_MAIN]         = "main",
+	[BOOT_STAGE_BT_ENABLE]    = "bt_enable",
+	[BOOT_STAGE_BT_READY]     = "bt_ready",
+	[BOOT_STAGE_SETTINGS]     = "settings",
+	[BOOT_STAGE_SERVICE_INIT] = "service_init",
+	[BOOT_STAGE_ADV_START]    = "adv_start",
+};
+
+void boot_time_mark(enum boot_stage stage)
+{
+	if (stage >= BOOT_STAGE_COUNT || stage_set[stage]) {
+		return;
+	}
+
+	stage_cyc[stage] = k_cycle_get_32();
+	stage_set[stage] = true;
+}
+
+uint32_t boot_time_us(enum boot_stage stage)
+{
+	if (stage >= BOOT_STAGE_COUNT || !stage_set[stage]) {
+		return 0;
+	}
+
+	return k_cyc_to_us_floor32(stage_cyc[stage]);
+}
+
+void boot_time_report(void)
+{
+	bool printed[BOOT_STAGE_COUNT] = { false };
+	uint32_t prev_us = 0;
+
+	/* Stages don't happen in enum order, fast start inits the service last */
+	for (int n = 0; n < BOOT_STAGE_COUNT; n++) {
+		int next = -1;
+
+		for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+			if (stage_set[i] && !printed[i] &&
+			    (next < 0 || (int32_t)(stage_cyc[i] - stage_cyc[next]) < 0)) {
+				next = i;
+			}
+		}
+
+		if (next < 0) {
+			break;
+		}
+
+		printed[next] = true;
+		printk("Boot %s: %u us (+%u us)\n", stage_name[next], boot_time_us(next),
+		       boot_time_us(next) - prev_us);
+		prev_us = boot_time_us(next);
+	}
+}
+
+static int boot_time_kernel(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	boot_time_mark(BOOT_STAGE_KERNEL);
+
+	return 0;
+}
+
+SYS_INIT(boot_time_kernel, POST_KERNEL, 0);
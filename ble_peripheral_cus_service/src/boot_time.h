@@ -0,0 +1,40 @@
+#ifndef BOOT_TIME_H_
+#define BOOT_TIME_H_
+
+#include <zephyr/types.h>
+
+/** @brief Boot stages timestamped on the way to the first advertisement. */
+enum boot_stage
+{
+	/** Kernel up and the cycle counter running (POST_KERNEL init). */
+	BOOT_STAGE_KERNEL,
+	/** main() entered. */
+	BOOT_STAGE_MAIN,
+	/** bt_enable() called. */
+	BOOT_STAGE_BT_ENABLE,
+	/** bt_ready() called by the stack. */
+	BOOT_STAGE_BT_READY,
+	/** Bonds and identity loaded from settings. */
+	BOOT_STAGE_SETTINGS,
+	/** my_service_init() returned. */
+	BOOT_STAGE_SERVICE_INIT,
+	/** bt_le_adv_start() returned, the device is connectable. */
+	BOOT_STAGE_ADV_START,
+
+	BOOT_STAGE_COUNT,
+};
+
+/** @brief Timestamp @p stage, only the first call per stage counts. */
+void boot_time_mark(enum boot_stage stage);
+
+/** @brief Time from the start of the cycle counter to @p stage in us,
+ *  0 if the stage has not been reached.
+ */
+uint32_t boot_time_us(enum boot_stage stage);
+
+/** @brief Print the stages in the order they were reached, with their time
+ *  and the time since the previous one.
+ */
+void boot_time_report(void);
+
+#endif /* BOOT_TIME_H_ */
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Traffic-aware connection parameter policy.
+
+	my_service reports every change of its TX backlog through
+	conn_policy_tx_changed(). When notifications pile up, the peripheral
+	asks for a short connection interval, zero slave latency and the 2M
+	PHY (BURST). Once the backlog has stayed drained for
+	CONFIG_CONN_POLICY_IDLE_HOLD_MS it falls back to a long interval with
+	slave latency (IDLE). Requests to the central are rate limited to one
+	per CONFIG_CONN_POLICY_MIN_UPDATE_MS. The evaluation work only runs when
+	one of these events may change the policy, never while the link sits
+	idle.
+*/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <zephyr.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include "conn_policy.h"
+#include "../services/my_service.h"
+
+static const struct bt_le_conn_param burst_param =
+	BT_LE_CONN_PARAM_INIT(CONFIG_CONN_POLICY_BURST_INT_MIN,
+			      CONFIG_CONN_POLICY_BURST_INT_MAX,
+			      0,
+			      CONFIG_CONN_POLICY_TIMEOUT);
+
+static const struct bt_le_conn_param idle_param =
+	BT_LE_CONN_PARAM_INIT(CONFIG_CONN_POLICY_IDLE_INT_MIN,
+			      CONFIG_CONN_POLICY_IDLE_INT_MAX,
+			      CONFIG_CONN_POLICY_IDLE_LATENCY,
+			      CONFIG_CONN_POLICY_TIMEOUT);
+
+/* Under conn_lock, the work takes its own reference to use it */
+static struct bt_conn *policy_conn;
+static struct k_spinlock conn_lock;
+static int64_t last_request_ms;
+
+/* Shared with the connection callbacks and with conn_policy_tx_changed(),
+ * which runs in whatever context sends or completes a notification.
+ */
+static atomic_t active;
+static atomic_t mode;
+static atomic_t mode_applied;
+/* k_uptime_get_32() when the backlog was last above BURST_EXIT */
+static atomic_t busy_ms;
+
+static void policy_eval(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(policy_work, policy_eval);
+
+enum conn_policy_mode conn_policy_mode_get(void)
+{
+	return (enum conn_policy_mode)atomic_get(&mode);
+}
+
+static enum conn_policy_mode policy_target(uint32_t pending, uint32_t drained_ms)
+{
+	if (pending >= CONFIG_CONN_POLICY_BURST_ENTER) {
+		return CONN_POLICY_BURST;
+	}
+
+	if (atomic_get(&mode) == CONN_POLICY_BURST) {
+		/* Hysteresis: stay in burst until the queue has been drained
+		 * for a while, so short pauses in the stream don't bounce the
+		 * connection between the two parameter sets.
+		 */
+		if (pending > CONFIG_CONN_POLICY_BURST_EXIT ||
+		    drained_ms < CONFIG_CONN_POLICY_IDLE_HOLD_MS) {
+			return CONN_POLICY_BURST;
+		}
+	}
+
+	return CONN_POLICY_IDLE;
+}
+
+static void policy_apply(struct bt_conn *conn, enum conn_policy_mode target)
+{
+	int err;
+
+	err = bt_conn_le_param_update(conn,
+				      target == CONN_POLICY_BURST ? &burst_param : &idle_param);
+	if (err && err != -EALREADY) {
+		printk("Connection parameter update failed (err %d)\n", err);
+		return;
+	}
+
+	if (target == CONN_POLICY_BURST) {
+		err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+		if (err && err != -EALREADY) {
+			printk("PHY update failed (err %d)\n", err);
+		}
+	}
+
+	atomic_set(&mode, target);
+	atomic_set(&mode_applied, true);
+
+	printk("Connection policy: %s\n", target == CONN_POLICY_BURST ? "burst" : "idle");
+}
+
+static void policy_eval(struct k_work *work)
+{
+	enum conn_policy_mode target;
+	int64_t now = k_uptime_get();
+	struct bt_conn *conn = NULL;
+	uint32_t pending;
+	uint32_t drained_ms;
+	int64_t wait_ms;
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+
+	if (policy_conn) {
+		conn = bt_conn_ref(policy_conn);
+	}
+
+	k_spin_unlock(&conn_lock, key);
+
+	if (!conn) {
+		return;
+	}
+
+	pending = my_service_tx_pending();
+	if (pending > CONFIG_CONN_POLICY_BURST_EXIT) {
+		atomic_set(&busy_ms, (uint32_t)now);
+	}
+	drained_ms = (uint32_t)now - (uint32_t)atomic_get(&busy_ms);
+
+	target = policy_target(pending, drained_ms);
+
+	if (target != atomic_get(&mode) || !atomic_get(&mode_applied)) {
+		wait_ms = last_request_ms + CONFIG_CONN_POLICY_MIN_UPDATE_MS - now;
+		if (wait_ms > 0) {
+			k_work_reschedule(&policy_work, K_MSEC(wait_ms));
+			bt_conn_unref(conn);
+			return;
+		}
+
+		last_request_ms = now;
+		policy_apply(conn, target);
+	}
+
+	bt_conn_unref(conn);
+
+	/* A drained burst goes idle without any further event, a busy one
+	 * is looked at again by the conn_policy_tx_changed() that drains it.
+	 */
+	if (atomic_get(&mode) == CONN_POLICY_BURST && pending <= CONFIG_CONN_POLICY_BURST_EXIT) {
+		k_work_reschedule(&policy_work,
+				  K_MSEC(CONFIG_CONN_POLICY_IDLE_HOLD_MS - MIN(drained_ms,
+						 CONFIG_CONN_POLICY_IDLE_HOLD_MS)));
+	}
+}
+
+void conn_policy_tx_changed(void)
+{
+	uint32_t pending;
+
+	if (!atomic_get(&active)) {
+		return;
+	}
+
+	pending = my_service_tx_pending();
+
+	if (atomic_get(&mode) == CONN_POLICY_BURST) {
+		if (pending > CONFIG_CONN_POLICY_BURST_EXIT) {
+			atomic_set(&busy_ms, k_uptime_get_32());
+		} else {
+			/* No-op while the idle hold is already counting down */
+			k_work_schedule(&policy_work, K_MSEC(CONFIG_CONN_POLICY_IDLE_HOLD_MS));
+		}
+	} else if (pending >= CONFIG_CONN_POLICY_BURST_ENTER) {
+		k_work_schedule(&policy_work, K_NO_WAIT);
+	}
+}
+
+void conn_policy_connected(struct bt_conn *conn)
+{
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+
+	if (policy_conn) {
+		k_spin_unlock(&conn_lock, key);
+		return;
+	}
+
+	policy_conn = bt_conn_ref(conn);
+	k_spin_unlock(&conn_lock, key);
+
+	atomic_set(&mode, CONN_POLICY_IDLE);
+	atomic_set(&mode_applied, false);
+	atomic_set(&busy_ms, k_uptime_get_32());
+
+	/* Leave the central time to finish its own setup procedures before
+	 * the first request.
+	 */
+	last_request_ms = k_uptime_get();
+
+	atomic_set(&active, true);
+	k_work_reschedule(&policy_work, K_MSEC(CONFIG_CONN_POLICY_MIN_UPDATE_MS));
+}
+
+void conn_policy_disconnected(struct bt_conn *conn)
+{
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+
+	if (conn != policy_conn) {
+		k_spin_unlock(&conn_lock, key);
+		return;
+	}
+
+	policy_conn = NULL;
+	k_spin_unlock(&conn_lock, key);
+
+	atomic_set(&active, false);
+	k_work_cancel_delayable(&policy_work);
+
+	/* A running policy_eval() holds its own reference */
+	bt_conn_unref(conn);
+}
+
+bool conn_policy_param_req(struct bt_conn *conn, const struct bt_le_conn_param *param)
+{
+	bool accept;
+
+	if (atomic_get(&mode) == CONN_POLICY_BURST) {
+		/* Anything slower than the burst parameters costs throughput */
+		accept = param->interval_max <= CONFIG_CONN_POLICY_BURST_INT_MAX &&
+			 param->latency == 0;
+	} else {
+		/* Anything faster than the idle parameters costs power */
+		accept = param->interval_min >= CONFIG_CONN_POLICY_IDLE_INT_MIN;
+	}
+
+	printk("Connection parameter request %u-%u latency %u %s\n",
+	       param->interval_min, param->interval_max, param->latency,
+	       accept ? "accepted" : "rejected");
+
+	return accept;
+}
+
+void conn_policy_param_updated(struct bt_conn *conn, uint16_t interval,
+			       uint16_t latency, uint16_t timeout)
+{
+	enum conn_policy_mode current = atomic_get(&mode);
+
+	ARG_UNUSED(timeout);
+
+	if (conn != policy_conn || !atomic_get(&mode_applied)) {
+		return;
+	}
+
+	if ((current == CONN_POLICY_BURST && interval > CONFIG_CONN_POLICY_BURST_INT_MAX) ||
+	    (current == CONN_POLICY_IDLE && interval < CONFIG_CONN_POLICY_IDLE_INT_MIN)) {
+		/* The central picked something else, ask again once the rate
+		 * limit allows it.
+		 */
+		atomic_set(&mode_applied, false);
+		k_work_schedule(&policy_work, K_NO_WAIT);
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef CONN_POLICY_H_
+#define CONN_POLICY_H_
+
+#include <zephyr/types.h>
+#include <stdbool.h>
+#include <bluetooth/conn.h>
+
+/** @brief Connection parameter policies selected from the TX backlog. */
+enum conn_policy_mode
+{
+	/** Long interval with slave latency, used while the TX queue is empty. */
+	CONN_POLICY_IDLE,
+	/** Short interval, zero latency and 2M PHY, used while a backlog builds. */
+	CONN_POLICY_BURST,
+};
+
+/** @brief Start watching the TX queue of a new connection. */
+void conn_policy_connected(struct bt_conn *conn);
+
+/** @brief Stop watching the connection. */
+void conn_policy_disconnected(struct bt_conn *conn);
+
+/** @brief Check a connection parameter request from the central.
+ *
+ *  @return true if @p param is compatible with the active policy.
+ */
+bool conn_policy_param_req(struct bt_conn *conn, const struct bt_le_conn_param *param);
+
+/** @brief Report connection parameters that took effect. */
+void conn_policy_param_updated(struct bt_conn *conn, uint16_t interval,
+			       uint16_t latency, uint16_t timeout);
+
+#if defined(CONFIG_CONN_POLICY)
+
+/** @brief Report that the TX backlog of my_service changed. Safe from any
+ *  context, cheap enough to call for every notification.
+ */
+void conn_policy_tx_changed(void);
+
+#else
+
+static inline void conn_policy_tx_changed(void)
+{
+}
+
+#endif /* CONFIG_CONN_POLICY */
+
+/** @brief Currently active policy. */
+enum conn_policy_mode conn_policy_mode_get(void);
+
+#endif /* CONN_POLICY_H_ */
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <sys/util.h>
+#include <zephyr.h>
+
+#if defined(CONFIG_EVENT_TRACE_BACKEND_RTT)
+#include <SEGGER_RTT.h>
+#endif
+
+#include "event_trace.h"
+
+#define RING_SIZE CONFIG_EVENT_TRACE_RING_SIZE
+
+BUILD_ASSERT((RING_SIZE & (RING_SIZE - 1)) == 0, "Ring size must be a power of two");
+
+/* Records drained per pass, bounded so the lock is never held for long */
+#define DRAIN_CHUNK 8
+
+static struct event_trace_record ring[RING_SIZE];
+static uint32_t ring_head;
+static uint32_t ring_tail;
+static uint32_t ring_dropped;
+static uint16_t record_seq;
+static struct k_spinlock ring_lock;
+
+static K_SEM_DEFINE(drain_sem, 0, 1);
+
+#if defined(CONFIG_EVENT_TRACE_BACKEND_RTT)
+static uint8_t rtt_buf[CONFIG_EVENT_TRACE_RTT_BUFFER_SIZE];
+#endif
+
+void event_trace(enum event_trace_id id, uint32_t arg0, uint32_t arg1)
+{
+	struct event_trace_record *rec;
+	uint32_t queued;
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+
+	if ((ring_head - ring_tail) >= RING_SIZE) {
+		ring_dropped++;
+		record_seq++;
+		k_spin_unlock(&ring_lock, key);
+		return;
+	}
+
+	rec = &ring[ring_head % RING_SIZE];
+	rec->timestamp = sys_cpu_to_le32(k_cycle_get_32());
+	rec->id = id;
+	rec->reserved = 0;
+	rec->seq = sys_cpu_to_le16(record_seq++);
+	rec->arg0 = sys_cpu_to_le32(arg0);
+	rec->arg1 = sys_cpu_to_le32(arg1);
+	ring_head++;
+	queued = ring_head - ring_tail;
+
+	k_spin_unlock(&ring_lock, key);
+
+	/* Wake the drain thread once per batch rather than per record */
+	if (queued == CONFIG_EVENT_TRACE_DRAIN_THRESHOLD) {
+		k_sem_give(&drain_sem);
+	}
+}
+
+static void event_trace_output(const struct event_trace_record *recs, uint32_t count)
+{
+#if defined(CONFIG_EVENT_TRACE_BACKEND_RTT)
+	const uint8_t *data = (const uint8_t *)recs;
+	uint32_t len = count * sizeof(*recs);
+	uint32_t written;
+
+	while (len) {
+		written = SEGGER_RTT_Write(CONFIG_EVENT_TRACE_RTT_CHANNEL, data, len);
+		if (!written) {
+			/* Host is not reading fast enough, the ring absorbs it */
+			k_sleep(K_MSEC(1));
+			continue;
+		}
+		data += written;
+		len -= written;
+	}
+#else
+	char hex[sizeof(*recs) * 2 + 1];
+
+	for (uint32_t i = 0; i < count; i++) {
+		bin2hex((const uint8_t *)&recs[i], sizeof(recs[i]), hex, sizeof(hex));
+		printk("TRC %s\n", hex);
+	}
+#endif
+}
+
+static uint32_t event_trace_take(struct event_trace_record *out, uint32_t max,
+				 uint32_t *dropped)
+{
+	k_spinlock_key_t key = k_spin_lock(&ring_lock);
+	uint32_t count = MIN(ring_head - ring_tail, max);
+
+	for (uint32_t i = 0; i < count; i++) {
+		out[i] = ring[(ring_tail + i) % RING_SIZE];
+	}
+	ring_tail += count;
+
+	*dropped = ring_dropped;
+	ring_dropped = 0;
+
+	k_spin_unlock(&ring_lock, key);
+
+	return count;
+}
+
+static void event_trace_thread(void *p1, void *p2, void *p3)
+{
+	struct event_trace_record recs[DRAIN_CHUNK];
+	uint32_t dropped;
+	uint32_t count;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+#if defined(CONFIG_EVENT_TRACE_BACKEND_RTT)
+	SEGGER_RTT_ConfigUpBuffer(CONFIG_EVENT_TRACE_RTT_CHANNEL, "trace",
+				  rtt_buf, sizeof(rtt_buf),
+				  SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+#endif
+
+	event_trace(EVENT_TRACE_START, sys_clock_hw_cycles_per_sec(), 0);
+
+	for (;;) {
+		k_sem_take(&drain_sem, K_MSEC(CONFIG_EVENT_TRACE_DRAIN_INTERVAL_MS));
+
+		do {
+			count = event_trace_take(recs, ARRAY_SIZE(recs), &dropped);
+
+			if (dropped) {
+				event_trace(EVENT_TRACE_OVERFLOW, dropped, 0);
+			}
+
+			event_trace_output(recs, count);
+		} while (count == ARRAY_SIZE(recs));
+	}
+}
+
+/* Lowest priority, so draining only uses otherwise idle CPU time */
+K_THREAD_DEFINE(event_trace_tid, CONFIG_EVENT_TRACE_STACK_SIZE, event_trace_thread,
+		NULL, NULL, NULL, K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
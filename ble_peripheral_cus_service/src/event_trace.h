@@ -0,0 +1,77 @@
+#ifndef EVENT_TRACE_H_
+#define EVENT_TRACE_H_
+
+#include <zephyr/types.h>
+#include <sys/util.h>
+
+/*
+	Deferred binary event trace.
+
+	Hot paths record fixed-size binary events into a ring buffer, which
+	takes a few dozen cycles instead of a printk() formatting pass. A low
+	priority thread drains the ring over RTT or the console, and
+	scripts/event_trace_decode.py turns the records back into text on the
+	host. Keep the ids below in sync with the decoder.
+*/
+
+/** @brief Event ids and the meaning of their two arguments. */
+enum event_trace_id
+{
+	/** Trace started: arg0 = k_cycle_get_32() frequency. */
+	EVENT_TRACE_START          = 0x01,
+	/** Records lost because the ring was full: arg0 = count. */
+	EVENT_TRACE_OVERFLOW       = 0x02,
+
+	/** Connected: arg0 = err, arg1 = interval | latency << 16. */
+	EVENT_TRACE_CONNECTED      = 0x10,
+	/** Disconnected: arg0 = reason. */
+	EVENT_TRACE_DISCONNECTED   = 0x11,
+	/** Parameters updated: arg0 = interval | latency << 16, arg1 = timeout. */
+	EVENT_TRACE_PARAM_UPDATED  = 0x12,
+	/** Reconnected: arg0 = ms since the disconnect, arg1 = enum adv_ctrl_mode. */
+	EVENT_TRACE_RECONNECT      = 0x13,
+
+	/** Notification sent: arg0 = notifications still pending, arg1 = stream. */
+	EVENT_TRACE_NOTIFY_SENT    = 0x20,
+	/** Send failed: arg0 = negative error code, arg1 = length. */
+	EVENT_TRACE_SEND_ERR       = 0x21,
+	/** Codec characteristic written: arg0 = length, arg1 = first 4 bytes. */
+	EVENT_TRACE_RX             = 0x22,
+	/** CCC written: arg0 = value, arg1 = stream. */
+	EVENT_TRACE_CCC            = 0x23,
+
+	/** Producer sample: arg0 = sequence number, arg1 = jitter in cycles. */
+	EVENT_TRACE_SAMPLE         = 0x30,
+};
+
+/** @brief One record as stored in the ring and sent to the host (little endian). */
+struct event_trace_record
+{
+	/** k_cycle_get_32() when the event was recorded. */
+	uint32_t timestamp;
+	/** enum event_trace_id */
+	uint8_t  id;
+	uint8_t  reserved;
+	/** Record counter, gaps mean records were lost. */
+	uint16_t seq;
+	uint32_t arg0;
+	uint32_t arg1;
+} __packed;
+
+#if defined(CONFIG_EVENT_TRACE)
+
+/** @brief Record an event. Safe from any context, including ISRs. */
+void event_trace(enum event_trace_id id, uint32_t arg0, uint32_t arg1);
+
+#else
+
+static inline void event_trace(enum event_trace_id id, uint32_t arg0, uint32_t arg1)
+{
+	ARG_UNUSED(id);
+	ARG_UNUSED(arg0);
+	ARG_UNUSED(arg1);
+}
+
+#endif /* CONFIG_EVENT_TRACE */
+
+#endif /* EVENT_TRACE_H_ */
@@ -23,8 +23,15 @@
 #include <bluetooth/conn.h>
 #include <bluetooth/uuid.h>
 #include <bluetooth/gatt.h>
+#include <settings/settings.h>
 
 #include "../services/my_service.h"
+#include "../services/pa_stream.h"
+#include "conn_policy.h"
+#include "producer.h"
+#include "event_trace.h"
+#include "boot_time.h"
+#include "adv_ctrl.h"
 
 #define DEVICE_NAME             CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN         (sizeof(DEVICE_NAME) - 1)
@@ -42,46 +49,139 @@ static const struct bt_data sd[] =
 	BT_DATA_BYTES(BT_DATA_UUID128_ALL, MY_SERVICE_UUID),
 };
 
+/* Holds its own reference, read through connection_get() from other threads */
 struct bt_conn *my_connection;
+static struct k_spinlock conn_lock;
+
+/* The current connection with a reference taken, or NULL */
+static struct bt_conn *connection_get(void)
+{
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+
+	if (my_connection)
+	{
+		conn = bt_conn_ref(my_connection);
+	}
+
+	k_spin_unlock(&conn_lock, key);
+
+	return conn;
+}
+
+static void reconnect_stats_print(void)
+{
+	struct adv_ctrl_stats stats;
+	uint32_t count = 0;
+
+	adv_ctrl_stats_get(&stats);
+
+	for (int i = 0; i < ARRAY_SIZE(stats.reconnects); i++)
+	{
+		count += stats.reconnects[i];
+	}
+
+	if (!count)
+	{
+		return;
+	}
+
+	printk("Reconnects: %u directed, %u fast, %u slow, %u directed timeouts, "
+	       "average %u ms, max %u ms\n", stats.reconnects[ADV_CTRL_DIRECTED],
+	       stats.reconnects[ADV_CTRL_FAST], stats.reconnects[ADV_CTRL_SLOW],
+	       stats.directed_timeouts, stats.total_ms / count, stats.max_ms);
+}
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
 	struct bt_conn_info info; 
 	char addr[BT_ADDR_LE_STR_LEN];
 
-	my_connection = conn;
+	adv_ctrl_connected(conn, err);
 
 	if (err) 
 	{
+		event_trace(EVENT_TRACE_CONNECTED, err, 0);
 		printk("Connection failed (err %u)\n", err);
 		return;
 	}
-	else if(bt_conn_get_info(conn, &info))
+
+	reconnect_stats_print();
+
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+
+	if (!my_connection)
+	{
+		my_connection = bt_conn_ref(conn);
+	}
+
+	k_spin_unlock(&conn_lock, key);
+
+	if(bt_conn_get_info(conn, &info))
 	{
 		printk("Could not parse connection info\n");
 	}
 	else
 	{
-		bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-		
-		printk("Connection established!		\n\
-		Connected to: %s					\n\
-		Role: %u							\n\
-		Connection interval: %u				\n\
-		Slave latency: %u					\n\
-		Connection supervisory timeout: %u	\n"
-		, addr, info.role, info.le.interval, info.le.latency, info.le.timeout);
+		event_trace(EVENT_TRACE_CONNECTED, 0, info.le.interval | (info.le.latency << 16));
+
+		if (IS_ENABLED(CONFIG_CALLBACK_PRINTK))
+		{
+			bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+
+			printk("Connection established!		\n\
+			Connected to: %s					\n\
+			Role: %u							\n\
+			Connection interval: %u				\n\
+			Slave latency: %u					\n\
+			Connection supervisory timeout: %u	\n"
+			, addr, info.role, info.le.interval, info.le.latency, info.le.timeout);
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_CONN_POLICY))
+	{
+		conn_policy_connected(conn);
 	}
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
+	event_trace(EVENT_TRACE_DISCONNECTED, reason, 0);
 	printk("Disconnected (reason %u)\n", reason);
+
+	k_spinlock_key_t key = k_spin_lock(&conn_lock);
+	struct bt_conn *old = NULL;
+
+	if (my_connection == conn)
+	{
+		old = my_connection;
+		my_connection = NULL;
+	}
+
+	k_spin_unlock(&conn_lock, key);
+
+	if (old)
+	{
+		bt_conn_unref(old);
+	}
+
+	adv_ctrl_disconnected(conn, reason);
+
+	if (IS_ENABLED(CONFIG_CONN_POLICY))
+	{
+		conn_policy_disconnected(conn);
+	}
 }
 
 static bool le_param_req(struct bt_conn *conn, struct bt_le_conn_param *param)
 {
 	//If acceptable params, return true, otherwise return false.
+	if (IS_ENABLED(CONFIG_CONN_POLICY))
+	{
+		return conn_policy_param_req(conn, param);
+	}
+
 	return true; 
 }
 
@@ -89,8 +189,14 @@ static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t l
 {
 	struct bt_conn_info info; 
 	char addr[BT_ADDR_LE_STR_LEN];
-	
-	if(bt_conn_get_info(conn, &info))
+
+	event_trace(EVENT_TRACE_PARAM_UPDATED, interval | (latency << 16), timeout);
+
+	if (!IS_ENABLED(CONFIG_CALLBACK_PRINTK))
+	{
+		// Traced above, the text version is opt-in
+	}
+	else if(bt_conn_get_info(conn, &info))
 	{
 		printk("Could not parse connection info\n");
 	}
@@ -105,51 +211,210 @@ static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t l
 		New Connection Supervisory Timeout: %u	\n"
 		, addr, info.le.interval, info.le.latency, info.le.timeout);
 	}
+
+	if (IS_ENABLED(CONFIG_CONN_POLICY))
+	{
+		conn_policy_param_updated(conn, interval, latency, timeout);
+	}
 }
 
-static struct bt_conn_cb conn_callbacks = 
+#if defined(CONFIG_BT_SMP)
+static void security_changed(struct bt_conn *conn, bt_security_t level, enum bt_security_err err)
+{
+	if (IS_ENABLED(CONFIG_CALLBACK_PRINTK) || err)
+	{
+		printk("Security level %u (err %d)\n", level, err);
+	}
+
+	adv_ctrl_security_changed(conn, level, err);
+}
+#endif
+
+/* Registered at build time, so connections are handled from the first advertisement */
+BT_CONN_CB_DEFINE(conn_callbacks) = 
 {
 	.connected				= connected,
 	.disconnected   		= disconnected,
 	.le_param_req			= le_param_req,
-	.le_param_updated		= le_param_updated
+	.le_param_updated		= le_param_updated,
+#if defined(CONFIG_BT_SMP)
+	.security_changed		= security_changed
+#endif
 };
 
-static void bt_ready(int err)
+static int services_init(void)
 {
+	int err = my_service_init();
+
 	if (err) 
 	{
-		printk("BLE init failed with error code %d\n", err);
-		return;
+		printk("Failed to init LBS (err:%d)\n", err);
+		return err;
 	}
 
-	//Configure connection callbacks
-	bt_conn_cb_register(&conn_callbacks);
+	boot_time_mark(BOOT_STAGE_SERVICE_INIT);
+
+	return 0;
+}
 
-	//Initalize services
-	err = my_service_init();
+static void bt_ready(int err)
+{
+	boot_time_mark(BOOT_STAGE_BT_READY);
 
 	if (err) 
 	{
-		printk("Failed to init LBS (err:%d)\n", err);
+		printk("BLE init failed with error code %d\n", err);
 		return;
 	}
 
-	//Start advertising
-	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad),
-			      sd, ARRAY_SIZE(sd));
+	//Bonds have to be loaded before advertising toward a bonded central
+	if (IS_ENABLED(CONFIG_BT_SETTINGS))
+	{
+		settings_load();
+		boot_time_mark(BOOT_STAGE_SETTINGS);
+	}
+
+	//Initalize services, after advertising in fast start mode
+	if (!IS_ENABLED(CONFIG_FAST_START))
+	{
+		err = services_init();
+		if (err)
+		{
+			return;
+		}
+	}
+
+	//Start advertising, directed if a bonded central is known
+	err = adv_ctrl_start(ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
 	if (err) 
 	{
 		printk("Advertising failed to start (err %d)\n", err);
 		return;
 	}
 
+	boot_time_mark(BOOT_STAGE_ADV_START);
+
+	/* 	The L2CAP server only has to be registered before a connected peer 	\
+		opens the channel, which can't happen within this callback. */
+	if (IS_ENABLED(CONFIG_FAST_START))
+	{
+		err = services_init();
+		if (err)
+		{
+			return;
+		}
+	}
+
 	printk("Advertising successfully started\n");
 
+	if (IS_ENABLED(CONFIG_PA_STREAM))
+	{
+		err = pa_stream_start();
+		if (err)
+		{
+			return;
+		}
+	}
+
 	k_sem_give(&ble_init_ok);
 }
 
 
+/* Producer counters sent on the STATUS stream (little endian) */
+struct status_msg
+{
+	uint32_t produced;
+	uint32_t sent;
+	uint32_t overruns;
+	uint32_t dropped;
+	/* Notifications, SDUs and indications not yet sent */
+	uint32_t tx_pending;
+} __packed;
+
+/* Send the counters to a subscribed Client, binary on STATUS and the printed line on LOG */
+static void status_send(const struct producer_stats *stats, const char *line, size_t line_len)
+{
+	struct bt_conn *conn = connection_get();
+
+	if (!conn)
+	{
+		return;
+	}
+
+	if (my_service_stream_subscribed(conn, MY_SERVICE_STREAM_STATUS))
+	{
+		struct status_msg msg = 
+		{
+			.produced	= sys_cpu_to_le32(stats->produced),
+			.sent		= sys_cpu_to_le32(stats->sent),
+			.overruns	= sys_cpu_to_le32(stats->overruns),
+			.dropped	= sys_cpu_to_le32(stats->dropped),
+			.tx_pending	= sys_cpu_to_le32(my_service_tx_pending())
+		};
+
+		my_service_stream_send(conn, MY_SERVICE_STREAM_STATUS, (const uint8_t *)&msg,
+				       sizeof(msg));
+	}
+
+	if (my_service_stream_subscribed(conn, MY_SERVICE_STREAM_LOG))
+	{
+		my_service_stream_send(conn, MY_SERVICE_STREAM_LOG, (const uint8_t *)line,
+				       MIN(line_len, bt_gatt_get_mtu(conn) - 3));
+	}
+
+	bt_conn_unref(conn);
+}
+
+static int producer_send(const uint8_t *data, uint16_t len)
+{
+	struct bt_conn *conn = connection_get();
+	int err;
+
+	if (!conn)
+	{
+		return -ENOTCONN;
+	}
+
+	err = my_service_send(conn, data, len);
+	bt_conn_unref(conn);
+
+	return err;
+}
+
+static uint16_t producer_max_len(void)
+{
+	struct bt_conn *conn = connection_get();
+	uint16_t len;
+
+	if (!conn)
+	{
+		return 0;
+	}
+
+	len = my_service_max_payload(conn);
+	bt_conn_unref(conn);
+
+	return len;
+}
+
+/* Same samples, broadcast to every synced receiver instead of the Client */
+static const struct producer_sink broadcast_sink = 
+{
+	.send		= pa_stream_send,
+	.max_len	= pa_stream_max_len
+};
+
+static void producer_trace(uint32_t seq, uint32_t scheduled_cyc, uint32_t actual_cyc)
+{
+	event_trace(EVENT_TRACE_SAMPLE, seq, actual_cyc - scheduled_cyc);
+}
+
+static const struct producer_sink producer_sink = 
+{
+	.send		= producer_send,
+	.max_len	= producer_max_len
+};
+
 static void error(void)
 {
 	while (true) {
@@ -165,9 +430,11 @@ void main(void)
 	int err = 0;
 	uint32_t number = 0;
 
+	boot_time_mark(BOOT_STAGE_MAIN);
+
 	printk("Starting Nordic BLE peripheral tutorial\n");
 
-	
+	boot_time_mark(BOOT_STAGE_BT_ENABLE);
 	err = bt_enable(bt_ready);
 
 	if (err) 
@@ -186,26 +453,53 @@ void main(void)
 	if (!err) 
 	{
 		printk("Bluetooth initialized\n");
+		boot_time_report();
 	} else 
 	{
 		printk("BLE initialization did not complete in time\n");
 		error(); //Catch error
 	}
 
-	err = my_service_init();
-
-	#define BYTES_TO_SEND 30
+	if (IS_ENABLED(CONFIG_BENCH_SERVICE))
+	{
+		// The benchmark service owns the TX characteristic
+		return;
+	}
 
-	uint8_t number_arr[BYTES_TO_SEND];
-	for(int x = 0; x< sizeof(number_arr); x++){
-		number_arr[x] = x;
+	if (IS_ENABLED(CONFIG_EVENT_TRACE_SAMPLES))
+	{
+		producer_trace_set(producer_trace);
 	}
 
-	for (;;) 
+	/* 	Samples are taken at CONFIG_PRODUCER_RATE_HZ from a timer and sent 		\
+		in batches from the producer thread, so main() has nothing left to do. */
+	producer_start(IS_ENABLED(CONFIG_PA_STREAM) ? &broadcast_sink : &producer_sink);
+
+	while (CONFIG_PRODUCER_STATS_INTERVAL_S)
 	{
-		// Main loop
-		my_service_send(my_connection, number_arr, sizeof(number_arr));
-		number_arr[0]++;
-		k_sleep(K_MSEC(1000)); // 1000ms
+		struct producer_stats stats;
+		char line[128];
+		int len;
+
+		k_sleep(K_SECONDS(CONFIG_PRODUCER_STATS_INTERVAL_S));
+
+		producer_stats_get(&stats);
+		len = snprintk(line, sizeof(line), "Producer: %u produced, %u sent in %u batches, "
+			       "%u overruns, %u dropped, jitter max %u cycles\n", stats.produced,
+			       stats.sent, stats.batches, stats.overruns, stats.dropped,
+			       stats.jitter_max_cyc);
+		printk("%s", line);
+
+		status_send(&stats, line, MIN(len, sizeof(line) - 1));
+
+		if (IS_ENABLED(CONFIG_PA_STREAM))
+		{
+			struct pa_stream_stats pa;
+
+			pa_stream_stats_get(&pa);
+			printk("Broadcast: %u messages, %u dropped, %u fragments, %u idle, "
+			       "%u errors\n", pa.messages, pa.dropped, pa.fragments, pa.idle,
+			       pa.errors);
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Fixed-rate sampling producer.
+
+	Samples are taken from a k_timer ISR that is re-armed on an absolute
+	tick schedule (start + n / rate), so the sample period never drifts by
+	the time spent sending and the average rate is exact even when the
+	period is not a whole number of ticks. Samples are stored in a
+	preallocated pool and a thread hands them to the sink in batches.
+	A batch only leaves the pool once the sink accepted it, so when the
+	sink can't keep up (-ENOMEM, or no connection to send on) the pool
+	fills, CONFIG_PRODUCER_OVERRUN decides which samples are lost, and they
+	are counted rather than blocking the sampling.
+*/
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <zephyr.h>
+
+#include "producer.h"
+
+#define POOL_SIZE CONFIG_PRODUCER_POOL_SIZE
+#define BATCH_MAX CONFIG_PRODUCER_BATCH_MAX
+
+BUILD_ASSERT(BATCH_MAX <= POOL_SIZE, "Batch larger than the sample pool");
+
+static struct producer_sample pool[POOL_SIZE];
+static uint32_t pool_head;
+static uint32_t pool_tail;
+static struct k_spinlock pool_lock;
+
+static uint8_t batch[BATCH_MAX * sizeof(struct producer_sample)];
+
+static const struct producer_sink *producer_sink;
+static producer_trace_t trace_hook;
+
+/* Sample schedule, only touched with the timer stopped or from its ISR */
+static int64_t start_ticks;
+static uint32_t seq;
+
+static struct producer_stats stats;
+
+static K_SEM_DEFINE(batch_ready, 0, 1);
+
+static void producer_tick(struct k_timer *timer);
+
+static K_TIMER_DEFINE(sample_timer, producer_tick, NULL);
+
+static inline int64_t producer_due_ticks(uint32_t n)
+{
+	return start_ticks + ((int64_t)n * CONFIG_SYS_CLOCK_TICKS_PER_SEC) / CONFIG_PRODUCER_RATE_HZ;
+}
+
+static void producer_sample(struct producer_sample *sample, uint32_t n, uint32_t now)
+{
+	/* Stand-in for a sensor read, the same ramp main() used to send */
+	sample->timestamp = sys_cpu_to_le32(now);
+	for (int i = 0; i < sizeof(sample->data); i++) {
+		sample->data[i] = i;
+	}
+	sample->data[0] = (uint8_t)n;
+}
+
+static void producer_tick(struct k_timer *timer)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t due = k_ticks_to_cyc_floor32(producer_due_ticks(seq));
+	uint32_t jitter = now - due;
+	uint32_t queued;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&pool_lock);
+
+	stats.produced++;
+	if (jitter > stats.jitter_max_cyc) {
+		stats.jitter_max_cyc = jitter;
+	}
+
+	if ((pool_head - pool_tail) >= POOL_SIZE) {
+		stats.overruns++;
+		if (IS_ENABLED(CONFIG_PRODUCER_OVERWRITE_OLDEST)) {
+			pool_tail++;
+		}
+	}
+
+	if ((pool_head - pool_tail) < POOL_SIZE) {
+		producer_sample(&pool[pool_head % POOL_SIZE], seq, now);
+		pool_head++;
+	}
+
+	queued = pool_head - pool_tail;
+
+	k_spin_unlock(&pool_lock, key);
+
+	if (trace_hook) {
+		trace_hook(seq, due, now);
+	}
+
+	seq++;
+	k_timer_start(timer, K_TIMEOUT_ABS_TICKS(producer_due_ticks(seq)), K_NO_WAIT);
+
+	if (queued >= CONFIG_PRODUCER_BATCH) {
+		k_sem_give(&batch_ready);
+	}
+}
+
+static void producer_schedule_start(void)
+{
+	seq = 0;
+	start_ticks = k_uptime_ticks() + 1;
+	k_timer_start(&sample_timer, K_TIMEOUT_ABS_TICKS(start_ticks), K_NO_WAIT);
+}
+
+void producer_trace_set(producer_trace_t hook)
+{
+	trace_hook = hook;
+}
+
+void producer_stats_get(struct producer_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&pool_lock);
+
+	*out = stats;
+
+	k_spin_unlock(&pool_lock, key);
+}
+
+void producer_start(const struct producer_sink *sink)
+{
+	producer_sink = sink;
+	producer_schedule_start();
+
+	printk("Producer started at %u Hz\n", CONFIG_PRODUCER_RATE_HZ);
+}
+
+/* Copy up to max samples out of the pool, leaving them there until
+ * producer_commit(). The copy is what lets the ISR keep sampling, and
+ * overwrite the oldest samples, while the batch waits for the stack.
+ */
+static uint32_t producer_peek(uint32_t max, uint32_t *tail)
+{
+	k_spinlock_key_t key = k_spin_lock(&pool_lock);
+	uint32_t count = MIN(pool_head - pool_tail, max);
+
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(&batch[i * sizeof(struct producer_sample)],
+		       &pool[(pool_tail + i) % POOL_SIZE],
+		       sizeof(struct producer_sample));
+	}
+	*tail = pool_tail;
+
+	k_spin_unlock(&pool_lock, key);
+
+	return count;
+}
+
+/* Remove a batch peeked at @p tail from the pool, @p sent if the sink
+ * accepted it. Samples the ISR overwrote meanwhile are already gone.
+ */
+static void producer_commit(uint32_t tail, uint32_t count, bool sent)
+{
+	k_spinlock_key_t key = k_spin_lock(&pool_lock);
+	uint32_t overwritten = MIN(pool_tail - tail, count);
+
+	pool_tail = tail + MAX(pool_tail - tail, count);
+
+	if (sent) {
+		/* Counted as overruns by the ISR, but they made it out */
+		stats.overruns -= overwritten;
+		stats.sent += count;
+		stats.batches++;
+	} else {
+		stats.dropped += count - overwritten;
+	}
+
+	k_spin_unlock(&pool_lock, key);
+}
+
+static void producer_thread(void *p1, void *p2, void *p3)
+{
+	uint32_t max;
+	uint32_t count;
+	uint32_t tail;
+	int err;
+
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;) {
+		/* Partial batches go out after CONFIG_PRODUCER_FLUSH_MS */
+		k_sem_take(&batch_ready, K_MSEC(CONFIG_PRODUCER_FLUSH_MS));
+
+		if (!producer_sink) {
+			continue;
+		}
+
+		do {
+			max = MIN(BATCH_MAX, producer_sink->max_len() / sizeof(struct producer_sample));
+			if (!max) {
+				/* Nowhere to send a sample, the pool holds them meanwhile */
+				k_sleep(K_MSEC(CONFIG_PRODUCER_FLUSH_MS));
+				break;
+			}
+
+			count = producer_peek(max, &tail);
+			if (!count) {
+				break;
+			}
+
+			err = producer_sink->send(batch, count * sizeof(struct producer_sample));
+			if (err == -ENOMEM) {
+				/* Give the stack a chance to free TX buffers */
+				k_sleep(K_MSEC(1));
+				break;
+			}
+
+			producer_commit(tail, count, !err);
+		} while (count >= CONFIG_PRODUCER_BATCH);
+	}
+}
+
+K_THREAD_DEFINE(producer_tid, CONFIG_PRODUCER_STACK_SIZE, producer_thread,
+		NULL, NULL, NULL, CONFIG_PRODUCER_THREAD_PRIORITY, 0, 0);
@@ -0,0 +1,61 @@
+#ifndef PRODUCER_H_
+#define PRODUCER_H_
+
+#include <zephyr/types.h>
+
+/** @brief One sample as it is handed to the sink (little endian). */
+struct producer_sample
+{
+	/** k_cycle_get_32() when the sample was taken. */
+	uint32_t timestamp;
+	uint8_t data[CONFIG_PRODUCER_SAMPLE_LEN];
+} __packed;
+
+/** @brief Where batches of samples are delivered. */
+struct producer_sink
+{
+	/** Send one batch, returns 0 on success, -ENOMEM to be retried. */
+	int (*send)(const uint8_t *data, uint16_t len);
+	/** Largest batch in bytes the sink accepts right now, 0 while it
+	 *  can't send at all.
+	 */
+	uint16_t (*max_len)(void);
+};
+
+/** @brief Sampling hook, called from the timer ISR for every sample.
+ *
+ *  @p scheduled_cyc is when the sample was due and @p actual_cyc when it
+ *  was taken, both in k_cycle_get_32() units, so their difference is the
+ *  sampling jitter.
+ */
+typedef void (*producer_trace_t)(uint32_t seq, uint32_t scheduled_cyc, uint32_t actual_cyc);
+
+/** @brief Producer counters, all in samples unless noted. */
+struct producer_stats
+{
+	/** Samples taken by the timer. */
+	uint32_t produced;
+	/** Samples lost because the pool was full, the sink rejecting
+	 *  batches with -ENOMEM or having no room fills it.
+	 */
+	uint32_t overruns;
+	/** Samples accepted by the sink. */
+	uint32_t sent;
+	/** Samples in batches the sink rejected with another error. */
+	uint32_t dropped;
+	/** Batches accepted by the sink. */
+	uint32_t batches;
+	/** Largest sampling jitter seen, in cycles. */
+	uint32_t jitter_max_cyc;
+};
+
+/** @brief Start sampling at CONFIG_PRODUCER_RATE_HZ into @p sink. */
+void producer_start(const struct producer_sink *sink);
+
+/** @brief Install a hook that sees every sample's timing. */
+void producer_trace_set(producer_trace_t hook);
+
+/** @brief Copy the producer counters. */
+void producer_stats_get(struct producer_stats *stats);
+
+#endif /* PRODUCER_H_ */
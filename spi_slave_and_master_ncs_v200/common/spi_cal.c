@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/byteorder.h>
+#include <sys/util.h>
+
+#include "spi_cal.h"
+
+#define HDR_LEN    sizeof(struct spi_frame_hdr)
+#define CHUNK      CONFIG_SPI_FRAME_CHUNK
+#define ERRORS_LEN 4
+
+/* xorshift32, so neighbouring bits and bytes differ between transactions */
+static uint32_t pattern_next(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return x;
+}
+
+static uint32_t pattern_seed(uint8_t seq)
+{
+	return 0x9e3779b9u * (seq + 1u);
+}
+
+void spi_cal_fill(uint8_t *xfer, uint8_t seq, uint32_t errors)
+{
+	const struct spi_frame_hdr hdr = {
+		.magic = SPI_FRAME_MAGIC,
+		.type = SPI_FRAME_TYPE_CAL,
+		.seq = seq,
+		.flags = SPI_FRAME_FLAG_LAST,
+		.len = sys_cpu_to_le16(CHUNK),
+	};
+	uint8_t *payload = xfer + HDR_LEN;
+	uint32_t x = pattern_seed(seq);
+
+	memcpy(xfer, &hdr, HDR_LEN);
+	sys_put_le32(errors, payload);
+
+	for (size_t i = ERRORS_LEN; i < CHUNK; i++) {
+		x = pattern_next(x);
+		payload[i] = (uint8_t)x;
+	}
+
+	sys_put_le32(spi_frame_crc32(0, xfer, HDR_LEN + CHUNK), payload + CHUNK);
+}
+
+int spi_cal_check(const uint8_t *xfer, uint32_t *errors)
+{
+	struct spi_frame_hdr hdr;
+	const uint8_t *payload = xfer + HDR_LEN;
+	uint16_t len;
+	uint32_t x;
+	size_t i;
+
+	/* The other side was not armed and clocked out nothing but its def-char */
+	for (i = 0; i < SPI_FRAME_XFER_LEN; i++) {
+		if (xfer[i] != CONFIG_SPI_FRAME_CAL_IDLE_CHAR) {
+			break;
+		}
+	}
+	if (i == SPI_FRAME_XFER_LEN) {
+		return -ENODATA;
+	}
+
+	memcpy(&hdr, xfer, HDR_LEN);
+	len = sys_le16_to_cpu(hdr.len);
+
+	if (hdr.magic != SPI_FRAME_MAGIC || len > CHUNK ||
+	    spi_frame_crc32(0, xfer, HDR_LEN + len) != sys_get_le32(payload + CHUNK)) {
+		return -EBADMSG;
+	}
+
+	if (hdr.type != SPI_FRAME_TYPE_CAL) {
+		return 0;
+	}
+
+	if (len != CHUNK) {
+		return -EBADMSG;
+	}
+
+	x = pattern_seed(hdr.seq);
+	for (size_t i = ERRORS_LEN; i < CHUNK; i++) {
+		x = pattern_next(x);
+		if (payload[i] != (uint8_t)x) {
+			return -EBADMSG;
+		}
+	}
+
+	if (errors) {
+		*errors = sys_get_le32(payload);
+	}
+
+	return 1;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SPI_CAL_H_
+#define SPI_CAL_H_
+
+#include <zephyr/types.h>
+
+#include "spi_frame.h"
+
+/*
+	Clock calibration patterns, shared by spi_master and spi_slave.
+
+	A pattern frame is a single SPI_FRAME_TYPE_CAL fragment with a full
+	CONFIG_SPI_FRAME_CHUNK payload, so the CRC covers every byte of the
+	transaction:
+
+	  errors, le32 | pseudo-random bytes seeded by the sequence number
+
+	The master sends them while it tries a clock. As long as they keep
+	arriving, the slave answers with pattern frames whose errors field
+	counts the corrupt transactions it received, so the master checks
+	MISO itself and MOSI through the slave's count.
+*/
+
+BUILD_ASSERT(CONFIG_SPI_FRAME_CHUNK >= 8, "Pattern frames need a longer chunk");
+
+/** @brief Encode a pattern frame into a transaction buffer of
+ *  SPI_FRAME_XFER_LEN bytes.
+ */
+void spi_cal_fill(uint8_t *xfer, uint8_t seq, uint32_t errors);
+
+/** @brief Check a received transaction.
+ *
+ *  @return 1 for an intact pattern frame, with its errors field in
+ *          @p errors if not NULL, 0 for an intact frame of another type,
+ *          -ENODATA if every byte is CONFIG_SPI_FRAME_CAL_IDLE_CHAR (the
+ *          other side was not armed), -EBADMSG for anything else corrupt.
+ */
+int spi_cal_check(const uint8_t *xfer, uint32_t *errors);
+
+#endif /* SPI_CAL_H_ */
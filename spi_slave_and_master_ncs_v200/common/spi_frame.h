@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SPI_FRAME_H_
+#define SPI_FRAME_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <toolchain.h>
+#include <sys/util.h>
+
+/*
+	Framing shared by spi_master and spi_slave.
+
+	Every SPI transaction has the same length, SPI_FRAME_XFER_LEN, and
+	carries one fragment of a message:
+
+	  struct spi_frame_hdr | payload, CONFIG_SPI_FRAME_CHUNK bytes | CRC-32
+
+	Only the first len bytes of the payload are used. The CRC-32 (IEEE,
+	little endian) covers the header and those bytes. Messages longer than
+	a chunk are split into fragments 0, 1, ... and the last one has
+	SPI_FRAME_FLAG_LAST set. A transaction without anything to send
+	carries an SPI_FRAME_TYPE_IDLE header, and an unarmed slave clocks
+	out its def-char, which does not match SPI_FRAME_MAGIC.
+*/
+
+#define SPI_FRAME_MAGIC 0xA5
+
+#define SPI_FRAME_FLAG_LAST BIT(0)
+
+/** @brief Message types, the ones above SPI_FRAME_TYPE_CAL are free for
+ *  the application.
+ */
+enum spi_frame_type
+{
+	SPI_FRAME_TYPE_IDLE = 0x00,
+	SPI_FRAME_TYPE_DATA = 0x01,
+	/** Clock calibration pattern, see spi_cal.h. */
+	SPI_FRAME_TYPE_CAL  = 0x02,
+};
+
+struct spi_frame_hdr
+{
+	uint8_t magic;
+	/** enum spi_frame_type */
+	uint8_t type;
+	/** Message sequence number, the same in all its fragments. */
+	uint8_t seq;
+	/** SPI_FRAME_FLAG_* */
+	uint8_t flags;
+	/** Fragment index within the message. */
+	uint16_t frag;
+	/** Payload bytes in this fragment. */
+	uint16_t len;
+} __packed;
+
+#define SPI_FRAME_HDR_LEN  sizeof(struct spi_frame_hdr)
+#define SPI_FRAME_CRC_LEN  4
+#define SPI_FRAME_XFER_LEN (SPI_FRAME_HDR_LEN + CONFIG_SPI_FRAME_CHUNK + SPI_FRAME_CRC_LEN)
+
+/** @brief Message being sent. */
+struct spi_frame_tx
+{
+	const uint8_t *msg;
+	size_t len;
+	size_t offset;
+	uint16_t frag;
+	uint8_t type;
+	uint8_t seq;
+	bool busy;
+};
+
+/** @brief Message being received, and the receive counters. */
+struct spi_frame_rx
+{
+	uint8_t *buf;
+	size_t size;
+	size_t received;
+	uint16_t next_frag;
+	uint8_t seq;
+	uint8_t type;
+
+	/** Fragments with a valid CRC. */
+	uint32_t frames;
+	/** Complete messages. */
+	uint32_t messages;
+	/** Fragments with a bad CRC or header. */
+	uint32_t crc_errors;
+	/** Messages abandoned because a fragment was missing. */
+	uint32_t seq_errors;
+	/** Messages that did not fit the buffer. */
+	uint32_t overflows;
+};
+
+/** @brief Table driven CRC-32 (IEEE 802.3), start with @p crc = 0. */
+uint32_t spi_frame_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+/** @brief Start sending @p len bytes of @p msg, which has to stay valid
+ *  until spi_frame_tx_busy() returns false.
+ */
+void spi_frame_tx_start(struct spi_frame_tx *tx, uint8_t type, uint8_t seq,
+			const void *msg, size_t len);
+
+bool spi_frame_tx_busy(const struct spi_frame_tx *tx);
+
+/** @brief Encode the next fragment, or an idle frame if there is none,
+ *  into a transaction buffer of SPI_FRAME_XFER_LEN bytes.
+ */
+void spi_frame_tx_fill(struct spi_frame_tx *tx, uint8_t *xfer);
+
+/** @brief Check a received transaction of SPI_FRAME_XFER_LEN bytes in
+ *  place, for receivers that use the payload where it is.
+ *
+ *  @p hdr gets the header in CPU byte order, the payload starts
+ *  SPI_FRAME_HDR_LEN bytes into @p xfer.
+ *
+ *  @return Payload length, -ENODATA if nothing was sent (the other side
+ *          was not armed), -EBADMSG for a bad CRC or header.
+ */
+int spi_frame_check(const uint8_t *xfer, struct spi_frame_hdr *hdr);
+
+/** @brief Receive messages into @p buf, which can be reused once
+ *  spi_frame_rx_put() reported a complete message.
+ */
+void spi_frame_rx_init(struct spi_frame_rx *rx, void *buf, size_t size);
+
+/** @brief Check a received transaction of SPI_FRAME_XFER_LEN bytes and
+ *  copy its payload to its place in the receive buffer.
+ *
+ *  @return Message length once the last fragment arrived, 0 for an idle
+ *          transaction or a fragment that is not the last, -EBADMSG for a
+ *          bad CRC or header, -EILSEQ for a fragment out of order,
+ *          -EMSGSIZE if the message does not fit the receive buffer.
+ */
+int spi_frame_rx_put(struct spi_frame_rx *rx, const uint8_t *xfer);
+
+#endif /* SPI_FRAME_H_ */
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	SPI master benchmark.
+
+	Sweeps transfer sizes and clock frequencies with the blocking
+	spi_transceive() and the double-buffered spi_stream, on the bench_spi
+	controller with MOSI looped back to MISO. Every transfer carries its
+	start time in its first bytes, so the loopback brings it back with
+	the data and the latency is measured from the received copy. The
+	received data is compared against what was sent.
+
+	One line per measurement, for twister's console harness:
+
+	  BENCH SPI: mode=<sync|async> freq=<Hz> len=<bytes> xfers=<n>
+	             errors=<n> throughput_bps=<n> lat_p50_us=<n>
+	             lat_p90_us=<n> lat_p99_us=<n> lat_max_us=<n>
+	             cpu_pct=<n>
+	  BENCH SPI DONE: points=<n> failed=<n>
+
+	cpu_pct is -1 without CONFIG_SCHED_THREAD_USAGE_ALL.
+*/
+
+#include <zephyr.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <drivers/spi.h>
+
+#include "spi_stream.h"
+
+#define BENCH_SPI_NODE DT_NODELABEL(bench_spi)
+#define XFERS          CONFIG_SPI_BENCH_XFERS
+
+/* Timestamp in the first bytes of every transfer */
+#define STAMP_LEN 4
+
+static const uint16_t lengths[] = { 16, 64, 256, 1024, 4096 };
+
+/* Doubling from 1 MHz up to CONFIG_SPI_BENCH_FREQ_MAX */
+static const uint32_t frequencies[] = { 1000000, 2000000, 4000000, 8000000,
+					16000000, 32000000 };
+
+/* The drivers only reconfigure when given another spi_config, so every
+ * frequency has its own.
+ */
+static struct spi_config configs[ARRAY_SIZE(frequencies)];
+
+static const struct device *spi_dev = DEVICE_DT_GET(BENCH_SPI_NODE);
+
+static uint8_t tx_buffer[CONFIG_SPI_STREAM_XFER_MAX];
+static uint8_t rx_buffer[CONFIG_SPI_STREAM_XFER_MAX];
+
+struct bench_result {
+	uint32_t latency_us[XFERS];
+	uint32_t count;
+	uint32_t errors;
+	uint32_t start_cyc;
+	uint32_t end_cyc;
+};
+
+static struct bench_result result;
+
+/* Stream state, touched from the stream thread only while it runs */
+static uint32_t fill_seq;
+static K_SEM_DEFINE(stream_done_sem, 0, 1);
+
+/* Each run tags its callbacks with a generation, so a transfer an earlier
+ * run still completes can't land in the result of the next point. The
+ * callbacks alternate, the stream keeps using the ones it was started with.
+ */
+static uint32_t stream_gen;
+static struct spi_stream_cb stream_cbs[2];
+
+static void pattern_fill(uint8_t *tx, size_t len, uint32_t seq)
+{
+	sys_put_le32(k_cycle_get_32(), tx);
+
+	for (size_t i = STAMP_LEN; i < len; i++) {
+		tx[i] = (uint8_t)(seq + i);
+	}
+}
+
+/* Latency from the start time in @p rx, or UINT32_MAX if @p rx is corrupt */
+static uint32_t pattern_check(const uint8_t *rx, size_t len, uint32_t seq, uint32_t now)
+{
+	for (size_t i = STAMP_LEN; i < len; i++) {
+		if (rx[i] != (uint8_t)(seq + i)) {
+			return UINT32_MAX;
+		}
+	}
+
+	return k_cyc_to_us_floor32(now - sys_get_le32(rx));
+}
+
+static void result_add(const uint8_t *rx, size_t len, uint32_t seq, int err)
+{
+	uint32_t now = k_cycle_get_32();
+	uint32_t latency = err ? UINT32_MAX : pattern_check(rx, len, seq, now);
+
+	if (latency == UINT32_MAX) {
+		result.errors++;
+	} else {
+		result.latency_us[result.count - result.errors] = latency;
+	}
+
+	result.count++;
+	result.end_cyc = now;
+}
+
+static void stream_fill(uint8_t *tx, size_t len, void *user_data)
+{
+	pattern_fill(tx, len, fill_seq++);
+}
+
+/* Transfers complete in order, so the n-th one carries sequence number n */
+static void stream_done(const uint8_t *rx, size_t len, int err, void *user_data)
+{
+	if (POINTER_TO_UINT(user_data) != stream_gen || result.count >= XFERS) {
+		return;
+	}
+
+	result_add(rx, len, result.count, err);
+
+	if (result.count == XFERS) {
+		spi_stream_stop();
+		k_sem_give(&stream_done_sem);
+	}
+}
+
+static int run_sync(const struct spi_config *cfg, size_t len)
+{
+	const struct spi_buf tx_buf = { .buf = tx_buffer, .len = len };
+	const struct spi_buf rx_buf = { .buf = rx_buffer, .len = len };
+	const struct spi_buf_set tx = { .buffers = &tx_buf, .count = 1 };
+	const struct spi_buf_set rx = { .buffers = &rx_buf, .count = 1 };
+
+	result.start_cyc = k_cycle_get_32();
+
+	for (uint32_t seq = 0; seq < XFERS; seq++) {
+		int err;
+
+		pattern_fill(tx_buffer, len, seq);
+		err = spi_transceive(spi_dev, cfg, &tx, &rx);
+		result_add(rx_buffer, len, seq, err);
+	}
+
+	return 0;
+}
+
+static int run_async(const struct spi_config *cfg, size_t len)
+{
+	struct spi_stream_cb *cb;
+	int err;
+
+	fill_seq = 0;
+	k_sem_reset(&stream_done_sem);
+
+	stream_gen++;
+	cb = &stream_cbs[stream_gen % ARRAY_SIZE(stream_cbs)];
+	cb->fill = stream_fill;
+	cb->done = stream_done;
+	cb->user_data = UINT_TO_POINTER(stream_gen);
+
+	result.start_cyc = k_cycle_get_32();
+
+	err = spi_stream_start(spi_dev, cfg, len, cb);
+	if (err) {
+		return err;
+	}
+
+	k_sem_take(&stream_done_sem, K_FOREVER);
+
+	/* spi_stream_running() stays true until the queued transfers have
+	 * completed, so the next point starts on an idle stream.
+	 */
+	while (spi_stream_running()) {
+		k_sleep(K_MSEC(1));
+	}
+
+	return 0;
+}
+
+#if defined(CONFIG_SCHED_THREAD_USAGE_ALL)
+static k_thread_runtime_stats_t cpu_start;
+
+static void cpu_load_start(void)
+{
+	k_thread_runtime_stats_all_get(&cpu_start);
+}
+
+/* Non-idle share of the cycles since cpu_load_start() */
+static int cpu_load_pct(void)
+{
+	k_thread_runtime_stats_t now;
+	uint64_t busy;
+	uint64_t all;
+
+	k_thread_runtime_stats_all_get(&now);
+
+	busy = now.total_cycles - cpu_start.total_cycles;
+	all = now.execution_cycles - cpu_start.execution_cycles;
+
+	return all ? (int)(busy * 100 / all) : -1;
+}
+#else
+static void cpu_load_start(void)
+{
+}
+
+static int cpu_load_pct(void)
+{
+	return -1;
+}
+#endif
+
+/* In place, the latencies are only sorted after the measurement */
+static void sort_u32(uint32_t *v, size_t n)
+{
+	for (size_t i = 1; i < n; i++) {
+		uint32_t x = v[i];
+		size_t j = i;
+
+		while (j > 0 && v[j - 1] > x) {
+			v[j] = v[j - 1];
+			j--;
+		}
+		v[j] = x;
+	}
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, uint32_t pct)
+{
+	return n ? sorted[MIN(n * pct / 100, n - 1)] : 0;
+}
+
+static bool bench_point(bool async, const struct spi_config *cfg, size_t len)
+{
+	uint32_t valid;
+	uint64_t elapsed_us;
+	uint32_t throughput;
+	int cpu;
+	int err;
+
+	memset(&result, 0, sizeof(result));
+	cpu_load_start();
+
+	err = async ? run_async(cfg, len) : run_sync(cfg, len);
+
+	cpu = cpu_load_pct();
+
+	if (err) {
+		printk("BENCH SPI: mode=%s freq=%u len=%u err=%d\n", async ? "async" : "sync",
+		       cfg->frequency, (uint32_t)len, err);
+		return false;
+	}
+
+	valid = result.count - result.errors;
+	sort_u32(result.latency_us, valid);
+
+	elapsed_us = k_cyc_to_us_floor64(result.end_cyc - result.start_cyc);
+	throughput = elapsed_us ? (uint32_t)((uint64_t)valid * len * USEC_PER_SEC / elapsed_us) : 0;
+
+	printk("BENCH SPI: mode=%s freq=%u len=%u xfers=%u errors=%u throughput_bps=%u "
+	       "lat_p50_us=%u lat_p90_us=%u lat_p99_us=%u lat_max_us=%u cpu_pct=%d\n",
+	       async ? "async" : "sync", cfg->frequency, (uint32_t)len, result.count,
+	       result.errors, throughput, percentile(result.latency_us, valid, 50),
+	       percentile(result.latency_us, valid, 90),
+	       percentile(result.latency_us, valid, 99),
+	       valid ? result.latency_us[valid - 1] : 0, cpu);
+
+	return result.errors == 0;
+}
+
+void main(void)
+{
+	uint32_t points = 0;
+	uint32_t failed = 0;
+
+	if (!device_is_ready(spi_dev)) {
+		printk("BENCH SPI: %s not ready\n", spi_dev->name);
+		return;
+	}
+
+	printk("BENCH SPI CONFIG: dev=%s xfers=%u freq_max=%u\n", spi_dev->name, XFERS,
+	       CONFIG_SPI_BENCH_FREQ_MAX);
+
+	for (int f = 0; f < ARRAY_SIZE(frequencies); f++) {
+		struct spi_config *cfg = &configs[f];
+
+		if (frequencies[f] > CONFIG_SPI_BENCH_FREQ_MAX) {
+			break;
+		}
+
+		cfg->operation = SPI_WORD_SET(8) | SPI_TRANSFER_MSB | SPI_MODE_CPOL | SPI_MODE_CPHA;
+		cfg->frequency = frequencies[f];
+
+		for (int l = 0; l < ARRAY_SIZE(lengths); l++) {
+			if (lengths[l] > CONFIG_SPI_STREAM_XFER_MAX) {
+				break;
+			}
+
+			for (int async = 0; async <= 1; async++) {
+				points++;
+				if (!bench_point(async, cfg, lengths[l])) {
+					failed++;
+				}
+			}
+		}
+	}
+
+	printk("BENCH SPI DONE: points=%u failed=%u\n", points, failed);
+}
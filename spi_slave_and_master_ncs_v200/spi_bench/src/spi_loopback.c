@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Emulated SPI controller for native_posix.
+
+	Every transfer copies the TX buffers to the RX buffers, as a MOSI-MISO
+	jumper would, and completes after the time its bytes take on the wire
+	at spi_config.frequency. Like the nrfx drivers, a controller runs one
+	transfer at a time and a second caller blocks on the bus lock until
+	the running transfer is done, so the sync and async APIs compare the
+	way they do on hardware.
+*/
+
+#define DT_DRV_COMPAT vnd_spi_loopback
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <device.h>
+#include <drivers/spi.h>
+
+struct spi_loopback_data {
+	struct k_sem lock;
+	struct k_sem sync;
+	struct k_timer timer;
+	struct k_poll_signal *signal;
+	int result;
+};
+
+/* Bytes in a buffer set, NULL counts as empty */
+static size_t buf_set_len(const struct spi_buf_set *set)
+{
+	size_t len = 0;
+
+	for (size_t i = 0; set && i < set->count; i++) {
+		len += set->buffers[i].len;
+	}
+
+	return len;
+}
+
+/* Clocks MAX(TX, RX) bytes, TX without data clocks out zeros */
+static size_t loopback_copy(const struct spi_buf_set *tx_bufs,
+			    const struct spi_buf_set *rx_bufs)
+{
+	size_t len = MAX(buf_set_len(tx_bufs), buf_set_len(rx_bufs));
+	size_t tx_i = 0, tx_off = 0;
+	size_t rx_i = 0, rx_off = 0;
+
+	for (size_t n = 0; n < len; n++) {
+		uint8_t byte = 0;
+
+		while (tx_bufs && tx_i < tx_bufs->count && tx_off == tx_bufs->buffers[tx_i].len) {
+			tx_i++;
+			tx_off = 0;
+		}
+		if (tx_bufs && tx_i < tx_bufs->count) {
+			const uint8_t *tx = tx_bufs->buffers[tx_i].buf;
+
+			byte = tx ? tx[tx_off] : 0;
+			tx_off++;
+		}
+
+		while (rx_bufs && rx_i < rx_bufs->count && rx_off == rx_bufs->buffers[rx_i].len) {
+			rx_i++;
+			rx_off = 0;
+		}
+		if (rx_bufs && rx_i < rx_bufs->count) {
+			uint8_t *rx = rx_bufs->buffers[rx_i].buf;
+
+			if (rx) {
+				rx[rx_off] = byte;
+			}
+			rx_off++;
+		}
+	}
+
+	return len;
+}
+
+static void loopback_done(struct k_timer *timer)
+{
+	struct spi_loopback_data *data = CONTAINER_OF(timer, struct spi_loopback_data, timer);
+
+	if (data->signal) {
+		k_poll_signal_raise(data->signal, data->result);
+	} else {
+		k_sem_give(&data->sync);
+	}
+
+	k_sem_give(&data->lock);
+}
+
+static int loopback_start(const struct device *dev, const struct spi_config *config,
+			  const struct spi_buf_set *tx_bufs,
+			  const struct spi_buf_set *rx_bufs,
+			  struct k_poll_signal *signal)
+{
+	struct spi_loopback_data *data = dev->data;
+	uint64_t wire_us;
+	size_t len;
+
+	if (config->frequency == 0 || (config->operation & SPI_OP_MODE_SLAVE)) {
+		return -EINVAL;
+	}
+
+	k_sem_take(&data->lock, K_FOREVER);
+
+	len = loopback_copy(tx_bufs, rx_bufs);
+	wire_us = DIV_ROUND_UP((uint64_t)len * 8 * USEC_PER_SEC, config->frequency);
+
+	data->signal = signal;
+	data->result = 0;
+	k_timer_start(&data->timer, K_USEC(MAX(wire_us, 1)), K_NO_WAIT);
+
+	return 0;
+}
+
+static int loopback_transceive(const struct device *dev, const struct spi_config *config,
+			       const struct spi_buf_set *tx_bufs,
+			       const struct spi_buf_set *rx_bufs)
+{
+	struct spi_loopback_data *data = dev->data;
+	int err = loopback_start(dev, config, tx_bufs, rx_bufs, NULL);
+
+	if (err) {
+		return err;
+	}
+
+	k_sem_take(&data->sync, K_FOREVER);
+
+	return 0;
+}
+
+#if defined(CONFIG_SPI_ASYNC)
+static int loopback_transceive_async(const struct device *dev,
+				     const struct spi_config *config,
+				     const struct spi_buf_set *tx_bufs,
+				     const struct spi_buf_set *rx_bufs,
+				     struct k_poll_signal *async)
+{
+	return loopback_start(dev, config, tx_bufs, rx_bufs, async);
+}
+#endif
+
+static int loopback_release(const struct device *dev, const struct spi_config *config)
+{
+	return 0;
+}
+
+static const struct spi_driver_api loopback_api = {
+	.transceive = loopback_transceive,
+#if defined(CONFIG_SPI_ASYNC)
+	.transceive_async = loopback_transceive_async,
+#endif
+	.release = loopback_release,
+};
+
+static int loopback_init(const struct device *dev)
+{
+	struct spi_loopback_data *data = dev->data;
+
+	k_sem_init(&data->lock, 1, 1);
+	k_sem_init(&data->sync, 0, 1);
+	k_timer_init(&data->timer, loopback_done, NULL);
+
+	return 0;
+}
+
+#define SPI_LOOPBACK_DEFINE(n)							\
+	static struct spi_loopback_data loopback_data_##n;			\
+	DEVICE_DT_INST_DEFINE(n, loopback_init, NULL, &loopback_data_##n, NULL, \
+			      POST_KERNEL, CONFIG_SPI_INIT_PRIORITY, &loopback_api);
+
+DT_INST_FOREACH_STATUS_OKAY(SPI_LOOPBACK_DEFINE)
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	SPI slave to BLE bridge.
+
+	The master's transactions land in the buffers of the spis_queue pool.
+	The bridge thread checks each one in place and notifies its payload
+	straight from the pool buffer, so the only copy is the one into the
+	stack's ACL buffer within bt_gatt_notify_cb(). The buffer goes back
+	to the pool right after. Each frame is one notification, so the
+	central sees the co-processor's framing, and a frame longer than the
+	ATT MTU allows is counted and not forwarded.
+
+	At most CONFIG_SPI_BRIDGE_TX_CREDITS notifications are in the stack,
+	a credit comes back when the stack reports one sent. When they are
+	all taken the thread waits with the frame and raises busy-gpios, so
+	the master stops clocking. A transaction the master is already in
+	lands in the armed buffer and the next one is prepared from the
+	pool, so nothing is dropped. Busy is also raised while the pool is
+	empty, since the next transaction would go to a scratch buffer, and
+	while no central is subscribed.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <drivers/spi.h>
+#include <drivers/gpio.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/gatt.h>
+
+#include "spi_frame.h"
+#include "spis_queue.h"
+#include "bridge.h"
+
+#define CREDITS CONFIG_SPI_BRIDGE_TX_CREDITS
+
+BUILD_ASSERT(SPI_FRAME_XFER_LEN <= CONFIG_SPIS_QUEUE_XFER_MAX,
+	     "A transaction does not fit CONFIG_SPIS_QUEUE_XFER_MAX");
+
+static const struct spi_config spi_cfg = {
+	.operation = SPI_WORD_SET(8) | SPI_TRANSFER_MSB | SPI_OP_MODE_SLAVE |
+		     SPI_MODE_CPOL | SPI_MODE_CPHA,
+	.frequency = 8000000,
+	.slave = 1,
+};
+
+/* Optional, without it the master has to pace itself */
+static const struct gpio_dt_spec busy =
+	GPIO_DT_SPEC_GET_OR(DT_PATH(zephyr_user), busy_gpios, {0});
+
+static const struct bt_gatt_attr *notify_attr;
+
+/* Never started, so it fills idle frames */
+static struct spi_frame_tx idle_tx;
+
+static K_SEM_DEFINE(bridge_start_sem, 0, 1);
+static K_SEM_DEFINE(credit_sem, 0, 1);
+static struct k_spinlock lock;
+
+/* Under the lock. conn_gen changes with the connection, so credits of an
+ * earlier connection are not returned to this one.
+ */
+static struct bt_conn *bridge_conn;
+static uint32_t conn_gen;
+static bool subscribed;
+static uint32_t in_flight;
+static bool waiting;
+static bool busy_level;
+static uint32_t busy_start_cyc;
+static uint64_t busy_cyc;
+static struct bridge_stats stats;
+static uint32_t dropped_base;
+
+static void busy_set_locked(void)
+{
+	uint32_t free = spis_queue_free();
+	bool level = waiting || free == 0 || !subscribed;
+	uint32_t now = k_cycle_get_32();
+
+	stats.pool_free_min = MIN(stats.pool_free_min, free);
+
+	if (level == busy_level) {
+		return;
+	}
+
+	if (level) {
+		busy_start_cyc = now;
+	} else {
+		busy_cyc += now - busy_start_cyc;
+	}
+	busy_level = level;
+
+	if (busy.port) {
+		gpio_pin_set_dt(&busy, level);
+	}
+}
+
+static void busy_update(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	busy_set_locked();
+
+	k_spin_unlock(&lock, key);
+}
+
+/* A referenced connection with a credit taken, or NULL to wait */
+static struct bt_conn *credit_take(uint32_t *gen)
+{
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (subscribed && in_flight < CREDITS) {
+		in_flight++;
+		conn = bt_conn_ref(bridge_conn);
+		*gen = conn_gen;
+		waiting = false;
+	} else {
+		if (!waiting && subscribed) {
+			stats.busy_events++;
+		}
+		waiting = true;
+	}
+
+	busy_set_locked();
+
+	k_spin_unlock(&lock, key);
+
+	return conn;
+}
+
+static void credit_put(uint32_t gen)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (gen == conn_gen && in_flight) {
+		in_flight--;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	k_sem_give(&credit_sem);
+}
+
+static void on_sent(struct bt_conn *conn, void *user_data)
+{
+	uint32_t gen = POINTER_TO_UINT(user_data);
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (gen == conn_gen) {
+		stats.sent++;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	credit_put(gen);
+}
+
+static void bridge_send(const uint8_t *data, uint16_t len)
+{
+	uint32_t start_cyc = k_cycle_get_32();
+	uint32_t wait_us;
+	k_spinlock_key_t key;
+
+	for (;;) {
+		struct bt_gatt_notify_params params = {
+			.attr = notify_attr,
+			.data = data,
+			.len = len,
+			.func = on_sent,
+		};
+		struct bt_conn *conn;
+		uint32_t gen;
+		int err;
+
+		conn = credit_take(&gen);
+		if (!conn) {
+			k_sem_take(&credit_sem, K_FOREVER);
+			continue;
+		}
+
+		if (len > bt_gatt_get_mtu(conn) - 3) {
+			bt_conn_unref(conn);
+			credit_put(gen);
+
+			key = k_spin_lock(&lock);
+			stats.oversize++;
+			k_spin_unlock(&lock, key);
+			return;
+		}
+
+		params.user_data = UINT_TO_POINTER(gen);
+
+		err = bt_gatt_notify_cb(conn, &params);
+		bt_conn_unref(conn);
+
+		if (!err) {
+			break;
+		}
+
+		/* Tried again, on this connection or the next one */
+		credit_put(gen);
+
+		if (err == -ENOMEM) {
+			key = k_spin_lock(&lock);
+			stats.enomem++;
+			k_spin_unlock(&lock, key);
+		}
+
+		k_sleep(K_MSEC(1));
+	}
+
+	wait_us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cyc);
+
+	key = k_spin_lock(&lock);
+
+	stats.notified++;
+	stats.bytes += len;
+	stats.wait_max_us = MAX(stats.wait_max_us, wait_us);
+
+	k_spin_unlock(&lock, key);
+}
+
+static void bridge_forward(const struct spis_xfer *xfer)
+{
+	struct spi_frame_hdr hdr;
+	int len = spi_frame_check(xfer->rx, &hdr);
+	k_spinlock_key_t key;
+
+	if (len == -EBADMSG) {
+		key = k_spin_lock(&lock);
+		stats.crc_errors++;
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	/* Idle, not armed in time, or calibration */
+	if (len <= 0 || hdr.type != SPI_FRAME_TYPE_DATA) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	stats.frames++;
+	k_spin_unlock(&lock, key);
+
+	bridge_send(xfer->rx + SPI_FRAME_HDR_LEN, len);
+}
+
+/* Runs in the queue thread, right after the buffer was taken from the pool */
+static void queue_fill(uint8_t *tx, size_t len, void *user_data)
+{
+	spi_frame_tx_fill(&idle_tx, tx);
+	busy_update();
+}
+
+int bridge_start(const struct device *dev, const struct bt_gatt_attr *attr)
+{
+	int err;
+
+	if (!device_is_ready(dev)) {
+		return -ENODEV;
+	}
+
+	/* Busy until a central subscribes */
+	busy_level = true;
+	busy_start_cyc = k_cycle_get_32();
+	stats.pool_free_min = CONFIG_SPIS_QUEUE_BUFFERS;
+
+	if (busy.port) {
+		err = gpio_pin_configure_dt(&busy, GPIO_OUTPUT_ACTIVE);
+		if (err) {
+			printk("Error %d: failed to configure busy pin %d\n", err, busy.pin);
+			return err;
+		}
+		printk("Busy on %s pin %d\n", busy.port->name, busy.pin);
+	} else {
+		printk("No busy-gpios, the master has to pace itself\n");
+	}
+
+	notify_attr = attr;
+
+	err = spis_queue_start(dev, &spi_cfg, SPI_FRAME_XFER_LEN, queue_fill, NULL);
+	if (err) {
+		return err;
+	}
+
+	k_sem_give(&bridge_start_sem);
+
+	return 0;
+}
+
+void bridge_conn_set(struct bt_conn *conn)
+{
+	struct bt_conn *old;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	old = bridge_conn;
+	bridge_conn = conn ? bt_conn_ref(conn) : NULL;
+	conn_gen++;
+	in_flight = 0;
+	subscribed = conn && bt_gatt_is_subscribed(conn, notify_attr, BT_GATT_CCC_NOTIFY);
+	busy_set_locked();
+
+	k_spin_unlock(&lock, key);
+
+	if (old) {
+		bt_conn_unref(old);
+	}
+
+	k_sem_give(&credit_sem);
+}
+
+void bridge_subscription_changed(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	subscribed = bridge_conn &&
+		     bt_gatt_is_subscribed(bridge_conn, notify_attr, BT_GATT_CCC_NOTIFY);
+	busy_set_locked();
+
+	k_spin_unlock(&lock, key);
+
+	k_sem_give(&credit_sem);
+}
+
+void bridge_stats_get(struct bridge_stats *out)
+{
+	struct spis_queue_stats queue;
+	k_spinlock_key_t key;
+	uint64_t cyc;
+
+	spis_queue_stats_get(&queue);
+
+	key = k_spin_lock(&lock);
+
+	*out = stats;
+	out->dropped = queue.dropped - dropped_base;
+	cyc = busy_cyc + (busy_level ? k_cycle_get_32() - busy_start_cyc : 0);
+
+	k_spin_unlock(&lock, key);
+
+	out->busy_ms = (uint32_t)k_cyc_to_ms_floor64(cyc);
+}
+
+void bridge_stats_reset(void)
+{
+	struct spis_queue_stats queue;
+	k_spinlock_key_t key;
+
+	spis_queue_stats_get(&queue);
+
+	key = k_spin_lock(&lock);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.pool_free_min = spis_queue_free();
+	dropped_base = queue.dropped;
+	busy_cyc = 0;
+	busy_start_cyc = k_cycle_get_32();
+
+	k_spin_unlock(&lock, key);
+}
+
+static void bridge_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	k_sem_take(&bridge_start_sem, K_FOREVER);
+
+	for (;;) {
+		struct spis_xfer *xfer = spis_queue_get(K_FOREVER);
+
+		bridge_forward(xfer);
+		spis_queue_release(xfer);
+		busy_update();
+	}
+}
+
+K_THREAD_DEFINE(bridge_tid, CONFIG_SPI_BRIDGE_STACK_SIZE, bridge_thread,
+		NULL, NULL, NULL, CONFIG_SPI_BRIDGE_THREAD_PRIORITY, 0, 0);
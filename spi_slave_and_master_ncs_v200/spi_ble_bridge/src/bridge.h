@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef BRIDGE_H_
+#define BRIDGE_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <device.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+/** @brief Bridge counters, since the last bridge_stats_reset(). */
+struct bridge_stats
+{
+	/** Data frames received from the SPI master. */
+	uint32_t frames;
+	/** Payload bytes handed to the stack. */
+	uint32_t bytes;
+	/** Notifications handed to the stack, and reported sent. */
+	uint32_t notified;
+	uint32_t sent;
+	/** Data frames longer than one notification on the connection
+	 *  can carry, not forwarded.
+	 */
+	uint32_t oversize;
+	/** Notifications the stack refused with -ENOMEM, each retried. */
+	uint32_t enomem;
+	/** Transactions with a bad CRC or header. */
+	uint32_t crc_errors;
+	/** Transactions the SPI master clocked while the pool was empty. */
+	uint32_t dropped;
+	/** Times busy was raised because the BLE credits ran out. */
+	uint32_t busy_events;
+	/** Time busy was raised for, for any reason. */
+	uint32_t busy_ms;
+	/** Longest time a frame waited for a credit. */
+	uint32_t wait_max_us;
+	/** Fewest pool buffers ever free. */
+	uint32_t pool_free_min;
+};
+
+/** @brief Forward frames from @p dev to notifications of @p attr.
+ *
+ *  @return 0 on success, or the error of spis_queue_start().
+ */
+int bridge_start(const struct device *dev, const struct bt_gatt_attr *attr);
+
+/** @brief Notify on @p conn from now on, NULL after it disconnected. */
+void bridge_conn_set(struct bt_conn *conn);
+
+/** @brief Called when the central changed the CCC of the attribute. */
+void bridge_subscription_changed(void);
+
+void bridge_stats_get(struct bridge_stats *stats);
+
+void bridge_stats_reset(void);
+
+#endif /* BRIDGE_H_ */
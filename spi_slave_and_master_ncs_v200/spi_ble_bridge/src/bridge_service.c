@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	GATT side of the bridge.
+
+	The custom service of ble_peripheral_cus_service with only its TX
+	characteristic, which carries the bridged data, and the benchmark
+	service, so bench_central can measure the bridge unchanged. A
+	benchmark START resets the counters and, with the emulated
+	co-processor, starts it with the requested frame size and rate. The
+	benchmark stats keep their meaning, one frame is one notification:
+
+	  frames  data frames received over SPI
+	  sent    notifications reported sent
+	  dropped frames too long for one notification
+	  enomem  notifications the stack refused with -ENOMEM
+	  bytes   payload bytes notified
+
+	What is lost before the bridge and the backpressure it applied are in
+	the bridge stats characteristic of the custom service instead, see
+	struct bridge_service_stats.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "my_service.h"
+#include "bench_service.h"
+#include "bridge.h"
+#include "bridge_service.h"
+#if defined(CONFIG_SPI_BRIDGE_EMUL)
+#include "coproc_emul.h"
+#endif
+
+#define BT_UUID_MY_SERVICE      BT_UUID_DECLARE_128(MY_SERVICE_UUID)
+#define BT_UUID_MY_SERVICE_TX   BT_UUID_DECLARE_128(TX_CHARACTERISTIC_UUID)
+#define BT_UUID_BRIDGE_STATS    BT_UUID_DECLARE_128(BRIDGE_STATS_CHARACTERISTIC_UUID)
+#define BT_UUID_BENCH_SERVICE   BT_UUID_DECLARE_128(BENCH_SERVICE_UUID)
+#define BT_UUID_BENCH_CTRL      BT_UUID_DECLARE_128(BENCH_CTRL_CHARACTERISTIC_UUID)
+#define BT_UUID_BENCH_STATS     BT_UUID_DECLARE_128(BENCH_STATS_CHARACTERISTIC_UUID)
+
+/* Benchmark run, written from the BT RX thread */
+static atomic_t bench_running;
+static int64_t bench_start_ms;
+static int64_t bench_stop_ms;
+
+static void on_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	printk("Notifications %s\n", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+
+	bridge_subscription_changed();
+}
+
+static ssize_t on_bridge_stats_read(struct bt_conn *conn,
+				    const struct bt_gatt_attr *attr,
+				    void *buf,
+				    uint16_t len,
+				    uint16_t offset)
+{
+	struct bridge_service_stats out;
+	struct bridge_stats bridge;
+
+	bridge_stats_get(&bridge);
+
+	memset(&out, 0, sizeof(out));
+	out.crc_errors    = sys_cpu_to_le32(bridge.crc_errors);
+	out.pool_dropped  = sys_cpu_to_le32(bridge.dropped);
+	out.busy_events   = sys_cpu_to_le32(bridge.busy_events);
+	out.busy_ms       = sys_cpu_to_le32(bridge.busy_ms);
+	out.wait_max_us   = sys_cpu_to_le32(bridge.wait_max_us);
+	out.pool_free_min = sys_cpu_to_le32(bridge.pool_free_min);
+
+#if defined(CONFIG_SPI_BRIDGE_EMUL)
+	struct coproc_emul_stats coproc;
+
+	coproc_emul_stats_get(&coproc);
+	out.coproc_lost = sys_cpu_to_le32(coproc.lost);
+#endif
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &out, sizeof(out));
+}
+
+BT_GATT_SERVICE_DEFINE(bridge_service,
+BT_GATT_PRIMARY_SERVICE(BT_UUID_MY_SERVICE),
+BT_GATT_CHARACTERISTIC(BT_UUID_MY_SERVICE_TX,
+		       BT_GATT_CHRC_NOTIFY,
+		       BT_GATT_PERM_READ,
+		       NULL, NULL, NULL),
+BT_GATT_CCC(on_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+BT_GATT_CHARACTERISTIC(BT_UUID_BRIDGE_STATS,
+		       BT_GATT_CHRC_READ,
+		       BT_GATT_PERM_READ,
+		       on_bridge_stats_read, NULL, NULL),
+);
+
+const struct bt_gatt_attr *bridge_service_tx_attr(void)
+{
+	/* 0 = Primary service, 1 = characteristic declaration, 2 = value */
+	return &bridge_service.attrs[2];
+}
+
+static int bench_start(const uint8_t *ctrl)
+{
+#if defined(CONFIG_SPI_BRIDGE_EMUL)
+	uint16_t len = sys_get_le16(&ctrl[offsetof(struct bench_ctrl, len)]);
+	uint16_t rate_hz = sys_get_le16(&ctrl[offsetof(struct bench_ctrl, rate_hz)]);
+	uint32_t count = sys_get_le32(&ctrl[offsetof(struct bench_ctrl, count)]);
+	int err;
+
+	bridge_stats_reset();
+
+	err = coproc_emul_start(len, rate_hz, count);
+	if (err) {
+		return err;
+	}
+#else
+	/* The co-processor streams on its own, only the counters restart */
+	bridge_stats_reset();
+#endif
+
+	bench_start_ms = k_uptime_get();
+	atomic_set(&bench_running, true);
+
+	return 0;
+}
+
+static void bench_stop(void)
+{
+#if defined(CONFIG_SPI_BRIDGE_EMUL)
+	coproc_emul_stop();
+#endif
+	if (atomic_cas(&bench_running, true, false)) {
+		bench_stop_ms = k_uptime_get();
+	}
+}
+
+static ssize_t on_ctrl_write(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr,
+			     const void *buf,
+			     uint16_t len,
+			     uint16_t offset,
+			     uint8_t flags)
+{
+	const uint8_t *ctrl = buf;
+
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (len < 1) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	switch (ctrl[0]) {
+	case BENCH_OP_START:
+		if (len != sizeof(struct bench_ctrl)) {
+			return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+		}
+
+		/* A frame has to fit one notification */
+		if (IS_ENABLED(CONFIG_SPI_BRIDGE_EMUL) &&
+		    sys_get_le16(&ctrl[offsetof(struct bench_ctrl, len)]) >
+		    bt_gatt_get_mtu(conn) - 3) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+
+		if (atomic_get(&bench_running) || bench_start(ctrl)) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+		break;
+
+	case BENCH_OP_STOP:
+		bench_stop();
+		break;
+
+	case BENCH_OP_RESET:
+		if (atomic_get(&bench_running)) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+		bridge_stats_reset();
+		bench_start_ms = bench_stop_ms = k_uptime_get();
+		break;
+
+	default:
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	return len;
+}
+
+static ssize_t on_stats_read(struct bt_conn *conn,
+			     const struct bt_gatt_attr *attr,
+			     void *buf,
+			     uint16_t len,
+			     uint16_t offset)
+{
+	struct bridge_stats bridge;
+	struct bench_stats stats;
+	int64_t stop_ms = atomic_get(&bench_running) ? k_uptime_get() : bench_stop_ms;
+
+	bridge_stats_get(&bridge);
+
+	memset(&stats, 0, sizeof(stats));
+	stats.frames         = sys_cpu_to_le32(bridge.frames);
+	stats.sent           = sys_cpu_to_le32(bridge.sent);
+	stats.dropped        = sys_cpu_to_le32(bridge.oversize);
+	stats.enomem         = sys_cpu_to_le32(bridge.enomem);
+	stats.bytes          = sys_cpu_to_le32(bridge.bytes);
+	stats.elapsed_ms     = sys_cpu_to_le32((uint32_t)(stop_ms - bench_start_ms));
+	stats.cycles_per_sec = sys_cpu_to_le32(sys_clock_hw_cycles_per_sec());
+	stats.gatt_bytes     = sys_cpu_to_le32(bridge.bytes);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats, sizeof(stats));
+}
+
+BT_GATT_SERVICE_DEFINE(bench_service,
+BT_GATT_PRIMARY_SERVICE(BT_UUID_BENCH_SERVICE),
+BT_GATT_CHARACTERISTIC(BT_UUID_BENCH_CTRL,
+		       BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+		       BT_GATT_PERM_WRITE,
+		       NULL, on_ctrl_write, NULL),
+BT_GATT_CHARACTERISTIC(BT_UUID_BENCH_STATS,
+		       BT_GATT_CHRC_READ,
+		       BT_GATT_PERM_READ,
+		       on_stats_read, NULL, NULL),
+);
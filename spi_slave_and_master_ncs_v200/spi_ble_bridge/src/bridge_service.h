@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef BRIDGE_SERVICE_H_
+#define BRIDGE_SERVICE_H_
+
+#include <zephyr/types.h>
+#include <bluetooth/gatt.h>
+
+#define BRIDGE_STATS_CHARACTERISTIC_UUID 0x2B, 0x90, 0x61, 0xE4, 0x3C, 0x5D, 0x4A, 0x87, \
+					 0x9E, 0x14, 0xD6, 0x0A, 0x74, 0xC3, 0x58, 0xB2
+
+/** @brief Bridge stats characteristic read format (little endian).
+ *
+ *  The losses and backpressure the benchmark stats have no field for,
+ *  since the last benchmark START or RESET.
+ */
+struct bridge_service_stats
+{
+	/** Transactions with a bad CRC or header. */
+	uint32_t crc_errors;
+	/** Transactions the master clocked while the pool was empty. */
+	uint32_t pool_dropped;
+	/** Frames the emulated co-processor clocked while the slave was
+	 *  not armed, 0 on hardware.
+	 */
+	uint32_t coproc_lost;
+	/** Times busy was raised because the BLE credits ran out. */
+	uint32_t busy_events;
+	/** Time busy was raised for, for any reason. */
+	uint32_t busy_ms;
+	/** Longest time a frame waited for a credit. */
+	uint32_t wait_max_us;
+	/** Fewest pool buffers ever free. */
+	uint32_t pool_free_min;
+} __packed;
+
+/** @brief Value attribute of the TX characteristic, which carries the
+ *  bridged data.
+ */
+const struct bt_gatt_attr *bridge_service_tx_attr(void);
+
+#endif /* BRIDGE_SERVICE_H_ */
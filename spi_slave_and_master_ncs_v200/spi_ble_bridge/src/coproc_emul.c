@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Emulated co-processor for BabbleSim.
+
+	Plays the SPI master that pushes data to the bridge: it frames each
+	buffer with spi_frame, holds off while the bridge raises busy and
+	clocks the frame through spi_slave_emul_clock() at
+	CONFIG_SPI_BRIDGE_EMUL_FREQ. Frames carry the benchmark header, so
+	bench_central measures the latency from here to the central, and the
+	loss, over the whole bridge. A frame clocked while the bridge was not
+	armed is gone, as it would be on the wire, and counted as lost.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <sys/byteorder.h>
+#include <drivers/gpio.h>
+#include <drivers/gpio/gpio_emul.h>
+
+#include "spi_frame.h"
+#include "bench_service.h"
+#include "spi_slave_emul.h"
+#include "coproc_emul.h"
+
+/* The busy line, read back from the emulated GPIO output */
+static const struct gpio_dt_spec busy =
+	GPIO_DT_SPEC_GET_OR(DT_PATH(zephyr_user), busy_gpios, {0});
+
+static const struct device *link_dev;
+
+static K_SEM_DEFINE(coproc_start_sem, 0, 1);
+
+/* running covers the whole run, stopping only asks coproc_run() to wind
+ * down, so the end of a stopped run can't clear a new start.
+ */
+static atomic_t running;
+static atomic_t stopping;
+static uint16_t coproc_len;
+static uint16_t coproc_rate_hz;
+static uint32_t coproc_count;
+
+static struct coproc_emul_stats stats;
+static struct k_spinlock stats_lock;
+
+static uint8_t msg[CONFIG_SPI_FRAME_CHUNK];
+static uint8_t mosi[SPI_FRAME_XFER_LEN];
+static uint8_t miso[SPI_FRAME_XFER_LEN];
+static struct spi_frame_tx frame_tx;
+
+int coproc_emul_init(const struct device *dev)
+{
+	if (!device_is_ready(dev)) {
+		return -ENODEV;
+	}
+
+	link_dev = dev;
+
+	return 0;
+}
+
+int coproc_emul_start(uint16_t len, uint16_t rate_hz, uint32_t count)
+{
+	if (len < sizeof(struct bench_hdr)) {
+		return -EINVAL;
+	}
+
+	if (!atomic_cas(&running, false, true)) {
+		return -EBUSY;
+	}
+
+	atomic_clear(&stopping);
+
+	coproc_len = MIN(len, sizeof(msg));
+	coproc_rate_hz = rate_hz;
+	coproc_count = count;
+
+	k_sem_give(&coproc_start_sem);
+
+	return 0;
+}
+
+void coproc_emul_stop(void)
+{
+	atomic_set(&stopping, true);
+}
+
+bool coproc_emul_running(void)
+{
+	return atomic_get(&running);
+}
+
+void coproc_emul_stats_get(struct coproc_emul_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void stats_inc(uint32_t *counter)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	(*counter)++;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+static bool busy_get(void)
+{
+	return busy.port && gpio_emul_output_get(busy.port, busy.pin) > 0;
+}
+
+static void coproc_push(uint32_t seq)
+{
+	struct bench_hdr *hdr = (struct bench_hdr *)msg;
+
+	if (busy_get()) {
+		stats_inc(&stats.busy_waits);
+		do {
+			k_sleep(K_USEC(CONFIG_SPI_BRIDGE_EMUL_BUSY_POLL_US));
+		} while (busy_get() && !atomic_get(&stopping));
+	}
+
+	for (uint16_t i = sizeof(*hdr); i < coproc_len; i++) {
+		msg[i] = (uint8_t)(seq + i);
+	}
+	hdr->seq = sys_cpu_to_le32(seq);
+	hdr->timestamp = sys_cpu_to_le32(k_cycle_get_32());
+
+	spi_frame_tx_start(&frame_tx, SPI_FRAME_TYPE_DATA, (uint8_t)seq, msg, coproc_len);
+	spi_frame_tx_fill(&frame_tx, mosi);
+
+	stats_inc(&stats.frames);
+
+	if (spi_slave_emul_clock(link_dev, mosi, miso, sizeof(mosi),
+				 CONFIG_SPI_BRIDGE_EMUL_FREQ)) {
+		stats_inc(&stats.lost);
+	}
+}
+
+static void coproc_run(void)
+{
+	struct coproc_emul_stats end;
+	struct k_timer period;
+	uint32_t seq = 0;
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	memset(&stats, 0, sizeof(stats));
+	k_spin_unlock(&stats_lock, key);
+
+	printk("Co-processor: pushing %u byte frames at %u Hz\n", coproc_len, coproc_rate_hz);
+
+	k_timer_init(&period, NULL, NULL);
+	if (coproc_rate_hz) {
+		k_timer_start(&period, K_NO_WAIT, K_USEC(USEC_PER_SEC / coproc_rate_hz));
+	}
+
+	while (!atomic_get(&stopping)) {
+		if (coproc_count && seq >= coproc_count) {
+			break;
+		}
+
+		/* Periods missed while busy was raised are not made up */
+		if (coproc_rate_hz) {
+			k_timer_status_sync(&period);
+		}
+
+		coproc_push(seq++);
+	}
+
+	k_timer_stop(&period);
+
+	coproc_emul_stats_get(&end);
+	printk("Co-processor: %u frames, %u lost, %u busy waits\n", end.frames, end.lost,
+	       end.busy_waits);
+
+	atomic_set(&running, false);
+}
+
+static void coproc_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (;;) {
+		k_sem_take(&coproc_start_sem, K_FOREVER);
+
+		coproc_run();
+	}
+}
+
+K_THREAD_DEFINE(coproc_tid, CONFIG_SPI_BRIDGE_EMUL_STACK_SIZE, coproc_thread,
+		NULL, NULL, NULL, CONFIG_SPI_BRIDGE_EMUL_THREAD_PRIORITY, 0, 0);
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef COPROC_EMUL_H_
+#define COPROC_EMUL_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <device.h>
+
+/** @brief Emulated co-processor counters, since the last start. */
+struct coproc_emul_stats
+{
+	/** Frames generated, including lost ones. */
+	uint32_t frames;
+	/** Frames clocked while the bridge was not armed. */
+	uint32_t lost;
+	/** Times the co-processor found busy raised before a frame. */
+	uint32_t busy_waits;
+};
+
+/** @brief Master side of the emulated SPI link to @p dev. */
+int coproc_emul_init(const struct device *dev);
+
+/** @brief Push @p count frames (0 until stopped) of @p len bytes at
+ *  @p rate_hz (0 as fast as busy allows).
+ *
+ *  Every frame starts with a struct bench_hdr, the timestamp taken just
+ *  before the frame is clocked out.
+ *
+ *  @return 0 on success, -EINVAL if @p len does not hold the header,
+ *          -EBUSY if already running.
+ */
+int coproc_emul_start(uint16_t len, uint16_t rate_hz, uint32_t count);
+
+/** @brief Stop after the frame being pushed. */
+void coproc_emul_stop(void);
+
+/** @brief True from coproc_emul_start() until the last frame is pushed,
+ *  also after coproc_emul_stop().
+ */
+bool coproc_emul_running(void);
+
+void coproc_emul_stats_get(struct coproc_emul_stats *stats);
+
+#endif /* COPROC_EMUL_H_ */
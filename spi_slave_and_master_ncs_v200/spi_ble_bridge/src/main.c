@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	SPI slave to BLE bridge.
+
+	Data the co-processor pushes over SPI goes out as notifications of
+	the TX characteristic of the custom service, see bridge.c. With the
+	emulated SPI link of boards/nrf52_bsim.overlay the co-processor runs
+	in this image, and bench_central of ble_peripheral_cus_service
+	measures the throughput and latency end to end.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+#include "my_service.h"
+#include "spis_queue.h"
+#include "bridge.h"
+#include "bridge_service.h"
+#if defined(CONFIG_SPI_BRIDGE_EMUL)
+#include "coproc_emul.h"
+#endif
+
+#define DEVICE_NAME     CONFIG_BT_DEVICE_NAME
+#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
+
+static const struct device *spi_dev = DEVICE_DT_GET(DT_NODELABEL(bridge_spi));
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+};
+
+static const struct bt_data sd[] = {
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, MY_SERVICE_UUID),
+};
+
+static void adv_work_handler(struct k_work *work);
+
+/* The connection is only released after disconnected() returns, so
+ * advertising is restarted a little later, and retried until it starts.
+ */
+static K_WORK_DELAYABLE_DEFINE(adv_work, adv_work_handler);
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		printk("Connection failed (err %u)\n", err);
+		k_work_schedule(&adv_work, K_MSEC(100));
+		return;
+	}
+
+	printk("Connected\n");
+	bridge_conn_set(conn);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	printk("Disconnected (reason %u)\n", reason);
+
+	bridge_conn_set(NULL);
+	k_work_schedule(&adv_work, K_MSEC(100));
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+static void adv_work_handler(struct k_work *work)
+{
+	int err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+
+	if (err == -ENOMEM) {
+		k_work_schedule(&adv_work, K_MSEC(100));
+	} else if (err) {
+		printk("Advertising failed to start (err %d)\n", err);
+	} else {
+		printk("Advertising successfully started\n");
+	}
+}
+
+static void bridge_report(void)
+{
+	struct bridge_stats stats;
+	struct spis_queue_stats queue;
+
+	bridge_stats_get(&stats);
+	spis_queue_stats_get(&queue);
+
+	printk("BRIDGE: frames=%u bytes=%u notified=%u sent=%u oversize=%u enomem=%u "
+	       "crc_errors=%u dropped=%u busy_events=%u busy_ms=%u wait_max_us=%u "
+	       "pool_free_min=%u\n",
+	       stats.frames, stats.bytes, stats.notified, stats.sent, stats.oversize,
+	       stats.enomem, stats.crc_errors, stats.dropped, stats.busy_events, stats.busy_ms,
+	       stats.wait_max_us, stats.pool_free_min);
+	printk("BRIDGE SPIS: transactions=%u overruns=%u errors=%u queued_max=%u\n",
+	       queue.transactions, queue.overruns, queue.errors, queue.queued_max);
+
+#if defined(CONFIG_SPI_BRIDGE_EMUL)
+	struct coproc_emul_stats coproc;
+
+	coproc_emul_stats_get(&coproc);
+	printk("BRIDGE COPROC: frames=%u lost=%u busy_waits=%u\n", coproc.frames, coproc.lost,
+	       coproc.busy_waits);
+#endif
+}
+
+void main(void)
+{
+	int err;
+
+	printk("Starting SPI to BLE bridge\n");
+
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	err = bridge_start(spi_dev, bridge_service_tx_attr());
+	if (err) {
+		printk("Bridge failed to start (err %d)\n", err);
+		return;
+	}
+
+#if defined(CONFIG_SPI_BRIDGE_EMUL)
+	err = coproc_emul_init(spi_dev);
+	if (err) {
+		printk("Co-processor emulation failed (err %d)\n", err);
+		return;
+	}
+#endif
+
+	k_work_schedule(&adv_work, K_NO_WAIT);
+
+	for (;;) {
+		k_sleep(K_SECONDS(CONFIG_SPI_BRIDGE_REPORT_SEC));
+		bridge_report();
+	}
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Emulated SPI slave for BabbleSim.
+
+	nrf52_bsim has no SPIS, so the slave side of the link is this driver
+	and the master side is spi_slave_emul_clock(), called by the emulated
+	co-processor. As on the SPIS, one transaction is armed at a time, the
+	master's bytes only land while it is armed, and a slave transfer
+	completes with the number of bytes received.
+*/
+
+#define DT_DRV_COMPAT vnd_spi_slave_emul
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <device.h>
+#include <drivers/spi.h>
+
+#include "spi_slave_emul.h"
+
+struct spi_slave_emul_data {
+	struct k_spinlock lock;
+	struct k_sem sync;
+	const struct spi_buf_set *tx_bufs;
+	const struct spi_buf_set *rx_bufs;
+	struct k_poll_signal *signal;
+	bool armed;
+	int result;
+};
+
+/* Copy up to @p len bytes from @p src into @p set, NULL buffers skip */
+static size_t buf_set_write(const struct spi_buf_set *set, const uint8_t *src, size_t len)
+{
+	size_t done = 0;
+
+	for (size_t i = 0; set && i < set->count && done < len; i++) {
+		size_t n = MIN(set->buffers[i].len, len - done);
+
+		if (set->buffers[i].buf) {
+			memcpy(set->buffers[i].buf, src + done, n);
+		}
+		done += n;
+	}
+
+	return done;
+}
+
+/* Copy up to @p len bytes from @p set into @p dst, zeros past its end */
+static void buf_set_read(const struct spi_buf_set *set, uint8_t *dst, size_t len)
+{
+	size_t done = 0;
+
+	for (size_t i = 0; set && i < set->count && done < len; i++) {
+		size_t n = MIN(set->buffers[i].len, len - done);
+
+		if (set->buffers[i].buf) {
+			memcpy(dst + done, set->buffers[i].buf, n);
+		} else {
+			memset(dst + done, 0, n);
+		}
+		done += n;
+	}
+
+	memset(dst + done, 0, len - done);
+}
+
+static int slave_emul_arm(const struct device *dev, const struct spi_config *config,
+			  const struct spi_buf_set *tx_bufs,
+			  const struct spi_buf_set *rx_bufs,
+			  struct k_poll_signal *signal)
+{
+	struct spi_slave_emul_data *data = dev->data;
+	k_spinlock_key_t key;
+
+	if (!(config->operation & SPI_OP_MODE_SLAVE)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&data->lock);
+
+	if (data->armed) {
+		k_spin_unlock(&data->lock, key);
+		return -EBUSY;
+	}
+
+	data->tx_bufs = tx_bufs;
+	data->rx_bufs = rx_bufs;
+	data->signal = signal;
+	data->armed = true;
+
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+static int slave_emul_transceive(const struct device *dev, const struct spi_config *config,
+				 const struct spi_buf_set *tx_bufs,
+				 const struct spi_buf_set *rx_bufs)
+{
+	struct spi_slave_emul_data *data = dev->data;
+	int err = slave_emul_arm(dev, config, tx_bufs, rx_bufs, NULL);
+
+	if (err) {
+		return err;
+	}
+
+	k_sem_take(&data->sync, K_FOREVER);
+
+	return data->result;
+}
+
+#if defined(CONFIG_SPI_ASYNC)
+static int slave_emul_transceive_async(const struct device *dev,
+				       const struct spi_config *config,
+				       const struct spi_buf_set *tx_bufs,
+				       const struct spi_buf_set *rx_bufs,
+				       struct k_poll_signal *async)
+{
+	return slave_emul_arm(dev, config, tx_bufs, rx_bufs, async);
+}
+#endif
+
+static int slave_emul_release(const struct device *dev, const struct spi_config *config)
+{
+	return 0;
+}
+
+int spi_slave_emul_clock(const struct device *dev, const uint8_t *mosi, uint8_t *miso,
+			 size_t len, uint32_t frequency)
+{
+	struct spi_slave_emul_data *data = dev->data;
+	struct k_poll_signal *signal;
+	k_spinlock_key_t key;
+	uint64_t wire_us = DIV_ROUND_UP((uint64_t)len * 8 * USEC_PER_SEC, MAX(frequency, 1));
+	int result;
+
+	key = k_spin_lock(&data->lock);
+
+	if (!data->armed) {
+		k_spin_unlock(&data->lock, key);
+		memset(miso, 0, len);
+		k_sleep(K_USEC(MAX(wire_us, 1)));
+		return -EAGAIN;
+	}
+
+	/* The transaction is under way, the CPU can't re-arm until it ends */
+	data->armed = false;
+	result = buf_set_write(data->rx_bufs, mosi, len);
+	buf_set_read(data->tx_bufs, miso, len);
+	signal = data->signal;
+
+	k_spin_unlock(&data->lock, key);
+
+	k_sleep(K_USEC(MAX(wire_us, 1)));
+
+	if (signal) {
+		k_poll_signal_raise(signal, result);
+	} else {
+		data->result = result;
+		k_sem_give(&data->sync);
+	}
+
+	return 0;
+}
+
+static const struct spi_driver_api slave_emul_api = {
+	.transceive = slave_emul_transceive,
+#if defined(CONFIG_SPI_ASYNC)
+	.transceive_async = slave_emul_transceive_async,
+#endif
+	.release = slave_emul_release,
+};
+
+static int slave_emul_init(const struct device *dev)
+{
+	struct spi_slave_emul_data *data = dev->data;
+
+	k_sem_init(&data->sync, 0, 1);
+
+	return 0;
+}
+
+#define SPI_SLAVE_EMUL_DEFINE(n)						\
+	static struct spi_slave_emul_data slave_emul_data_##n;			\
+	DEVICE_DT_INST_DEFINE(n, slave_emul_init, NULL, &slave_emul_data_##n,	\
+			      NULL, POST_KERNEL, CONFIG_SPI_INIT_PRIORITY,	\
+			      &slave_emul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(SPI_SLAVE_EMUL_DEFINE)
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SPI_SLAVE_EMUL_H_
+#define SPI_SLAVE_EMUL_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <device.h>
+
+/** @brief Clock one transaction from the master side of @p dev.
+ *
+ *  @p mosi goes to the armed RX buffers and the armed TX buffers come
+ *  back in @p miso, then the caller sleeps for the time @p len bytes take
+ *  at @p frequency and the slave's transfer completes. Like the SPIS, a
+ *  slave that is not armed answers with zeros and receives nothing.
+ *
+ *  @return 0 on success, -EAGAIN if the slave was not armed.
+ */
+int spi_slave_emul_clock(const struct device *dev, const uint8_t *mosi, uint8_t *miso,
+			 size_t len, uint32_t frequency);
+
+#endif /* SPI_SLAVE_EMUL_H_ */
@@ -7,6 +7,13 @@
 #include <zephyr.h>
 #include <sys/printk.h>
 #include <drivers/spi.h>
+#include <drivers/gpio.h>
+#include <sys/byteorder.h>
+
+#include "spi_stream.h"
+#include "spi_frame.h"
+#include "spi_autotune.h"
+#include "spi_bus.h"
 
 #define DT_DRV_COMPAT nordic_nrf_spim
 
@@ -86,12 +93,343 @@ void spi_test_send(void)
 	}
 }
 
+#if defined(CONFIG_SPI_STREAM)
+#if defined(CONFIG_SPI_FRAME)
+#define STREAM_XFER_LEN SPI_FRAME_XFER_LEN
+
+BUILD_ASSERT(SPI_FRAME_XFER_LEN <= CONFIG_SPI_STREAM_XFER_MAX,
+	     "A frame does not fit CONFIG_SPI_STREAM_XFER_MAX");
+
+/* The test message is sent over and over, with its sequence number in byte 0 */
+static uint8_t test_msg[CONFIG_SPI_FRAME_TEST_MSG_LEN];
+static uint8_t rx_msg[CONFIG_SPI_FRAME_TEST_MSG_LEN];
+static struct spi_frame_tx frame_tx;
+static struct spi_frame_rx frame_rx;
+static uint8_t frame_seq;
+
+#if defined(CONFIG_SPI_DATA_READY)
+/* Optional, raised by the slave while it has frames to send */
+static const struct gpio_dt_spec data_ready =
+	GPIO_DT_SPEC_GET_OR(DT_PATH(zephyr_user), data_ready_gpios, {0});
+static struct gpio_callback data_ready_cb;
+static atomic_t msg_pending;
+
+static void data_ready_isr(const struct device *dev, struct gpio_callback *cb,
+			   uint32_t pins)
+{
+	spi_stream_kick();
+}
+
+/* Without the line the stream runs continuously, as without this option */
+static void data_ready_init(void)
+{
+	int err;
+
+	if (!data_ready.port) {
+		printk("No data-ready-gpios, streaming continuously\n");
+		return;
+	}
+
+	err = gpio_pin_configure_dt(&data_ready, GPIO_INPUT);
+	if (!err) {
+		err = gpio_pin_interrupt_configure_dt(&data_ready, GPIO_INT_EDGE_TO_ACTIVE);
+	}
+	if (err) {
+		printk("Error %d: failed to configure data ready pin %d\n", err,
+		       data_ready.pin);
+		return;
+	}
+
+	gpio_init_callback(&data_ready_cb, data_ready_isr, BIT(data_ready.pin));
+	gpio_add_callback(data_ready.port, &data_ready_cb);
+	printk("Data ready on %s pin %d\n", data_ready.port->name, data_ready.pin);
+}
+
+/* Transfers only while the slave has data or our message is not out yet */
+static bool stream_pending(void *user_data)
+{
+	return !data_ready.port || gpio_pin_get_dt(&data_ready) > 0 ||
+	       atomic_get(&msg_pending) || spi_frame_tx_busy(&frame_tx);
+}
+#endif
+
+/* Back to back without a data ready line, otherwise once per report */
+static bool test_msg_due(void)
+{
+#if defined(CONFIG_SPI_DATA_READY)
+	if (data_ready.port) {
+		return atomic_cas(&msg_pending, true, false);
+	}
+#endif
+	return true;
+}
+#else
+#define STREAM_XFER_LEN CONFIG_SPI_STREAM_XFER_LEN
+
+static uint8_t stream_counter;
+#endif
+
+/* The next fragment of the test message, or byte 0 counting transfers like
+ * the polled transfer did.
+ */
+static void stream_fill(uint8_t *tx, size_t len, void *user_data)
+{
+#if defined(CONFIG_SPI_FRAME)
+	if (!spi_frame_tx_busy(&frame_tx) && test_msg_due()) {
+		test_msg[0] = frame_seq;
+		spi_frame_tx_start(&frame_tx, SPI_FRAME_TYPE_DATA, frame_seq++,
+				   test_msg, sizeof(test_msg));
+	}
+
+	spi_frame_tx_fill(&frame_tx, tx);
+#else
+	tx[0] = stream_counter++;
+#endif
+}
+
+static void stream_done(const uint8_t *rx, size_t len, int err, void *user_data)
+{
+	if (err) {
+		printk("SPI error: %d\n", err);
+		return;
+	}
+
+#if defined(CONFIG_SPI_FRAME)
+	/* The CRC is checked per fragment, complete messages are only counted */
+	spi_frame_rx_put(&frame_rx, rx);
+#endif
+}
+
+static const struct spi_stream_cb stream_cb = {
+	.fill = stream_fill,
+	.done = stream_done,
+#if defined(CONFIG_SPI_DATA_READY)
+	.pending = stream_pending,
+#endif
+};
+
+static void stream_report(void)
+{
+	static uint64_t last_bytes;
+	static uint32_t last_ms;
+	struct spi_stream_stats stats;
+	uint32_t ms;
+
+	spi_stream_stats_get(&stats);
+
+	ms = stats.elapsed_ms - last_ms;
+	printk("SPI stream: %u transfers, %u errors, %u bytes/s\n",
+	       stats.transfers, stats.errors,
+	       ms ? (uint32_t)((stats.bytes - last_bytes) * MSEC_PER_SEC / ms) : 0);
+
+	last_bytes = stats.bytes;
+	last_ms = stats.elapsed_ms;
+
+#if defined(CONFIG_SPI_FRAME)
+	printk("SPI frames: %u messages, %u fragments, %u CRC errors, %u sequence errors\n",
+	       frame_rx.messages, frame_rx.frames, frame_rx.crc_errors, frame_rx.seq_errors);
+#endif
+}
+#endif
+
+#if defined(CONFIG_SPI_BUS)
+/* Two clients on one bus: a sensor polled every millisecond that has to be
+ * read within a millisecond, and bulk reads that are split into chunks so
+ * the sensor never waits long. Each client has its own spi_config and chip
+ * select, the first and second entry of cs-gpios. The sensor stands in for
+ * the slave on the first chip select.
+ */
+#define ADC_LEN    16
+#define BULK_LEN   4096
+
+#define FLASH_READ 0x03
+
+/* Each chunk is a read of its own, the flash drops the command when the
+ * chip select is released.
+ */
+static size_t flash_read_cmd(const struct spi_bus_xfer *xfer, size_t offset, uint8_t *cmd)
+{
+	uint32_t addr = POINTER_TO_UINT(xfer->user_data) + offset;
+
+	cmd[0] = FLASH_READ;
+	sys_put_be24(addr, &cmd[1]);
+
+	return 4;
+}
+
+static struct spi_cs_control adc_cs = {
+	.gpio_pin = DT_GPIO_PIN_BY_IDX(DT_DRV_INST(0), cs_gpios, 0),
+	.gpio_dt_flags = GPIO_ACTIVE_LOW,
+	.delay = 0,
+};
+
+static struct spi_cs_control flash_cs = {
+	.gpio_pin = DT_GPIO_PIN_BY_IDX(DT_DRV_INST(0), cs_gpios, 1),
+	.gpio_dt_flags = GPIO_ACTIVE_LOW,
+	.delay = 0,
+};
+
+static struct spi_config adc_cfg = {
+	.operation = SPI_WORD_SET(8) | SPI_TRANSFER_MSB |
+		     SPI_MODE_CPOL | SPI_MODE_CPHA,
+	.frequency = 4000000,
+	.slave = 0,
+	.cs = &adc_cs,
+};
+
+/* Flash reads are mode 0 */
+static struct spi_config flash_cfg = {
+	.operation = SPI_WORD_SET(8) | SPI_TRANSFER_MSB,
+	.frequency = 8000000,
+	.slave = 1,
+	.cs = &flash_cs,
+};
+
+static struct spi_bus_client adc_client = {
+	.name = "adc",
+	.cfg = &adc_cfg,
+	.priority = 0,
+};
+
+static struct spi_bus_client bulk_client = {
+	.name = "flash",
+	.cfg = &flash_cfg,
+	.priority = 1,
+};
+
+static K_SEM_DEFINE(bulk_sem, 0, 1);
+
+static void adc_thread(void *p1, void *p2, void *p3)
+{
+	static uint8_t adc_rx[ADC_LEN];
+
+	for (;;) {
+		k_sleep(K_MSEC(1));
+		spi_bus_transceive(&adc_client, NULL, adc_rx, sizeof(adc_rx),
+				   k_uptime_get() + 1, false);
+	}
+}
+
+static void bulk_done(struct spi_bus_xfer *xfer, int result)
+{
+	k_sem_give(&bulk_sem);
+}
+
+static void bulk_thread(void *p1, void *p2, void *p3)
+{
+	static uint8_t bulk_rx[BULK_LEN];
+	struct spi_bus_xfer xfer = {
+		.client = &bulk_client,
+		.rx = bulk_rx,
+		.len = sizeof(bulk_rx),
+		.preemptible = true,
+		.cmd = flash_read_cmd,
+		.done = bulk_done,
+		.user_data = UINT_TO_POINTER(0),
+	};
+
+	for (;;) {
+		if (!spi_bus_submit(&xfer)) {
+			k_sem_take(&bulk_sem, K_FOREVER);
+		}
+	}
+}
+
+K_THREAD_DEFINE(adc_tid, 512, adc_thread, NULL, NULL, NULL, 6, 0, K_TICKS_FOREVER);
+K_THREAD_DEFINE(bulk_tid, 512, bulk_thread, NULL, NULL, NULL, 7, 0, K_TICKS_FOREVER);
+
+static void bus_report(const struct spi_bus_client *client)
+{
+	struct spi_bus_stats stats;
+
+	spi_bus_stats_get(client, &stats);
+
+	printk("SPI bus %s: %u xfers, %u bytes, %u.%u %% busy, %u us max wait, "
+	       "%u deadline misses, %u preemptions\n",
+	       client->name, stats.xfers, stats.bytes, stats.utilisation_permille / 10,
+	       stats.utilisation_permille % 10, stats.wait_max_us, stats.deadline_misses,
+	       stats.preemptions);
+}
+
+static void bus_demo(void)
+{
+	int err;
+
+	adc_cs.gpio_dev = device_get_binding(DT_GPIO_LABEL_BY_IDX(DT_DRV_INST(0), cs_gpios, 0));
+	flash_cs.gpio_dev = device_get_binding(DT_GPIO_LABEL_BY_IDX(DT_DRV_INST(0), cs_gpios, 1));
+	if (adc_cs.gpio_dev == NULL || flash_cs.gpio_dev == NULL) {
+		printk("Could not get the chip select gpio devices\n");
+		return;
+	}
+
+	/* Calibrated against the slave on the first chip select */
+	adc_cfg.frequency = spi_cfg.frequency;
+
+	err = spi_bus_init(spi_dev);
+	if (err) {
+		printk("SPI bus failed to start (err %d)\n", err);
+		return;
+	}
+
+	spi_bus_client_add(&adc_client);
+	spi_bus_client_add(&bulk_client);
+	k_thread_start(adc_tid);
+	k_thread_start(bulk_tid);
+
+	while (1) {
+		k_sleep(K_SECONDS(1));
+		bus_report(&adc_client);
+		bus_report(&bulk_client);
+	}
+}
+#endif
+
 void main(void)
 {
 	printk("SPIM Example\n");	
 	spi_init();	
+
+#if defined(CONFIG_SPI_AUTOTUNE)
+	/* Before the stream, the calibration runs blocking transfers */
+	if (spi_dev) {
+		spi_autotune(spi_dev, &spi_cfg, DT_PROP(DT_DRV_INST(0), max_frequency));
+	}
+#endif
+
+#if defined(CONFIG_SPI_STREAM)
+#if defined(CONFIG_SPI_FRAME)
+	for (int i = 0; i < sizeof(test_msg); i++) {
+		test_msg[i] = i;
+	}
+	spi_frame_rx_init(&frame_rx, rx_msg, sizeof(rx_msg));
+#endif
+#if defined(CONFIG_SPI_DATA_READY)
+	data_ready_init();
+#endif
+
+	int err = spi_stream_start(spi_dev, &spi_cfg, STREAM_XFER_LEN, &stream_cb);
+
+	if (err) {
+		printk("SPI stream failed to start (err %d)\n", err);
+		return;
+	}
+
+	while (1) {
+		k_sleep(K_SECONDS(CONFIG_SPI_STREAM_REPORT_SEC));
+		stream_report();
+#if defined(CONFIG_SPI_DATA_READY)
+		atomic_set(&msg_pending, true);
+		spi_stream_kick();
+#endif
+	}
+#elif defined(CONFIG_SPI_BUS)
+	if (spi_dev) {
+		bus_demo();
+	}
+#else
 	while (1) {
 		spi_test_send();
 		k_sleep(K_MSEC(1000));
 	}
+#endif
 }
\ No newline at end of file
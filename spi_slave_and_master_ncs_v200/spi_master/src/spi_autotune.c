@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	SPI clock autotuning.
+
+	Each candidate clock is tried with CONFIG_SPI_AUTOTUNE_XFERS pattern
+	frames (spi_cal.h). It passes if every transaction from the slave is
+	intact, at least half of them are pattern frames, and the slave's
+	count of corrupt frames from the master did not grow. The slave
+	prepares its transactions ahead, so its answers start a few
+	transactions late and the first ones are plain frames. Transactions
+	the slave was not armed for are all its def-char and count as empty,
+	anything else that fails the check counts as corrupt.
+
+	Only clocks up to the max-frequency of the SPIM instance in use are
+	tried, the driver would silently run faster ones at that maximum.
+
+	Calibration steps up from the slowest clock and stops at the first
+	failure. The result goes to settings and is tried again on the next
+	boot, before it is used.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <drivers/spi.h>
+#if defined(CONFIG_SETTINGS)
+#include <settings/settings.h>
+#endif
+
+#include "spi_autotune.h"
+#include "spi_cal.h"
+
+/* The SPIM clock dividers, 16 and 32 MHz only on SPIM3 and SPIM4 */
+static const uint32_t frequencies[] = { 1000000, 2000000, 4000000, 8000000,
+					16000000, 32000000 };
+
+/* The driver only reconfigures when given another spi_config */
+static struct spi_config configs[ARRAY_SIZE(frequencies)];
+
+static uint8_t tx_buffer[SPI_FRAME_XFER_LEN];
+static uint8_t rx_buffer[SPI_FRAME_XFER_LEN];
+
+static uint32_t saved_frequency;
+
+#if defined(CONFIG_SETTINGS)
+static int autotune_settings_set(const char *name, size_t len,
+				 settings_read_cb read_cb, void *cb_arg)
+{
+	if (strcmp(name, "freq") || len != sizeof(saved_frequency)) {
+		return -ENOENT;
+	}
+
+	if (read_cb(cb_arg, &saved_frequency, sizeof(saved_frequency)) != sizeof(saved_frequency)) {
+		saved_frequency = 0;
+	}
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(spi_autotune, "spi_autotune", NULL, autotune_settings_set,
+			       NULL, NULL);
+#endif
+
+static void autotune_save(uint32_t frequency)
+{
+#if defined(CONFIG_SETTINGS)
+	int err = settings_save_one("spi_autotune/freq", &frequency, sizeof(frequency));
+
+	if (err) {
+		printk("SPI autotune: failed to save (err %d)\n", err);
+	}
+#endif
+	saved_frequency = frequency;
+}
+
+static bool autotune_try(const struct device *dev, const struct spi_config *cfg)
+{
+	const struct spi_buf tx_buf = { .buf = tx_buffer, .len = sizeof(tx_buffer) };
+	const struct spi_buf rx_buf = { .buf = rx_buffer, .len = sizeof(rx_buffer) };
+	const struct spi_buf_set tx = { .buffers = &tx_buf, .count = 1 };
+	const struct spi_buf_set rx = { .buffers = &rx_buf, .count = 1 };
+	uint32_t patterns = 0;
+	uint32_t corrupt = 0;
+	uint32_t empty = 0;
+	uint32_t slave_first = 0;
+	uint32_t slave_last = 0;
+
+	for (int i = 0; i < CONFIG_SPI_AUTOTUNE_XFERS; i++) {
+		uint32_t slave_errors;
+		int ret;
+
+		spi_cal_fill(tx_buffer, i, 0);
+
+		if (spi_transceive(dev, cfg, &tx, &rx)) {
+			return false;
+		}
+
+		ret = spi_cal_check(rx_buffer, &slave_errors);
+		if (ret == -ENODATA) {
+			empty++;
+		} else if (ret < 0) {
+			corrupt++;
+		} else if (ret > 0) {
+			if (!patterns) {
+				slave_first = slave_errors;
+			}
+			slave_last = slave_errors;
+			patterns++;
+		}
+	}
+
+	printk("SPI autotune: %u Hz, %u corrupt, %u empty, %u patterns, %u corrupt at the slave\n",
+	       cfg->frequency, corrupt, empty, patterns, slave_last - slave_first);
+
+	return !corrupt && patterns >= CONFIG_SPI_AUTOTUNE_XFERS / 2 &&
+	       slave_last == slave_first;
+}
+
+static struct spi_config *autotune_config(const struct spi_config *cfg, int i)
+{
+	configs[i] = *cfg;
+	configs[i].frequency = frequencies[i];
+
+	return &configs[i];
+}
+
+int spi_autotune_calibrate(const struct device *dev, struct spi_config *cfg,
+			   uint32_t max_frequency)
+{
+	uint32_t freq_max = MIN(CONFIG_SPI_AUTOTUNE_FREQ_MAX, max_frequency);
+	int best = -1;
+
+	for (int i = 0; i < ARRAY_SIZE(frequencies); i++) {
+		if (frequencies[i] > freq_max ||
+		    !autotune_try(dev, autotune_config(cfg, i))) {
+			break;
+		}
+		best = i;
+	}
+
+	if (best < 0) {
+		printk("SPI autotune: no clock passed, keeping %u Hz\n", cfg->frequency);
+		return -EIO;
+	}
+
+	cfg->frequency = frequencies[MAX(best - CONFIG_SPI_AUTOTUNE_MARGIN_STEPS, 0)];
+	autotune_save(cfg->frequency);
+
+	printk("SPI autotune: %u Hz passed, using %u Hz\n", frequencies[best], cfg->frequency);
+
+	return 0;
+}
+
+int spi_autotune(const struct device *dev, struct spi_config *cfg, uint32_t max_frequency)
+{
+	uint32_t freq_max = MIN(CONFIG_SPI_AUTOTUNE_FREQ_MAX, max_frequency);
+
+#if defined(CONFIG_SETTINGS)
+	int err = settings_subsys_init();
+
+	if (!err) {
+		err = settings_load_subtree("spi_autotune");
+	}
+	if (err) {
+		printk("SPI autotune: settings not loaded (err %d)\n", err);
+	}
+#endif
+
+	for (int i = 0; i < ARRAY_SIZE(frequencies); i++) {
+		if (frequencies[i] != saved_frequency || frequencies[i] > freq_max) {
+			continue;
+		}
+
+		/* The board or the slave may have changed since */
+		if (autotune_try(dev, autotune_config(cfg, i))) {
+			cfg->frequency = saved_frequency;
+			printk("SPI autotune: using saved %u Hz\n", cfg->frequency);
+			return 0;
+		}
+
+		printk("SPI autotune: saved %u Hz failed, calibrating\n", saved_frequency);
+		break;
+	}
+
+	return spi_autotune_calibrate(dev, cfg, max_frequency);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SPI_AUTOTUNE_H_
+#define SPI_AUTOTUNE_H_
+
+#include <device.h>
+#include <drivers/spi.h>
+
+/** @brief Set the clock of @p cfg to the saved calibration result, once it
+ *  passed a test run against the slave, or calibrate a new one.
+ *
+ *  Runs blocking transfers on @p dev, so it has to be called before the
+ *  stream starts. @p max_frequency is the max-frequency of the SPIM
+ *  instance behind @p dev, no faster clock is tried.
+ *
+ *  @return 0 on success, -EIO if no clock passed, @p cfg is then left at
+ *          its frequency.
+ */
+int spi_autotune(const struct device *dev, struct spi_config *cfg, uint32_t max_frequency);
+
+/** @brief Step the clock up until the slave's patterns fail, then set and
+ *  save the highest passing clock minus CONFIG_SPI_AUTOTUNE_MARGIN_STEPS.
+ *
+ *  @return 0 on success, -EIO if no clock passed.
+ */
+int spi_autotune_calibrate(const struct device *dev, struct spi_config *cfg,
+			   uint32_t max_frequency);
+
+#endif /* SPI_AUTOTUNE_H_ */
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	SPI bus scheduler.
+
+	Several clients, each with its own chip select, share one controller.
+	Their transactions wait in one list, and the bus thread picks the next
+	one to clock by
+
+	  1. priority,
+	  2. the client of the previous transaction, up to
+	     CONFIG_SPI_BUS_BATCH_MAX in a row, so one device's transactions
+	     go back to back without switching the chip select and config,
+	  3. the earliest deadline,
+	  4. submission order.
+
+	A preemptible transaction is clocked in chunks of CONFIG_SPI_BUS_CHUNK
+	bytes and the pick is made again after each chunk, so a high-rate ADC
+	waits at most one chunk behind a long flash read. Other transactions
+	are clocked in one go. The chip select is released between chunks,
+	so transactions with a cmd callback get the device's command for the
+	chunk's offset clocked ahead of each of them.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <drivers/spi.h>
+
+#include "spi_bus.h"
+
+static const struct device *bus_dev;
+
+static sys_slist_t pending;
+static struct k_spinlock lock;
+static K_SEM_DEFINE(bus_sem, 0, 1);
+static K_SEM_DEFINE(bus_start_sem, 0, 1);
+
+/* Touched by the bus thread only */
+static struct spi_bus_client *last_client;
+static struct spi_bus_xfer *last_xfer;
+static uint32_t batch;
+
+int spi_bus_init(const struct device *dev)
+{
+	if (!device_is_ready(dev)) {
+		return -ENODEV;
+	}
+
+	bus_dev = dev;
+	k_sem_give(&bus_start_sem);
+
+	return 0;
+}
+
+void spi_bus_client_add(struct spi_bus_client *client)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(&client->stats, 0, sizeof(client->stats));
+	client->added_ticks = k_uptime_ticks();
+
+	k_spin_unlock(&lock, key);
+}
+
+int spi_bus_submit(struct spi_bus_xfer *xfer)
+{
+	if (!xfer->client || !xfer->len) {
+		return -EINVAL;
+	}
+
+	xfer->offset = 0;
+	xfer->started = false;
+	xfer->submit_cyc = k_cycle_get_32();
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	sys_slist_append(&pending, &xfer->node);
+
+	k_spin_unlock(&lock, key);
+
+	k_sem_give(&bus_sem);
+
+	return 0;
+}
+
+struct transceive_ctx {
+	struct k_sem sem;
+	int result;
+};
+
+static void transceive_done(struct spi_bus_xfer *xfer, int result)
+{
+	struct transceive_ctx *ctx = xfer->user_data;
+
+	ctx->result = result;
+	k_sem_give(&ctx->sem);
+}
+
+int spi_bus_transceive(struct spi_bus_client *client, const uint8_t *tx, uint8_t *rx,
+		       size_t len, int64_t deadline_ms, bool preemptible)
+{
+	struct transceive_ctx ctx;
+	struct spi_bus_xfer xfer = {
+		.client = client,
+		.tx = tx,
+		.rx = rx,
+		.len = len,
+		.deadline_ms = deadline_ms,
+		.preemptible = preemptible,
+		.done = transceive_done,
+		.user_data = &ctx,
+	};
+	int err;
+
+	k_sem_init(&ctx.sem, 0, 1);
+
+	err = spi_bus_submit(&xfer);
+	if (err) {
+		return err;
+	}
+
+	k_sem_take(&ctx.sem, K_FOREVER);
+
+	return ctx.result;
+}
+
+void spi_bus_stats_get(const struct spi_bus_client *client, struct spi_bus_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	uint64_t elapsed_us = k_ticks_to_us_floor64(k_uptime_ticks() - client->added_ticks);
+
+	*out = client->stats;
+	out->utilisation_permille = elapsed_us ? (uint32_t)(out->busy_us * 1000 / elapsed_us) : 0;
+
+	k_spin_unlock(&lock, key);
+}
+
+/* Whether @p a should go before @p b */
+static bool xfer_before(const struct spi_bus_xfer *a, const struct spi_bus_xfer *b)
+{
+	bool a_batch = a->client == last_client && batch < CONFIG_SPI_BUS_BATCH_MAX;
+	bool b_batch = b->client == last_client && batch < CONFIG_SPI_BUS_BATCH_MAX;
+
+	if (a->client->priority != b->client->priority) {
+		return a->client->priority < b->client->priority;
+	}
+
+	if (a_batch != b_batch) {
+		return a_batch;
+	}
+
+	if (a->deadline_ms != b->deadline_ms) {
+		/* 0 is no deadline, after any deadline */
+		return b->deadline_ms == 0 || (a->deadline_ms && a->deadline_ms < b->deadline_ms);
+	}
+
+	return false;
+}
+
+static struct spi_bus_xfer *bus_pick(void)
+{
+	struct spi_bus_xfer *best = NULL;
+	struct spi_bus_xfer *xfer;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&pending, xfer, node) {
+		if (!best || xfer_before(xfer, best)) {
+			best = xfer;
+		}
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return best;
+}
+
+static int bus_clock(struct spi_bus_xfer *xfer, size_t len)
+{
+	uint8_t cmd[CONFIG_SPI_BUS_CMD_MAX];
+	size_t cmd_len = xfer->cmd ? xfer->cmd(xfer, xfer->offset, cmd) : 0;
+	const struct spi_buf tx_bufs[] = {
+		{ .buf = cmd, .len = cmd_len },
+		{ .buf = xfer->tx ? (uint8_t *)xfer->tx + xfer->offset : NULL, .len = len },
+	};
+	const struct spi_buf rx_bufs[] = {
+		{ .buf = NULL, .len = cmd_len },
+		{ .buf = xfer->rx ? xfer->rx + xfer->offset : NULL, .len = len },
+	};
+	/* Without a command only the second buffer of each set */
+	const struct spi_buf_set tx = {
+		.buffers = cmd_len ? tx_bufs : &tx_bufs[1],
+		.count = cmd_len ? 2 : 1,
+	};
+	const struct spi_buf_set rx = {
+		.buffers = cmd_len ? rx_bufs : &rx_bufs[1],
+		.count = cmd_len ? 2 : 1,
+	};
+
+	__ASSERT(cmd_len <= sizeof(cmd), "Command longer than CONFIG_SPI_BUS_CMD_MAX");
+
+	return spi_transceive(bus_dev, xfer->client->cfg, &tx, &rx);
+}
+
+static void bus_run(struct spi_bus_xfer *xfer)
+{
+	struct spi_bus_client *client = xfer->client;
+	size_t len = xfer->len - xfer->offset;
+	uint32_t start_cyc = k_cycle_get_32();
+	struct spi_bus_xfer *preempted = NULL;
+	uint32_t busy_us;
+	bool finished;
+	int err;
+
+	if (xfer->preemptible) {
+		len = MIN(len, CONFIG_SPI_BUS_CHUNK);
+	}
+
+	/* The previous transaction was set aside halfway */
+	if (last_xfer && last_xfer != xfer) {
+		preempted = last_xfer;
+	}
+
+	batch = (client == last_client) ? batch + 1 : 1;
+	last_client = client;
+	last_xfer = xfer;
+
+	err = bus_clock(xfer, len);
+	busy_us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cyc);
+
+	xfer->offset += len;
+	finished = err || xfer->offset >= xfer->len;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (preempted) {
+		preempted->client->stats.preemptions++;
+	}
+	if (!xfer->started) {
+		client->stats.wait_max_us = MAX(client->stats.wait_max_us,
+					       k_cyc_to_us_floor32(start_cyc - xfer->submit_cyc));
+		xfer->started = true;
+	}
+	client->stats.busy_us += busy_us;
+	client->stats.bytes += len;
+
+	if (finished) {
+		sys_slist_find_and_remove(&pending, &xfer->node);
+		client->stats.xfers++;
+		if (xfer->deadline_ms && k_uptime_get() > xfer->deadline_ms) {
+			client->stats.deadline_misses++;
+		}
+		last_xfer = NULL;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	if (finished && xfer->done) {
+		xfer->done(xfer, err);
+	}
+}
+
+static void bus_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	k_sem_take(&bus_start_sem, K_FOREVER);
+
+	for (;;) {
+		struct spi_bus_xfer *xfer = bus_pick();
+
+		if (!xfer) {
+			k_sem_take(&bus_sem, K_FOREVER);
+			continue;
+		}
+
+		bus_run(xfer);
+	}
+}
+
+K_THREAD_DEFINE(spi_bus_tid, CONFIG_SPI_BUS_STACK_SIZE, bus_thread,
+		NULL, NULL, NULL, CONFIG_SPI_BUS_THREAD_PRIORITY, 0, 0);
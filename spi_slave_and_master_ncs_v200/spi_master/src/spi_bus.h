@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SPI_BUS_H_
+#define SPI_BUS_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <kernel.h>
+#include <device.h>
+#include <drivers/spi.h>
+#include <sys/slist.h>
+
+struct spi_bus_xfer;
+
+/** @brief Called from the bus thread once @p xfer completed or failed. */
+typedef void (*spi_bus_done_t)(struct spi_bus_xfer *xfer, int result);
+
+/** @brief Write the command that makes the device continue at byte
+ *  @p offset of @p xfer into @p cmd, for example a flash read with the
+ *  start address plus @p offset.
+ *
+ *  @return The command length, at most CONFIG_SPI_BUS_CMD_MAX.
+ */
+typedef size_t (*spi_bus_cmd_t)(const struct spi_bus_xfer *xfer, size_t offset, uint8_t *cmd);
+
+/** @brief Per-client counters. */
+struct spi_bus_stats
+{
+	uint32_t xfers;
+	uint32_t bytes;
+	/** Time the bus was clocking for this client. */
+	uint64_t busy_us;
+	/** busy_us per mille of the time since the client was added. */
+	uint32_t utilisation_permille;
+	/** Longest time from spi_bus_submit() to the first byte. */
+	uint32_t wait_max_us;
+	/** Transactions that completed after their deadline. */
+	uint32_t deadline_misses;
+	/** Times a transaction was set aside for a more urgent one. */
+	uint32_t preemptions;
+};
+
+/** @brief A device on the bus, with its chip select in @p cfg. */
+struct spi_bus_client
+{
+	const char *name;
+	const struct spi_config *cfg;
+	/** 0 is the most urgent. */
+	uint8_t priority;
+
+	/* Private */
+	int64_t added_ticks;
+	struct spi_bus_stats stats;
+};
+
+/** @brief A transaction, owned by the bus from spi_bus_submit() until
+ *  @p done is called.
+ */
+struct spi_bus_xfer
+{
+	sys_snode_t node;
+	struct spi_bus_client *client;
+	/** NULL clocks out the driver's over-run character. */
+	const uint8_t *tx;
+	/** NULL discards what is clocked in. */
+	uint8_t *rx;
+	size_t len;
+	/** Absolute k_uptime_get() time, or 0 for none. Earlier deadlines
+	 *  go first among transactions of the same priority.
+	 */
+	int64_t deadline_ms;
+	/** Can be split into CONFIG_SPI_BUS_CHUNK byte transfers, with the
+	 *  chip select released in between, so more urgent transactions
+	 *  can go first. Devices that abort a command when the chip select
+	 *  is released, like a flash read, need @p cmd.
+	 */
+	bool preemptible;
+	/** If not NULL, called before each transfer, and the command is
+	 *  clocked ahead of @p tx and @p rx under the same chip select, so
+	 *  every chunk is a complete transaction for the device. What is
+	 *  clocked in during the command is discarded.
+	 */
+	spi_bus_cmd_t cmd;
+	spi_bus_done_t done;
+	void *user_data;
+
+	/* Private */
+	size_t offset;
+	uint32_t submit_cyc;
+	bool started;
+};
+
+/** @brief Start scheduling transactions on @p dev. */
+int spi_bus_init(const struct device *dev);
+
+/** @brief Add @p client, its fields before "Private" have to be set. */
+void spi_bus_client_add(struct spi_bus_client *client);
+
+/** @brief Queue @p xfer.
+ *
+ *  @return 0 on success, -EINVAL if the transaction is empty or its client
+ *          is not set.
+ */
+int spi_bus_submit(struct spi_bus_xfer *xfer);
+
+/** @brief Queue a transaction and wait until it is done.
+ *
+ *  @return The transfer result, or -EINVAL as for spi_bus_submit().
+ */
+int spi_bus_transceive(struct spi_bus_client *client, const uint8_t *tx, uint8_t *rx,
+		       size_t len, int64_t deadline_ms, bool preemptible);
+
+void spi_bus_stats_get(const struct spi_bus_client *client, struct spi_bus_stats *stats);
+
+#endif /* SPI_BUS_H_ */
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	Double-buffered SPI master stream.
+
+	Two TX/RX buffer pairs take turns. While the DMA works on one pair,
+	the stream thread consumes the other's RX data, refills its TX data
+	and calls spi_transceive_async() for it. The driver holds the bus
+	lock until the running transfer completes, so that call returns as
+	soon as the queued transfer has been started, and the bus only idles
+	for the time it takes to program the next DMA transfer. The CPU
+	touches a buffer pair only after its k_poll_signal reported it done.
+
+	With a pending callback the stream only runs while there is something
+	to transfer, and otherwise sleeps until spi_stream_kick(), for example
+	from the slave's data ready interrupt.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <drivers/spi.h>
+#include <soc.h>
+
+#include "spi_stream.h"
+
+#define XFER_MAX CONFIG_SPI_STREAM_XFER_MAX
+
+/* One EasyDMA transfer per stream transfer, the driver would split longer ones */
+#if defined(SPIM1_EASYDMA_MAXCNT_SIZE)
+BUILD_ASSERT(XFER_MAX < BIT(SPIM1_EASYDMA_MAXCNT_SIZE),
+	     "CONFIG_SPI_STREAM_XFER_MAX exceeds the EasyDMA transfer limit");
+#endif
+
+struct stream_slot {
+	uint8_t tx[XFER_MAX];
+	uint8_t rx[XFER_MAX];
+	struct spi_buf tx_buf;
+	struct spi_buf rx_buf;
+	struct spi_buf_set tx_set;
+	struct spi_buf_set rx_set;
+	struct k_poll_signal signal;
+	bool queued;
+};
+
+/* EasyDMA reads and writes RAM only, so the buffers can't be const */
+static struct stream_slot slots[2];
+
+static const struct device *stream_dev;
+static const struct spi_config *stream_cfg;
+static const struct spi_stream_cb *stream_cb;
+static size_t stream_len;
+
+/* running covers the whole run including the final drain, stopping only
+ * asks stream_run() to wind down, so a new start can't reuse the slots
+ * while the old transfers are still in flight.
+ */
+static atomic_t running;
+static atomic_t stopping;
+static K_SEM_DEFINE(stream_start_sem, 0, 1);
+static K_SEM_DEFINE(stream_kick_sem, 0, 1);
+
+static struct spi_stream_stats stats;
+static int64_t start_ms;
+static int64_t stop_ms;
+static struct k_spinlock stats_lock;
+
+int spi_stream_start(const struct device *dev, const struct spi_config *cfg,
+		     size_t len, const struct spi_stream_cb *cb)
+{
+	if (len == 0 || len > XFER_MAX) {
+		return -EINVAL;
+	}
+
+	if (!atomic_cas(&running, false, true)) {
+		return -EBUSY;
+	}
+
+	atomic_clear(&stopping);
+
+	stream_dev = dev;
+	stream_cfg = cfg;
+	stream_len = len;
+	stream_cb = cb;
+
+	k_sem_give(&stream_start_sem);
+
+	return 0;
+}
+
+void spi_stream_stop(void)
+{
+	atomic_set(&stopping, true);
+	k_sem_give(&stream_kick_sem);
+}
+
+void spi_stream_kick(void)
+{
+	k_sem_give(&stream_kick_sem);
+}
+
+bool spi_stream_running(void)
+{
+	return atomic_get(&running);
+}
+
+void spi_stream_stats_get(struct spi_stream_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+	out->elapsed_ms = (uint32_t)((atomic_get(&running) ? k_uptime_get() : stop_ms) - start_ms);
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+static int slot_submit(struct stream_slot *slot)
+{
+	int err;
+
+	if (stream_cb->fill) {
+		stream_cb->fill(slot->tx, stream_len, stream_cb->user_data);
+	}
+
+	slot->tx_buf.len = stream_len;
+	slot->rx_buf.len = stream_len;
+
+	k_poll_signal_reset(&slot->signal);
+
+	/* Blocks on the bus lock until the other slot's transfer is done */
+	err = spi_transceive_async(stream_dev, stream_cfg, &slot->tx_set, &slot->rx_set,
+				   &slot->signal);
+	slot->queued = !err;
+
+	return err;
+}
+
+static void slot_complete(struct stream_slot *slot)
+{
+	struct k_poll_event event = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+							     K_POLL_MODE_NOTIFY_ONLY,
+							     &slot->signal);
+	unsigned int signaled;
+	int result;
+
+	k_poll(&event, 1, K_FOREVER);
+	k_poll_signal_check(&slot->signal, &signaled, &result);
+	slot->queued = false;
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.transfers++;
+	if (result) {
+		stats.errors++;
+	} else {
+		stats.bytes += stream_len;
+	}
+
+	k_spin_unlock(&stats_lock, key);
+
+	if (stream_cb->done) {
+		stream_cb->done(slot->rx, stream_len, result, stream_cb->user_data);
+	}
+}
+
+static bool stream_pending(void)
+{
+	return !stream_cb->pending || stream_cb->pending(stream_cb->user_data);
+}
+
+static void stream_run(void)
+{
+	struct stream_slot *current = &slots[0];
+	struct stream_slot *next = &slots[1];
+	struct stream_slot *swap;
+	int err = 0;
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	memset(&stats, 0, sizeof(stats));
+	start_ms = k_uptime_get();
+
+	k_spin_unlock(&stats_lock, key);
+
+	k_sem_reset(&stream_kick_sem);
+
+	while (!err && !atomic_get(&stopping)) {
+		/* Nothing to transfer: finish the running transfer, which may
+		 * change that, and only then sleep.
+		 */
+		if (!stream_pending()) {
+			if (current->queued) {
+				slot_complete(current);
+			} else {
+				k_sem_take(&stream_kick_sem, K_FOREVER);
+			}
+			continue;
+		}
+
+		/* Queue the next transfer behind the running one, then finish
+		 * the running one while the next is on the bus.
+		 */
+		err = slot_submit(next);
+
+		if (current->queued) {
+			slot_complete(current);
+		}
+
+		swap = current;
+		current = next;
+		next = swap;
+	}
+
+	if (err) {
+		printk("SPI stream stopped (err %d)\n", err);
+	}
+
+	/* Drain what is still queued before the buffers can be reused */
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		if (current->queued) {
+			slot_complete(current);
+		}
+		current = next;
+	}
+
+	stop_ms = k_uptime_get();
+	atomic_set(&running, false);
+}
+
+static void stream_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	for (int i = 0; i < ARRAY_SIZE(slots); i++) {
+		struct stream_slot *slot = &slots[i];
+
+		slot->tx_buf.buf = slot->tx;
+		slot->rx_buf.buf = slot->rx;
+		slot->tx_set.buffers = &slot->tx_buf;
+		slot->tx_set.count = 1;
+		slot->rx_set.buffers = &slot->rx_buf;
+		slot->rx_set.count = 1;
+		k_poll_signal_init(&slot->signal);
+	}
+
+	for (;;) {
+		k_sem_take(&stream_start_sem, K_FOREVER);
+
+		stream_run();
+	}
+}
+
+K_THREAD_DEFINE(spi_stream_tid, CONFIG_SPI_STREAM_STACK_SIZE, stream_thread,
+		NULL, NULL, NULL, CONFIG_SPI_STREAM_THREAD_PRIORITY, 0, 0);
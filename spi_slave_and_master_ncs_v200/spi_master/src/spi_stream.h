@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SPI_STREAM_H_
+#define SPI_STREAM_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <device.h>
+#include <drivers/spi.h>
+
+/** @brief Fill the TX buffer of the next transfer.
+ *
+ *  Called from the stream thread, only for a buffer that is not in use by
+ *  the DMA. @p len bytes are clocked out whatever is written.
+ */
+typedef void (*spi_stream_fill_t)(uint8_t *tx, size_t len, void *user_data);
+
+/** @brief Consume the RX buffer of a completed transfer.
+ *
+ *  Called from the stream thread once the transfer is done, while the next
+ *  one is already running. @p err is the result of the transfer.
+ */
+typedef void (*spi_stream_done_t)(const uint8_t *rx, size_t len, int err, void *user_data);
+
+/** @brief Whether there is anything to transfer.
+ *
+ *  Called from the stream thread before each transfer is queued. Once it
+ *  returns false the stream finishes the running transfer and idles until
+ *  spi_stream_kick().
+ */
+typedef bool (*spi_stream_pending_t)(void *user_data);
+
+struct spi_stream_cb
+{
+	spi_stream_fill_t fill;
+	spi_stream_done_t done;
+	/** NULL to transfer continuously. */
+	spi_stream_pending_t pending;
+	void *user_data;
+};
+
+/** @brief Stream counters. */
+struct spi_stream_stats
+{
+	/** Transfers completed, including failed ones. */
+	uint32_t transfers;
+	/** Transfers that completed with an error. */
+	uint32_t errors;
+	/** Bytes clocked in each direction by successful transfers. */
+	uint64_t bytes;
+	/** Time since the stream started, or until it stopped. */
+	uint32_t elapsed_ms;
+};
+
+/** @brief Start back-to-back transfers of @p len bytes on @p dev.
+ *
+ *  Two TX/RX buffer pairs are used in turn. The next transfer is queued
+ *  while the previous one is running, so the bus idles only for the
+ *  driver's setup time between transfers.
+ *
+ *  @return 0 on success, -EINVAL if @p len is 0 or larger than
+ *          CONFIG_SPI_STREAM_XFER_MAX, -EBUSY if a stream is running.
+ */
+int spi_stream_start(const struct device *dev, const struct spi_config *cfg,
+		     size_t len, const struct spi_stream_cb *cb);
+
+/** @brief Stop after the transfers already queued. */
+void spi_stream_stop(void);
+
+/** @brief Check the pending callback again, from any context including
+ *  interrupts.
+ */
+void spi_stream_kick(void);
+
+/** @brief True from spi_stream_start() until the stream has stopped and
+ *  its last transfer completed, so the callbacks are no longer called.
+ */
+bool spi_stream_running(void);
+
+void spi_stream_stats_get(struct spi_stream_stats *stats);
+
+#endif /* SPI_STREAM_H_ */
@@ -5,8 +5,14 @@
 */
 
 #include <zephyr.h>
+#include <string.h>
 #include <sys/printk.h>
 #include <drivers/spi.h>
+#include <drivers/gpio.h>
+
+#include "spi_frame.h"
+#include "spi_cal.h"
+#include "spis_queue.h"
 
 #define DT_DRV_COMPAT nordic_nrf_spis
 
@@ -47,12 +53,236 @@ static void spi_init(void)
 	       DT_PROP(DT_DRV_INST(0), sck_pin));*/
 }
 
+#if defined(CONFIG_SPI_FRAME)
+#define XFER_LEN SPI_FRAME_XFER_LEN
+
+/* The test message is sent over and over, with its sequence number in byte 0 */
+static uint8_t test_msg[CONFIG_SPI_FRAME_TEST_MSG_LEN];
+static uint8_t rx_msg[CONFIG_SPI_FRAME_TEST_MSG_LEN];
+static struct spi_frame_tx frame_tx;
+static struct spi_frame_rx frame_rx;
+static uint8_t frame_seq;
+
+#if defined(CONFIG_SPI_DATA_READY)
+/* Optional, tells the master when to clock */
+static const struct gpio_dt_spec data_ready =
+	GPIO_DT_SPEC_GET_OR(DT_PATH(zephyr_user), data_ready_gpios, {0});
+static struct k_spinlock data_ready_lock;
+static bool msg_pending;
+static bool armed_has_data;
+
+static void data_ready_init(void)
+{
+	int err;
+
+	if (!data_ready.port) {
+		printk("No data-ready-gpios, the master streams continuously\n");
+		return;
+	}
+
+	err = gpio_pin_configure_dt(&data_ready, GPIO_OUTPUT_INACTIVE);
+	if (err) {
+		printk("Error %d: failed to configure data ready pin %d\n", err,
+		       data_ready.pin);
+		return;
+	}
+
+	printk("Data ready on %s pin %d\n", data_ready.port->name, data_ready.pin);
+}
+
+/* Called from main, the line goes up before the message is in a frame */
+static void data_ready_msg_queue(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&data_ready_lock);
+
+	msg_pending = true;
+	gpio_pin_set_dt(&data_ready, 1);
+
+	k_spin_unlock(&data_ready_lock, key);
+}
+
+/* Raised while the armed or the prepared transaction carries data, or a
+ * message waits to be started, so the master clocks all of it. The lock
+ * keeps data_ready_msg_queue() from being overwritten with a stale level.
+ */
+static void data_ready_update(const uint8_t *tx)
+{
+	const struct spi_frame_hdr *hdr = (const struct spi_frame_hdr *)tx;
+	bool has_data = hdr->type != SPI_FRAME_TYPE_IDLE;
+	k_spinlock_key_t key = k_spin_lock(&data_ready_lock);
+
+	gpio_pin_set_dt(&data_ready, armed_has_data || has_data || msg_pending);
+	armed_has_data = has_data;
+
+	k_spin_unlock(&data_ready_lock, key);
+}
+#endif
+
+/* Back to back without a data ready line, otherwise once per report */
+static bool test_msg_due(void)
+{
+#if defined(CONFIG_SPI_DATA_READY)
+	if (data_ready.port) {
+		k_spinlock_key_t key = k_spin_lock(&data_ready_lock);
+		bool due = msg_pending;
+
+		msg_pending = false;
+
+		k_spin_unlock(&data_ready_lock, key);
+
+		return due;
+	}
+#endif
+	return true;
+}
+
+#if defined(CONFIG_SPI_FRAME_CAL)
+/* Pattern frames are answered until this long after the last one */
+#define CAL_WINDOW_MS 100
+
+static atomic_t cal_until_ms;
+static atomic_t cal_errors;
+static uint8_t cal_seq;
+
+static bool cal_active(void)
+{
+	return (int32_t)((uint32_t)atomic_get(&cal_until_ms) - k_uptime_get_32()) > 0;
+}
+
+/* While the master calibrates, anything corrupt counts against its clock */
+static bool cal_received(const uint8_t *rx_buffer)
+{
+	int ret = spi_cal_check(rx_buffer, NULL);
+
+	if (ret > 0) {
+		atomic_set(&cal_until_ms, k_uptime_get_32() + CAL_WINDOW_MS);
+		return true;
+	}
+
+	if (ret < 0 && cal_active()) {
+		atomic_inc(&cal_errors);
+		return true;
+	}
+
+	return false;
+}
+
+static bool cal_fill(uint8_t *tx_buffer)
+{
+	if (!cal_active()) {
+		return false;
+	}
+
+	spi_cal_fill(tx_buffer, cal_seq++, atomic_get(&cal_errors));
+
+	return true;
+}
+#endif
+
+static void frame_init(void)
+{
+	for (int i = 0; i < sizeof(test_msg); i++) {
+		test_msg[i] = i;
+	}
+	spi_frame_rx_init(&frame_rx, rx_msg, sizeof(rx_msg));
+
+#if defined(CONFIG_SPI_DATA_READY)
+	data_ready_init();
+#endif
+}
+
+static void frame_fill(uint8_t *tx_buffer)
+{
+#if defined(CONFIG_SPI_FRAME_CAL)
+	if (cal_fill(tx_buffer)) {
+		return;
+	}
+#endif
+
+	if (!spi_frame_tx_busy(&frame_tx) && test_msg_due()) {
+		test_msg[0] = frame_seq;
+		spi_frame_tx_start(&frame_tx, SPI_FRAME_TYPE_DATA, frame_seq++,
+				   test_msg, sizeof(test_msg));
+	}
+
+	spi_frame_tx_fill(&frame_tx, tx_buffer);
+}
+
+static void frame_received(const uint8_t *rx_buffer)
+{
+	int len;
+
+#if defined(CONFIG_SPI_FRAME_CAL)
+	if (cal_received(rx_buffer)) {
+		return;
+	}
+#endif
+
+	len = spi_frame_rx_put(&frame_rx, rx_buffer);
+
+	if (len > 0) {
+		printk("Message %u received, %d bytes, byte 0: %x\n",
+		       frame_rx.messages, len, rx_msg[0]);
+	} else if (len < 0) {
+		printk("Frame error %d (%u CRC errors, %u sequence errors)\n",
+		       len, frame_rx.crc_errors, frame_rx.seq_errors);
+	}
+}
+#else
+#define XFER_LEN 32
+#endif
+
+#if defined(CONFIG_SPIS_QUEUE)
+BUILD_ASSERT(XFER_LEN <= CONFIG_SPIS_QUEUE_XFER_MAX,
+	     "A transaction does not fit CONFIG_SPIS_QUEUE_XFER_MAX");
+
+/* Runs in the queue thread, while the previous transaction is armed */
+static void queue_fill(uint8_t *tx, size_t len, void *user_data)
+{
+#if defined(CONFIG_SPI_FRAME)
+	frame_fill(tx);
+#if defined(CONFIG_SPI_DATA_READY)
+	if (data_ready.port) {
+		data_ready_update(tx);
+	}
+#endif
+#else
+	static const uint8_t hello[] = { 's', 'p', 'i', 's', 'l', 'a', 'v', 'e', '\n' };
+	static uint8_t queue_counter;
+
+	memset(tx, 0, len);
+	memcpy(tx, hello, MIN(len, sizeof(hello)));
+	tx[0] += queue_counter++;
+#endif
+}
+
+static void queue_consume(const struct spis_xfer *xfer)
+{
+#if defined(CONFIG_SPI_FRAME)
+	frame_received(xfer->rx);
+#else
+	printk("byte received: %u\n", (uint32_t)xfer->len);
+	printk("RX buffer [0]: %x\n", xfer->rx[0]);
+#endif
+}
+
+static void queue_report(void)
+{
+	struct spis_queue_stats stats;
+
+	spis_queue_stats_get(&stats);
+
+	printk("SPIS queue: %u transactions, %u dropped, %u overruns, %u errors, %u queued max\n",
+	       stats.transactions, stats.dropped, stats.overruns, stats.errors,
+	       stats.queued_max);
+}
+#else
 void spi_test_transceive(void)
 {
 	int err;
-	static uint8_t tx_buffer[32] = { 's', 'p', 'i', 's', 'l',
-					 'a', 'v', 'e', '\n' };
-	static uint8_t rx_buffer[32];
+	static uint8_t tx_buffer[XFER_LEN] = { 's', 'p', 'i', 's', 'l',
+					       'a', 'v', 'e', '\n' };
+	static uint8_t rx_buffer[XFER_LEN];
 
 	const struct spi_buf tx_buf = { .buf = tx_buffer,
 					.len = sizeof(tx_buffer) };
@@ -64,24 +294,54 @@ void spi_test_transceive(void)
 	};
 	const struct spi_buf_set rx = { .buffers = &rx_buf, .count = 1 };
 
+#if defined(CONFIG_SPI_FRAME)
+	frame_fill(tx_buffer);
+#endif
+
 	err = spi_transceive(spi_dev, &spi_cfg, &tx, &rx);
 	if (err < 0) {
 		printk("SPI error: %d\n", err);
 	} else {		
+#if defined(CONFIG_SPI_FRAME)
+		frame_received(rx_buffer);
+#else
 		printk("byte received: %d\n", err);
 		printk("TX buffer [0]: %x\n", tx_buffer[0]);
 		printk("RX buffer [0]: %x\n", rx_buffer[0]);
 		tx_buffer[0]++;
+#endif
 	}
 }
+#endif
 
 extern void spis_thread(void *unused1, void *unused2, void *unused3)
 {
 	spi_init();
 
+#if defined(CONFIG_SPI_FRAME)
+	frame_init();
+#endif
+
+#if defined(CONFIG_SPIS_QUEUE)
+	int err = spis_queue_start(spi_dev, &spi_cfg, XFER_LEN, queue_fill, NULL);
+
+	if (err) {
+		printk("SPIS queue failed to start (err %d)\n", err);
+		return;
+	}
+
+	/* Consumer: received buffers are processed in place and given back */
+	while (1) {
+		struct spis_xfer *xfer = spis_queue_get(K_FOREVER);
+
+		queue_consume(xfer);
+		spis_queue_release(xfer);
+	}
+#else
 	while (1) {
 		spi_test_transceive();
 	}
+#endif
 }
 
 void main(void)
@@ -89,4 +349,16 @@ void main(void)
 	printk("SPIS Example\n");
 	printk("Add any handling you'd like in the main thread\n");
 	printk("SPIS handling will be performed in an own thread\n");
+
+#if defined(CONFIG_SPIS_QUEUE)
+	while (1) {
+		k_sleep(K_SECONDS(CONFIG_SPIS_QUEUE_REPORT_SEC));
+		queue_report();
+#if defined(CONFIG_SPI_DATA_READY)
+		if (data_ready.port) {
+			data_ready_msg_queue();
+		}
+#endif
+	}
+#endif
 }
\ No newline at end of file
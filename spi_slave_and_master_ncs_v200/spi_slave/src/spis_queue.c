@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	SPI slave buffer pool.
+
+	The SPIS only receives while it is armed, and a transaction the master
+	clocks while the CPU re-arms is lost. The queue thread therefore takes
+	the next buffer from the pool and fills its TX data while the current
+	one is armed, and arms it right after the current one completes,
+	before anything is done with the received data. Completed buffers go
+	to the consumer through a k_fifo, and come back to the pool once the
+	consumer releases them.
+
+	When the consumer falls behind and the pool is empty, the slave stays
+	armed with one of two scratch buffers, whose data is counted as dropped.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <drivers/spi.h>
+
+#include "spis_queue.h"
+
+K_MEM_SLAB_DEFINE(spis_pool, sizeof(struct spis_xfer), CONFIG_SPIS_QUEUE_BUFFERS, 4);
+static K_FIFO_DEFINE(spis_fifo);
+
+/* Two, as the next one is filled while the current one is armed */
+static struct spis_xfer scratch[2];
+
+static const struct device *queue_dev;
+static const struct spi_config *queue_cfg;
+static spis_queue_fill_t queue_fill;
+static void *queue_user_data;
+static size_t queue_len;
+
+static atomic_t started;
+static K_SEM_DEFINE(queue_start_sem, 0, 1);
+
+static struct spis_queue_stats stats;
+static uint32_t queued;
+static struct k_spinlock stats_lock;
+
+/* Only one transaction is armed at a time, the driver keeps these until it completes */
+static struct spi_buf tx_buf;
+static struct spi_buf rx_buf;
+static const struct spi_buf_set tx_set = { .buffers = &tx_buf, .count = 1 };
+static const struct spi_buf_set rx_set = { .buffers = &rx_buf, .count = 1 };
+static struct k_poll_signal xfer_signal;
+
+int spis_queue_start(const struct device *dev, const struct spi_config *cfg,
+		     size_t len, spis_queue_fill_t fill, void *user_data)
+{
+	if (len == 0 || len > CONFIG_SPIS_QUEUE_XFER_MAX) {
+		return -EINVAL;
+	}
+
+	if (!atomic_cas(&started, false, true)) {
+		return -EALREADY;
+	}
+
+	queue_dev = dev;
+	queue_cfg = cfg;
+	queue_len = len;
+	queue_fill = fill;
+	queue_user_data = user_data;
+
+	k_sem_give(&queue_start_sem);
+
+	return 0;
+}
+
+struct spis_xfer *spis_queue_get(k_timeout_t timeout)
+{
+	struct spis_xfer *xfer = k_fifo_get(&spis_fifo, timeout);
+
+	if (xfer) {
+		k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+		queued--;
+
+		k_spin_unlock(&stats_lock, key);
+	}
+
+	return xfer;
+}
+
+void spis_queue_release(struct spis_xfer *xfer)
+{
+	k_mem_slab_free(&spis_pool, (void **)&xfer);
+}
+
+void spis_queue_stats_get(struct spis_queue_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+uint32_t spis_queue_free(void)
+{
+	return k_mem_slab_num_free_get(&spis_pool);
+}
+
+static bool is_scratch(const struct spis_xfer *xfer)
+{
+	return xfer == &scratch[0] || xfer == &scratch[1];
+}
+
+static struct spis_xfer *xfer_prepare(const struct spis_xfer *armed)
+{
+	struct spis_xfer *xfer;
+
+	if (k_mem_slab_alloc(&spis_pool, (void **)&xfer, K_NO_WAIT)) {
+		xfer = (armed == &scratch[0]) ? &scratch[1] : &scratch[0];
+	}
+
+	if (queue_fill) {
+		queue_fill(xfer->tx, queue_len, queue_user_data);
+	}
+
+	return xfer;
+}
+
+static int xfer_arm(struct spis_xfer *xfer)
+{
+	tx_buf.buf = xfer->tx;
+	tx_buf.len = queue_len;
+	rx_buf.buf = xfer->rx;
+	rx_buf.len = queue_len;
+
+	k_poll_signal_reset(&xfer_signal);
+
+	return spi_transceive_async(queue_dev, queue_cfg, &tx_set, &rx_set, &xfer_signal);
+}
+
+/* For a slave the signal result is the number of bytes received */
+static int xfer_wait(void)
+{
+	struct k_poll_event event = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+							     K_POLL_MODE_NOTIFY_ONLY,
+							     &xfer_signal);
+	unsigned int signaled;
+	int result;
+
+	k_poll(&event, 1, K_FOREVER);
+	k_poll_signal_check(&xfer_signal, &signaled, &result);
+
+	return result;
+}
+
+static void xfer_complete(struct spis_xfer *xfer, int result)
+{
+	bool deliver = false;
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.transactions++;
+	if (result < 0) {
+		stats.errors++;
+	} else if (is_scratch(xfer)) {
+		stats.dropped++;
+	} else {
+		if ((size_t)result != queue_len) {
+			stats.overruns++;
+		}
+		queued++;
+		stats.queued_max = MAX(stats.queued_max, queued);
+		deliver = true;
+	}
+
+	k_spin_unlock(&stats_lock, key);
+
+	if (deliver) {
+		xfer->len = result;
+		k_fifo_put(&spis_fifo, xfer);
+	} else if (!is_scratch(xfer)) {
+		spis_queue_release(xfer);
+	}
+}
+
+static void queue_run(void)
+{
+	struct spis_xfer *current = xfer_prepare(NULL);
+	struct spis_xfer *next;
+	int result;
+	int err;
+
+	err = xfer_arm(current);
+
+	while (!err) {
+		next = xfer_prepare(current);
+
+		result = xfer_wait();
+
+		/* Re-arm first, the master may already be clocking */
+		err = xfer_arm(next);
+
+		xfer_complete(current, result);
+		current = next;
+	}
+
+	/* current was never armed */
+	if (!is_scratch(current)) {
+		spis_queue_release(current);
+	}
+
+	printk("SPIS queue stopped (err %d)\n", err);
+}
+
+static void queue_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	k_poll_signal_init(&xfer_signal);
+
+	k_sem_take(&queue_start_sem, K_FOREVER);
+
+	queue_run();
+}
+
+K_THREAD_DEFINE(spis_queue_tid, CONFIG_SPIS_QUEUE_STACK_SIZE, queue_thread,
+		NULL, NULL, NULL, CONFIG_SPIS_QUEUE_THREAD_PRIORITY, 0, 0);
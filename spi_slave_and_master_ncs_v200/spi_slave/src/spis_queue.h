@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef SPIS_QUEUE_H_
+#define SPIS_QUEUE_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <kernel.h>
+#include <device.h>
+#include <drivers/spi.h>
+
+/** @brief One transaction, owned by the consumer between spis_queue_get()
+ *  and spis_queue_release().
+ */
+struct spis_xfer
+{
+	/** Used by the k_fifo. */
+	void *fifo_reserved;
+	/** Bytes clocked in by the master. */
+	size_t len;
+	uint8_t tx[CONFIG_SPIS_QUEUE_XFER_MAX];
+	uint8_t rx[CONFIG_SPIS_QUEUE_XFER_MAX];
+};
+
+/** @brief Fill the TX buffer of a transaction about to be armed.
+ *
+ *  Called from the queue thread while the previous transaction is still
+ *  armed, so it has to be quick.
+ */
+typedef void (*spis_queue_fill_t)(uint8_t *tx, size_t len, void *user_data);
+
+/** @brief Queue counters. */
+struct spis_queue_stats
+{
+	/** Transactions completed, including dropped and failed ones. */
+	uint32_t transactions;
+	/** Transactions received into a scratch buffer and discarded, because
+	 *  all pool buffers were waiting for the consumer.
+	 */
+	uint32_t dropped;
+	/** Transactions shorter or longer than armed, typically a master that
+	 *  started clocking before the slave was armed.
+	 */
+	uint32_t overruns;
+	/** Transactions that completed with an error. */
+	uint32_t errors;
+	/** Most buffers ever waiting for the consumer. */
+	uint32_t queued_max;
+};
+
+/** @brief Keep @p dev armed with transactions of @p len bytes.
+ *
+ *  The next transaction is prepared while the current one is armed and
+ *  armed as soon as the current one completes. Completed transactions are
+ *  handed to the consumer through spis_queue_get() without copying.
+ *
+ *  @return 0 on success, -EINVAL if @p len is 0 or larger than
+ *          CONFIG_SPIS_QUEUE_XFER_MAX, -EALREADY if already started.
+ */
+int spis_queue_start(const struct device *dev, const struct spi_config *cfg,
+		     size_t len, spis_queue_fill_t fill, void *user_data);
+
+/** @brief Next completed transaction, or NULL on timeout. */
+struct spis_xfer *spis_queue_get(k_timeout_t timeout);
+
+/** @brief Give a transaction from spis_queue_get() back to the pool. */
+void spis_queue_release(struct spis_xfer *xfer);
+
+void spis_queue_stats_get(struct spis_queue_stats *stats);
+
+/** @brief Pool buffers neither armed, prepared nor held by the consumer. */
+uint32_t spis_queue_free(void);
+
+#endif /* SPIS_QUEUE_H_ */
@@ -21,6 +21,12 @@ void test_main(void)
 #ifdef CONFIG_USERSPACE
 	set_permissions();
 #endif
-	printk("uart async api sample started\n");
-	double_buffer_setup_and_read();
+	ztest_test_suite(uart_async_test,
+			 ztest_unit_test(test_uart_frame_cobs),
+			 ztest_unit_test(test_uart_frame_slip),
+			 ztest_unit_test(test_uart_frame_errors),
+			 ztest_unit_test(test_uart_frame_bench),
+			 ztest_unit_test(test_uart_async_telemetry),
+			 ztest_unit_test(test_uart_loopback_bench));
+	ztest_run_test_suite(uart_async_test);
 }
@@ -13,6 +13,7 @@
 
 
 #include <drivers/uart.h>
+#include <ztest.h>
 
 /* RX and TX pins have to be connected together*/
 
@@ -20,10 +21,22 @@
 #define UART_DEVICE_NAME DT_LABEL(DT_NODELABEL(uart0))
 #elif defined(CONFIG_BOARD_NRF9160DK_NRF9160)
 #define UART_DEVICE_NAME DT_LABEL(DT_NODELABEL(uart1))
+#elif defined(CONFIG_UART_LOOPBACK_EMUL)
+#define UART_DEVICE_NAME DT_LABEL(DT_NODELABEL(uart_loopback))
 #endif
 
 void init_uart(void);
+const struct device *test_uart_dev(void);
 
+struct uart_frame_decoder;
+/* Ends RX, feeding the last chunks to @p dec, ready for the next start */
+void uart_rx_stop_and_drain(struct uart_frame_decoder *dec);
 
-void double_buffer_setup_and_read(void);
+void test_uart_async_telemetry(void);
+void test_uart_loopback_bench(void);
+
+void test_uart_frame_cobs(void);
+void test_uart_frame_slip(void);
+void test_uart_frame_errors(void);
+void test_uart_frame_bench(void);
 
@@ -8,86 +8,160 @@
 #include <drivers/uart.h>
 
 #include "test_uart.h"
-
-K_SEM_DEFINE(tx_done, 0, 1);
-K_SEM_DEFINE(tx_aborted, 0, 1);
-K_SEM_DEFINE(rx_rdy, 0, 1);
-K_SEM_DEFINE(rx_buf_released, 0, 1);
-K_SEM_DEFINE(rx_disabled, 0, 1);
-
-#define BUF_SIZE 64
-
-static K_MEM_SLAB_DEFINE(uart_slab, BUF_SIZE, 3, 4);
+#include "uart_rx_ring.h"
+#include "uart_tx_queue.h"
+#include "uart_frame.h"
 
 volatile bool failed_in_isr;
 static const struct device *uart_dev;
-uint8_t *read_ptr;
-int recv_length;
+
+void double_buffer_callback(const struct device *uart_dev,
+				 struct uart_event *evt, void *user_data)
+{
+	switch (evt->type) {
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		uart_tx_queue_event(uart_dev, evt);
+		break;
+	default:
+		uart_rx_ring_event(uart_dev, evt);
+		break;
+	}
+}
 
 void init_uart(void)
 {
+	int err;
+
 	uart_dev = device_get_binding(UART_DEVICE_NAME);
+	__ASSERT(uart_dev, "No UART device");
+
+	err = uart_callback_set(uart_dev, double_buffer_callback, NULL);
+	__ASSERT(err == 0, "Failed to set callback");
+
+	err = uart_tx_queue_init(uart_dev);
+	__ASSERT(err == 0, "Failed to init TX queue");
 }
 
-uint8_t double_buffer[2][12];
-uint8_t *next_buf = double_buffer[1];
+const struct device *test_uart_dev(void)
+{
+	return uart_dev;
+}
 
-void double_buffer_callback(const struct device *uart_dev,
-				 struct uart_event *evt, void *user_data)
+void uart_rx_stop_and_drain(struct uart_frame_decoder *dec)
 {
+	struct uart_rx_chunk chunk;
 	int err;
-	uint8_t *buf;
 
-	switch (evt->type) {
-	case UART_TX_DONE:
-		k_sem_give(&tx_done);
-		break;
-	case UART_RX_RDY:
-		read_ptr = evt->data.rx.buf + evt->data.rx.offset;
-		recv_length = evt->data.rx.len;
-		//Log("Recv: %s\n", read_ptr);
-		k_sem_give(&rx_rdy);
-		break;
-	case UART_RX_BUF_REQUEST:
-		
+	/* Whatever is on the line, then what the driver flushes on disable */
+	while (uart_rx_ring_get(&chunk, K_MSEC(20)) == 0) {
+		uart_frame_decoder_feed(dec, &chunk);
+	}
 
-		err = k_mem_slab_alloc(&uart_slab, (void **)&buf, K_NO_WAIT);
-		__ASSERT(err == 0, "Failed to allocate slab");
+	err = uart_rx_ring_stop(K_MSEC(100));
+	zassert_equal(err, 0, "RX did not stop");
 
-		err = uart_rx_buf_rsp(uart_dev, buf, BUF_SIZE);
-		__ASSERT(err == 0, "Failed to provide new buffer");
-		break;
-	case UART_RX_BUF_RELEASED:
-		k_mem_slab_free(&uart_slab, (void **)&evt->data.rx_buf.buf);
-		k_sem_give(&rx_buf_released);
-		break;
-	case UART_RX_DISABLED:
-		k_sem_give(&rx_disabled);
-		break;
-	default:
-		break;
+	while (uart_rx_ring_get(&chunk, K_NO_WAIT) == 0) {
+		uart_frame_decoder_feed(dec, &chunk);
 	}
 
+	/* A partial frame holds chunks, the next start needs them all back */
+	uart_frame_decoder_reset(dec);
 }
 
-void double_buffer_setup_and_read(void)
+/* Queued from the timer interrupt, without waiting for the line */
+static void telemetry_expiry(struct k_timer *timer)
 {
-	uint8_t err;
-	uint8_t *buf;
+	static uint32_t seq;
+	char line[24];
+	uint8_t frame[UART_FRAME_ENCODED_MAX(sizeof(line))];
+	int len = snprintk(line, sizeof(line), "telemetry %u", seq++);
+
+	len = uart_frame_encode(UART_FRAME_COBS, (const uint8_t *)line, len, frame,
+				sizeof(frame));
+	uart_tx_queue_write(frame, len);
+}
 
-	err = uart_callback_set(uart_dev, double_buffer_callback, NULL);
-	__ASSERT(err == 0, "Failed to set callback");
+/* Frames come in place in the RX buffers, a segment per chunk */
+static void frame_received(const struct uart_frame_seg *segs, size_t count, size_t len,
+			   void *user_data)
+{
+	for (size_t i = 0; i < count; i++) {
+		printk("%.*s", (int)segs[i].len, segs[i].data);
+	}
+	printk("\n");
+}
 
-	err = k_mem_slab_alloc(&uart_slab, (void **)&buf, K_NO_WAIT);
-	__ASSERT(err == 0, "Failed to alloc slab");
+static struct uart_frame_decoder decoder;
 
-	err = uart_rx_enable(uart_dev, buf, BUF_SIZE, 10000);
-	__ASSERT(err == 0, "Failed to enable RX");
+static K_TIMER_DEFINE(telemetry_timer, telemetry_expiry, NULL);
 
-	while (true) {
-		k_sem_take(&rx_rdy, K_FOREVER);
-		printk("%.*s\n", recv_length, read_ptr);
-		//printk("Recv: %s\n", read_ptr);
+static void uart_report(void)
+{
+	struct uart_rx_ring_stats stats;
+	struct uart_tx_queue_stats tx;
+	struct uart_frame_stats *frame = &decoder.stats;
+
+	uart_rx_ring_stats_get(&stats);
+	printk("RX: baudrate=%u buf_len=%u buf_count=%u timeout_us=%u chunks=%u bytes=%u "
+	       "lost=%u queued_max=%u starved=%u timeout_flushes=%u restarts=%u retimes=%u "
+	       "errors=%u\n",
+	       stats.baudrate, stats.buf_len, stats.buf_count, stats.timeout_us, stats.chunks,
+	       stats.bytes, stats.lost, stats.queued_max, stats.starved, stats.timeout_flushes,
+	       stats.restarts, stats.retimes, stats.errors);
+
+	uart_tx_queue_stats_get(&tx);
+	printk("TX: writes=%u sends=%u coalesced=%u transfers=%u bytes=%u rejected=%u "
+	       "aborted=%u queued=%u queued_max=%u staged_max=%u busy=%u.%u%% wire=%u.%u%%\n",
+	       tx.writes, tx.sends, tx.coalesced, tx.transfers, tx.bytes, tx.rejected,
+	       tx.aborted, tx.queued, tx.queued_max, tx.staged_max, tx.busy_permille / 10,
+	       tx.busy_permille % 10, tx.wire_permille / 10, tx.wire_permille % 10);
+	printk("FRAME: frames=%u bytes=%u crc_errors=%u format_errors=%u oversize=%u\n",
+	       frame->frames, frame->bytes, frame->crc_errors, frame->format_errors,
+	       frame->oversize);
+}
+
+/* The sample's traffic for a few periods, every line has to come back */
+void test_uart_async_telemetry(void)
+{
+	struct uart_rx_chunk chunk;
+	struct uart_rx_ring_stats stats;
+	int64_t end_ms;
+	int err;
+
+	uart_frame_decoder_init(&decoder, UART_FRAME_COBS, frame_received,
+				uart_rx_ring_release, NULL);
+
+	uart_rx_ring_stats_reset();
+	uart_tx_queue_stats_reset();
+
+	/* The RX ring owns the double-buffered slab */
+	err = uart_rx_ring_start(uart_dev, 0);
+	zassert_equal(err, 0, "Failed to enable RX");
+
+	k_timer_start(&telemetry_timer, K_MSEC(CONFIG_UART_TX_TELEMETRY_MS),
+		      K_MSEC(CONFIG_UART_TX_TELEMETRY_MS));
+
+	end_ms = k_uptime_get() + 5 * CONFIG_UART_TX_TELEMETRY_MS + CONFIG_UART_TX_TELEMETRY_MS / 2;
+
+	while (k_uptime_get() < end_ms) {
+		if (uart_rx_ring_get(&chunk, K_MSEC(100)) == 0) {
+			/* The decoder releases the chunk */
+			uart_frame_decoder_feed(&decoder, &chunk);
+		}
 	}
 
+	k_timer_stop(&telemetry_timer);
+	err = uart_tx_queue_flush(K_MSEC(100));
+	zassert_equal(err, 0, "TX did not drain");
+
+	uart_rx_stop_and_drain(&decoder);
+	uart_report();
+
+	uart_rx_ring_stats_get(&stats);
+	zassert_true(decoder.stats.frames >= 5, "%u telemetry lines came back",
+		     decoder.stats.frames);
+	zassert_equal(decoder.stats.crc_errors + decoder.stats.format_errors, 0,
+		      "Corrupted lines");
+	zassert_equal(stats.lost, 0, "RX ring overflowed");
 }
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr.h>
+#include <string.h>
+#include <devicetree.h>
+
+#include "test_uart.h"
+#include "uart_frame.h"
+
+/* Crosses the longest COBS group, and spans several 64 byte chunks */
+static const size_t frame_lens[] = { 0, 1, 2, 31, 100, 253, 254, 255, 300 };
+
+#define STREAM_SIZE 4096
+
+/* A telemetry sized payload, in the RX buffers of 1 Mbaud */
+#define BENCH_PAYLOAD 64
+#define BENCH_CHUNK 200
+
+/* 0 when the devicetree does not tell */
+#define CPU_HZ DT_PROP_OR(DT_PATH(cpus, cpu_0), clock_frequency, 0)
+
+static uint8_t stream[STREAM_SIZE];
+static uint8_t work[STREAM_SIZE];
+static size_t frame_offs[ARRAY_SIZE(frame_lens)];
+
+static struct {
+	size_t next;
+	bool mismatch;
+	uint32_t released;
+} check;
+
+/* Payload byte @p i of frame @p k, with plenty of 0x00, END and ESC bytes */
+static uint8_t pattern(size_t k, size_t i)
+{
+	uint32_t x = (k * 2654435761U) ^ (i * 40503U);
+
+	x ^= x >> 13;
+	switch (x % 8) {
+	case 0:
+		return 0x00;
+	case 1:
+		return 0xC0;
+	case 2:
+		return 0xDB;
+	default:
+		return x >> 8;
+	}
+}
+
+static size_t pattern_stream(enum uart_frame_format format)
+{
+	uint8_t payload[300];
+	size_t len = 0;
+
+	for (size_t k = 0; k < ARRAY_SIZE(frame_lens); k++) {
+		for (size_t i = 0; i < frame_lens[k]; i++) {
+			payload[i] = pattern(k, i);
+		}
+
+		frame_offs[k] = len;
+		len += uart_frame_encode(format, payload, frame_lens[k], &stream[len],
+					 sizeof(stream) - len);
+	}
+
+	return len;
+}
+
+/* Frames have to come in order. With @p user_data set, dropped ones may
+ * be missing, the lengths tell which.
+ */
+static void check_handler(const struct uart_frame_seg *segs, size_t count, size_t len,
+			  void *user_data)
+{
+	size_t k;
+	size_t i = 0;
+
+	while (user_data && check.next < ARRAY_SIZE(frame_lens) &&
+	       frame_lens[check.next] != len) {
+		check.next++;
+	}
+
+	k = check.next++;
+	if (k >= ARRAY_SIZE(frame_lens) || len != frame_lens[k]) {
+		check.mismatch = true;
+		return;
+	}
+
+	for (size_t s = 0; s < count; s++) {
+		for (size_t j = 0; j < segs[s].len; j++, i++) {
+			if (segs[s].data[j] != pattern(k, i)) {
+				check.mismatch = true;
+			}
+		}
+	}
+}
+
+static void check_release(const struct uart_rx_chunk *chunk)
+{
+	check.released++;
+}
+
+/* Feed @p len bytes of work[] in chunks of @p chunk_len, @return chunks fed */
+static uint32_t feed(struct uart_frame_decoder *dec, size_t len, size_t chunk_len)
+{
+	uint32_t fed = 0;
+
+	for (size_t off = 0; off < len; off += chunk_len) {
+		struct uart_rx_chunk chunk = {
+			.buf = work,
+			.offset = off,
+			.len = MIN(chunk_len, len - off),
+		};
+
+		uart_frame_decoder_feed(dec, &chunk);
+		fed++;
+	}
+
+	return fed;
+}
+
+static void roundtrip(enum uart_frame_format format)
+{
+	static const size_t chunk_lens[] = { 64, 200, STREAM_SIZE };
+	size_t len = pattern_stream(format);
+
+	for (size_t c = 0; c < ARRAY_SIZE(chunk_lens); c++) {
+		struct uart_frame_decoder dec;
+		uint32_t fed;
+
+		memset(&check, 0, sizeof(check));
+		memcpy(work, stream, len);
+		uart_frame_decoder_init(&dec, format, check_handler, check_release, NULL);
+
+		fed = feed(&dec, len, chunk_lens[c]);
+
+		zassert_false(check.mismatch, "Frame corrupted, %zu byte chunks", chunk_lens[c]);
+		zassert_equal(dec.stats.frames, ARRAY_SIZE(frame_lens), "Frames lost");
+		zassert_equal(check.released, fed, "Chunks not released");
+	}
+}
+
+void test_uart_frame_cobs(void)
+{
+	roundtrip(UART_FRAME_COBS);
+}
+
+void test_uart_frame_slip(void)
+{
+	roundtrip(UART_FRAME_SLIP);
+}
+
+void test_uart_frame_errors(void)
+{
+	static bool skips = true;
+	struct uart_frame_decoder dec;
+	size_t len = pattern_stream(UART_FRAME_COBS);
+	uint32_t fed;
+
+	/* A bit flip early in frame 3 */
+	memcpy(work, stream, len);
+	work[frame_offs[3] + 2] ^= 0x10;
+
+	memset(&check, 0, sizeof(check));
+	uart_frame_decoder_init(&dec, UART_FRAME_COBS, check_handler, check_release, &skips);
+	fed = feed(&dec, len, 64);
+
+	zassert_false(check.mismatch, "Frame corrupted");
+	zassert_true(dec.stats.crc_errors + dec.stats.format_errors > 0, "Error not detected");
+	zassert_equal(dec.stats.frames, ARRAY_SIZE(frame_lens) - 1, "Frames lost");
+	zassert_equal(check.released, fed, "Chunks not released");
+
+	/* 8 byte chunks, the longer frames span too many of them */
+	memset(&check, 0, sizeof(check));
+	memcpy(work, stream, len);
+	uart_frame_decoder_init(&dec, UART_FRAME_COBS, check_handler, check_release, &skips);
+	fed = feed(&dec, len, 8);
+
+	zassert_false(check.mismatch, "Frame corrupted");
+	zassert_true(dec.stats.oversize > 0, "Long frames not dropped");
+	zassert_equal(dec.stats.frames + dec.stats.oversize, ARRAY_SIZE(frame_lens),
+		      "Frames neither decoded nor dropped");
+	zassert_equal(check.released, fed, "Chunks not released");
+}
+
+static uint32_t bench_frames;
+
+static void bench_handler(const struct uart_frame_seg *segs, size_t count, size_t len,
+			  void *user_data)
+{
+	bench_frames++;
+}
+
+static void bench_release(const struct uart_rx_chunk *chunk)
+{
+}
+
+static void bench(enum uart_frame_format format, const char *name)
+{
+	struct uart_frame_decoder dec;
+	uint8_t payload[BENCH_PAYLOAD];
+	uint32_t seed = 2463534242U;
+	uint32_t frames = 0;
+	uint32_t runs = 0;
+	uint64_t cycles = 0;
+	uint64_t bytes = 0;
+	uint64_t ns;
+	uint32_t load;
+	size_t len = 0;
+
+	while (len + UART_FRAME_ENCODED_MAX(sizeof(payload)) <= sizeof(stream)) {
+		for (size_t i = 0; i < sizeof(payload); i++) {
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			payload[i] = seed;
+		}
+		len += uart_frame_encode(format, payload, sizeof(payload), &stream[len],
+					 sizeof(stream) - len);
+		frames++;
+	}
+
+	bench_frames = 0;
+	uart_frame_decoder_init(&dec, format, bench_handler, bench_release, NULL);
+
+	/* The decoder works in place, so each run gets a fresh copy, untimed.
+	 * On native_posix code takes no time, only the run count ends it.
+	 */
+	while (k_cyc_to_ms_floor64(cycles) < CONFIG_UART_FRAME_BENCH_MS &&
+	       runs < CONFIG_UART_FRAME_BENCH_RUNS_MAX) {
+		uint32_t start;
+
+		memcpy(work, stream, len);
+		start = k_cycle_get_32();
+		feed(&dec, len, BENCH_CHUNK);
+		cycles += k_cycle_get_32() - start;
+		bytes += len;
+		runs++;
+	}
+
+	zassert_equal(bench_frames, frames * runs, "Frames lost");
+	zassert_equal(dec.stats.crc_errors + dec.stats.format_errors, 0, "Frames corrupted");
+
+	ns = k_cyc_to_ns_floor64(cycles);
+	if (!ns) {
+		TC_PRINT("uart_frame %s: %u bytes, no time measured\n", name, (uint32_t)bytes);
+		return;
+	}
+
+	/* A byte every 10 us at 1 Mbaud */
+	load = ns * 1000 / (bytes * 10000);
+
+	TC_PRINT("uart_frame %s: %u bytes, %u.%u ns/byte", name, (uint32_t)bytes,
+		 (uint32_t)(ns / bytes), (uint32_t)(ns * 10 / bytes % 10));
+	if (CPU_HZ) {
+		uint32_t cycles_x10 = ns * CPU_HZ / (NSEC_PER_SEC / 10) / bytes;
+
+		TC_PRINT(", %u.%u cycles/byte", cycles_x10 / 10, cycles_x10 % 10);
+	}
+	TC_PRINT(", %u.%u%% CPU at 1 Mbaud\n", load / 10, load % 10);
+
+	zassert_true(load <= CONFIG_UART_FRAME_BENCH_MAX_LOAD,
+		     "%s decoding takes %u permille of the CPU at 1 Mbaud", name, load);
+}
+
+void test_uart_frame_bench(void)
+{
+	bench(UART_FRAME_COBS, "COBS");
+	bench(UART_FRAME_SLIP, "SLIP");
+}
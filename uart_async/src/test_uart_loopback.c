@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+	Loopback benchmark.
+
+	Pushes COBS frames of pseudo-random payload through the TX queue,
+	the wire and the RX ring, with TX looped back to RX: the
+	gpio_loopback fixture on hardware, the emulated UART on
+	native_posix. Each frame carries its sequence number and the cycle
+	count it was queued at, so the receiver tells lost, reordered and
+	corrupted frames apart and times each one. At most
+	CONFIG_UART_BENCH_WINDOW bytes are in flight, which keeps the line
+	busy without overrunning the staging ring.
+
+	Each baud rate runs with short RX buffers and with the default ones,
+	and has to keep CONFIG_UART_BENCH_MIN_WIRE of the line busy, lose
+	and reorder nothing, and deliver 99% of the frames within
+	CONFIG_UART_BENCH_MAX_LATENCY_CHARS character times.
+*/
+
+#include <zephyr.h>
+#include <string.h>
+#include <sys/byteorder.h>
+
+#include "test_uart.h"
+#include "uart_rx_ring.h"
+#include "uart_tx_queue.h"
+#include "uart_frame.h"
+
+/* seq, timestamp and payload */
+#define BENCH_FRAME_LEN 60
+#define BENCH_HDR_LEN 8
+
+/* 10 bits a character, with start and stop bits */
+#define CHAR_BITS 10
+
+/* Latency histogram in microseconds: exact below 8, then 8 buckets per
+ * power of two, so each bucket is within 12.5% of its values.
+ */
+#define HIST_SUB 8
+#define HIST_BUCKETS (30 * HIST_SUB)
+
+static const uint32_t baudrates[] = { 115200, 460800, 1000000 };
+/* 0 is CONFIG_UART_RX_RING_FILL_US */
+static const uint32_t fill_us[] = { 500, 0 };
+
+static struct {
+	uint32_t next_seq;
+	uint32_t frames;
+	uint32_t lost;
+	uint32_t reordered;
+	uint32_t corrupted;
+	uint32_t latency_max_us;
+	uint32_t hist[HIST_BUCKETS];
+} rx;
+
+static struct uart_frame_decoder decoder;
+
+static uint32_t xorshift(uint32_t x)
+{
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return x;
+}
+
+static void payload_fill(uint8_t *p, uint32_t seq)
+{
+	uint32_t x = seq * 2654435761U | 1;
+
+	for (size_t i = BENCH_HDR_LEN; i < BENCH_FRAME_LEN; i++) {
+		x = xorshift(x);
+		p[i] = x;
+	}
+}
+
+static uint32_t hist_bucket(uint32_t us)
+{
+	uint32_t msb;
+
+	if (us < HIST_SUB) {
+		return us;
+	}
+
+	msb = find_msb_set(us) - 1;
+
+	return MIN((msb - 2) * HIST_SUB + ((us >> (msb - 3)) & (HIST_SUB - 1)),
+		   HIST_BUCKETS - 1);
+}
+
+/* Highest latency of bucket @p b */
+static uint32_t hist_value(uint32_t b)
+{
+	uint32_t shift;
+
+	if (b < HIST_SUB) {
+		return b;
+	}
+
+	shift = b / HIST_SUB - 1;
+
+	return ((HIST_SUB + b % HIST_SUB + 1) << shift) - 1;
+}
+
+static uint32_t hist_percentile(uint32_t permille)
+{
+	uint32_t rank = DIV_ROUND_UP((uint64_t)rx.frames * permille, 1000);
+	uint32_t seen = 0;
+
+	for (uint32_t b = 0; b < HIST_BUCKETS; b++) {
+		seen += rx.hist[b];
+		if (seen >= MAX(rank, 1)) {
+			return MIN(hist_value(b), rx.latency_max_us);
+		}
+	}
+
+	return rx.latency_max_us;
+}
+
+/* Frames come in place in the RX buffers, the header may be split */
+static void bench_received(const struct uart_frame_seg *segs, size_t count, size_t len,
+			   void *user_data)
+{
+	uint32_t now = k_cycle_get_32();
+	uint8_t frame[BENCH_FRAME_LEN];
+	uint8_t expect[BENCH_FRAME_LEN];
+	size_t off = 0;
+	uint32_t seq;
+	uint32_t us;
+
+	if (len != BENCH_FRAME_LEN) {
+		rx.corrupted++;
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		memcpy(&frame[off], segs[i].data, segs[i].len);
+		off += segs[i].len;
+	}
+
+	seq = sys_get_le32(&frame[0]);
+	payload_fill(expect, seq);
+	if (memcmp(&frame[BENCH_HDR_LEN], &expect[BENCH_HDR_LEN],
+		   BENCH_FRAME_LEN - BENCH_HDR_LEN)) {
+		rx.corrupted++;
+		return;
+	}
+
+	if (seq < rx.next_seq) {
+		rx.reordered++;
+		return;
+	}
+
+	rx.lost += seq - rx.next_seq;
+	rx.next_seq = seq + 1;
+	rx.frames++;
+
+	us = k_cyc_to_us_floor32(now - sys_get_le32(&frame[4]));
+	rx.latency_max_us = MAX(rx.latency_max_us, us);
+	rx.hist[hist_bucket(us)]++;
+}
+
+/* Queue frame @p seq, @return its encoded length, 0 if it did not fit */
+static size_t bench_send(uint32_t seq)
+{
+	uint8_t frame[BENCH_FRAME_LEN];
+	uint8_t encoded[UART_FRAME_ENCODED_MAX(BENCH_FRAME_LEN)];
+	size_t len;
+
+	payload_fill(frame, seq);
+	sys_put_le32(seq, &frame[0]);
+	sys_put_le32(k_cycle_get_32(), &frame[4]);
+
+	len = uart_frame_encode(UART_FRAME_COBS, frame, sizeof(frame), encoded,
+				sizeof(encoded));
+
+	return uart_tx_queue_write(encoded, len) ? 0 : len;
+}
+
+static void bench_run(const struct device *dev, uint32_t baudrate, uint32_t fill)
+{
+	uint32_t total = CONFIG_UART_BENCH_BYTES / BENCH_FRAME_LEN;
+	uint32_t window = CONFIG_UART_BENCH_WINDOW / UART_FRAME_ENCODED_MAX(BENCH_FRAME_LEN);
+	/* Twice the time the window takes on the line, nothing can be later */
+	uint32_t stall_ms = 20 + 2 * CONFIG_UART_BENCH_WINDOW * CHAR_BITS * MSEC_PER_SEC /
+			    baudrate;
+	struct uart_rx_ring_stats ring;
+	struct uart_rx_chunk chunk;
+	struct uart_config cfg;
+	uint32_t sent = 0;
+	uint32_t wire_permille;
+	uint32_t p99_chars;
+	uint32_t p50, p90, p99;
+	int64_t start_ms;
+	int64_t elapsed_ms;
+	int err;
+
+	err = uart_config_get(dev, &cfg);
+	zassert_equal(err, 0, "No UART config");
+	cfg.baudrate = baudrate;
+	err = uart_configure(dev, &cfg);
+	zassert_equal(err, 0, "%u baud not supported", baudrate);
+
+	memset(&rx, 0, sizeof(rx));
+	uart_frame_decoder_init(&decoder, UART_FRAME_COBS, bench_received,
+				uart_rx_ring_release, NULL);
+	uart_rx_ring_stats_reset();
+	uart_tx_queue_stats_reset();
+
+	err = uart_rx_ring_start(dev, fill);
+	zassert_equal(err, 0, "Failed to enable RX");
+
+	start_ms = k_uptime_get();
+
+	while (rx.next_seq < total) {
+		while (sent < total && sent - rx.next_seq < window && bench_send(sent)) {
+			sent++;
+		}
+
+		if (uart_rx_ring_get(&chunk, K_MSEC(stall_ms)) == 0) {
+			/* The decoder releases the chunk */
+			uart_frame_decoder_feed(&decoder, &chunk);
+		} else {
+			/* What is still in flight is gone */
+			rx.lost += sent - rx.next_seq;
+			rx.next_seq = sent;
+		}
+	}
+
+	elapsed_ms = k_uptime_get() - start_ms;
+
+	err = uart_tx_queue_flush(K_MSEC(stall_ms));
+	zassert_equal(err, 0, "TX did not drain");
+	uart_rx_stop_and_drain(&decoder);
+
+	uart_rx_ring_stats_get(&ring);
+
+	wire_permille = (uint64_t)ring.bytes * CHAR_BITS * MSEC_PER_SEC * 1000 /
+			((uint64_t)baudrate * MAX(elapsed_ms, 1));
+	p50 = hist_percentile(500);
+	p90 = hist_percentile(900);
+	p99 = hist_percentile(990);
+	p99_chars = (uint64_t)p99 * baudrate / (CHAR_BITS * USEC_PER_SEC);
+
+	TC_PRINT("uart_loopback %u baud, %u byte buffers: %u frames, %u bytes in %u ms, "
+		 "%u.%u%% of the line, lost=%u reordered=%u corrupted=%u, "
+		 "latency p50=%u p90=%u p99=%u max=%u us\n",
+		 baudrate, ring.buf_len, rx.frames, ring.bytes, (uint32_t)elapsed_ms,
+		 wire_permille / 10, wire_permille % 10, rx.lost, rx.reordered, rx.corrupted,
+		 p50, p90, p99, rx.latency_max_us);
+
+	zassert_equal(rx.lost + decoder.stats.crc_errors + decoder.stats.format_errors +
+		      decoder.stats.oversize + ring.lost, 0, "Frames lost at %u baud", baudrate);
+	zassert_equal(rx.reordered, 0, "Frames reordered at %u baud", baudrate);
+	zassert_equal(rx.corrupted, 0, "Frames corrupted at %u baud", baudrate);
+	zassert_true(wire_permille >= CONFIG_UART_BENCH_MIN_WIRE,
+		     "%u permille of the line used at %u baud", wire_permille, baudrate);
+	zassert_true(p99_chars <= CONFIG_UART_BENCH_MAX_LATENCY_CHARS,
+		     "p99 latency of %u characters at %u baud", p99_chars, baudrate);
+}
+
+void test_uart_loopback_bench(void)
+{
+	const struct device *dev = test_uart_dev();
+	struct uart_config initial;
+	int err;
+
+	err = uart_config_get(dev, &initial);
+	if (err) {
+		ztest_test_skip();
+		return;
+	}
+
+	for (size_t b = 0; b < ARRAY_SIZE(baudrates); b++) {
+		for (size_t f = 0; f < ARRAY_SIZE(fill_us); f++) {
+			bench_run(dev, baudrates[b], fill_us[f]);
+		}
+	}
+
+	uart_configure(dev, &initial);
+	uart_tx_queue_stats_reset();
+}
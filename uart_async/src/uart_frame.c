@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+	Streaming frame decoder.
+
+	Each RX chunk is decoded where it lies, as it arrives. COBS and SLIP
+	both decode to no more bytes than they take in, so the decoded bytes
+	are written over the encoded ones already consumed and a frame never
+	needs a buffer of its own. A frame that spans chunks is handed over as
+	one segment per chunk, and the decoder holds the chunks, and so their
+	RX buffers, until the frame has ended.
+
+	At 1 Mbaud a byte arrives every 10 us, and most of them are neither a
+	delimiter nor an escape. The scan therefore tests a word at a time for
+	the bytes that matter, with the classic has-zero-byte trick on the
+	word XORed with the byte, and runs between them are moved with one
+	memmove() and one CRC update each.
+
+	Frames carry a CRC-16/KERMIT of the payload, least significant byte
+	first. Run over the payload and the CRC it gives 0, so the CRC is
+	updated over the decoded bytes as they come and checked at the
+	delimiter without knowing in advance where the payload ends.
+*/
+
+#include <zephyr.h>
+#include <string.h>
+#include <sys/crc.h>
+
+#include "uart_frame.h"
+
+#define COBS_DELIM 0x00
+#define COBS_GROUP_MAX 0xFF
+
+#define SLIP_END 0xC0
+#define SLIP_ESC 0xDB
+#define SLIP_ESC_END 0xDC
+#define SLIP_ESC_ESC 0xDD
+
+typedef unsigned long scan_word_t;
+
+#define SCAN_ONES (~(scan_word_t)0 / 0xFF)
+#define SCAN_HIGHS (SCAN_ONES << 7)
+
+/* Non-zero if a byte of @p w is 0 */
+static inline scan_word_t has_zero(scan_word_t w)
+{
+	return (w - SCAN_ONES) & ~w & SCAN_HIGHS;
+}
+
+/* Offset of the first @p a or @p b in @p p, or @p len if there is none */
+static size_t scan(const uint8_t *p, size_t len, uint8_t a, uint8_t b)
+{
+	const scan_word_t wa = SCAN_ONES * a;
+	const scan_word_t wb = SCAN_ONES * b;
+	size_t i = 0;
+
+	for (; i < len && ((uintptr_t)&p[i] % sizeof(scan_word_t)); i++) {
+		if (p[i] == a || p[i] == b) {
+			return i;
+		}
+	}
+
+	for (; i + sizeof(scan_word_t) <= len; i += sizeof(scan_word_t)) {
+		scan_word_t w;
+
+		memcpy(&w, &p[i], sizeof(w));
+		if (has_zero(w ^ wa) | has_zero(w ^ wb)) {
+			break;
+		}
+	}
+
+	for (; i < len; i++) {
+		if (p[i] == a || p[i] == b) {
+			return i;
+		}
+	}
+
+	return len;
+}
+
+static void frame_reset(struct uart_frame_decoder *dec)
+{
+	dec->seg_count = 0;
+	dec->encoded = 0;
+	dec->crc = 0;
+	dec->group_code = 0;
+	dec->group_left = 0;
+	dec->escaped = false;
+}
+
+static void release_held(struct uart_frame_decoder *dec)
+{
+	for (size_t i = 0; i < dec->seg_count; i++) {
+		dec->release(&dec->held[i]);
+	}
+}
+
+/* Drop the frame and everything up to the next delimiter */
+static void frame_abort(struct uart_frame_decoder *dec, uint32_t *counter)
+{
+	(*counter)++;
+	release_held(dec);
+	frame_reset(dec);
+	dec->skipping = true;
+}
+
+/* The delimiter of the frame whose last segment is @p seg, in the current chunk */
+static void frame_end(struct uart_frame_decoder *dec, const uint8_t *seg, size_t seg_len)
+{
+	struct uart_frame_seg segs[CONFIG_UART_FRAME_SEGMENTS + 1];
+	size_t count = dec->seg_count;
+	size_t len = seg_len;
+	size_t trim = UART_FRAME_CRC_LEN;
+
+	if (dec->encoded == 0) {
+		/* Back to back delimiters, also used to resynchronize */
+		return;
+	}
+
+	if (dec->group_left || dec->escaped) {
+		release_held(dec);
+		dec->stats.format_errors++;
+		frame_reset(dec);
+		return;
+	}
+
+	memcpy(segs, dec->segs, count * sizeof(segs[0]));
+	for (size_t i = 0; i < count; i++) {
+		len += segs[i].len;
+	}
+	segs[count].data = seg;
+	segs[count].len = seg_len;
+	count++;
+
+	if (len < UART_FRAME_CRC_LEN) {
+		dec->stats.format_errors++;
+	} else if (dec->crc != 0) {
+		dec->stats.crc_errors++;
+	} else {
+		/* The CRC may straddle segments */
+		while (trim) {
+			size_t n = MIN(trim, segs[count - 1].len);
+
+			segs[count - 1].len -= n;
+			trim -= n;
+			if (segs[count - 1].len == 0 && count > 1) {
+				count--;
+			}
+		}
+
+		len -= UART_FRAME_CRC_LEN;
+		dec->stats.frames++;
+		dec->stats.bytes += len;
+		dec->handler(segs, count, len, dec->user_data);
+	}
+
+	release_held(dec);
+	frame_reset(dec);
+}
+
+/* Decode [*pp, end), which holds no delimiter, to *wp */
+static void cobs_run(struct uart_frame_decoder *dec, uint8_t **pp, const uint8_t *end,
+		     uint8_t **wp)
+{
+	uint8_t *p = *pp;
+	uint8_t *w = *wp;
+
+	while (p < end) {
+		if (dec->group_left == 0) {
+			/* Read before the zero is written, w may be p */
+			uint8_t code = *p++;
+
+			/* A group shorter than the longest one ended with a zero */
+			if (dec->group_code && dec->group_code != COBS_GROUP_MAX) {
+				*w++ = 0;
+			}
+			dec->group_code = code;
+			dec->group_left = code - 1;
+		} else {
+			size_t n = MIN(dec->group_left, end - p);
+
+			memmove(w, p, n);
+			w += n;
+			p += n;
+			dec->group_left -= n;
+		}
+	}
+
+	*pp = p;
+	*wp = w;
+}
+
+/* Undo the escape in front of @p c, false if it is not one */
+static bool slip_unescape(uint8_t c, uint8_t *out)
+{
+	switch (c) {
+	case SLIP_ESC_END:
+		*out = SLIP_END;
+		return true;
+	case SLIP_ESC_ESC:
+		*out = SLIP_ESC;
+		return true;
+	default:
+		return false;
+	}
+}
+
+void uart_frame_decoder_feed(struct uart_frame_decoder *dec, const struct uart_rx_chunk *chunk)
+{
+	const bool cobs = dec->format == UART_FRAME_COBS;
+	const uint8_t delim = cobs ? COBS_DELIM : SLIP_END;
+	const uint8_t esc = cobs ? COBS_DELIM : SLIP_ESC;
+	uint8_t *seg = chunk->buf + chunk->offset;
+	const uint8_t *end = seg + chunk->len;
+	uint8_t *p = seg;
+	uint8_t *w = seg;
+
+	while (p < end) {
+		size_t n;
+
+		if (dec->skipping) {
+			n = scan(p, end - p, delim, delim);
+			p += n;
+			if (p == end) {
+				break;
+			}
+			p++;
+			seg = w = p;
+			dec->skipping = false;
+			continue;
+		}
+
+		if (dec->escaped) {
+			if (!slip_unescape(*p, w)) {
+				/* Leaves the byte, it may be the delimiter */
+				frame_abort(dec, &dec->stats.format_errors);
+				continue;
+			}
+			dec->crc = crc16_ccitt(dec->crc, w, 1);
+			dec->escaped = false;
+			dec->encoded++;
+			w++;
+			p++;
+			continue;
+		}
+
+		n = scan(p, end - p, delim, esc);
+		if (n) {
+			uint8_t *run = w;
+
+			if (cobs) {
+				cobs_run(dec, &p, p + n, &w);
+			} else {
+				memmove(w, p, n);
+				w += n;
+				p += n;
+			}
+			dec->crc = crc16_ccitt(dec->crc, run, w - run);
+			dec->encoded += n;
+		}
+
+		if (p == end) {
+			break;
+		}
+
+		if (*p++ == delim) {
+			frame_end(dec, seg, w - seg);
+			seg = w = p;
+		} else {
+			dec->escaped = true;
+			dec->encoded++;
+		}
+	}
+
+	/* The frame goes on in the next chunk, keep this one until it ends */
+	if (!dec->skipping && w > seg) {
+		if (dec->seg_count == ARRAY_SIZE(dec->segs)) {
+			frame_abort(dec, &dec->stats.oversize);
+		} else {
+			dec->segs[dec->seg_count].data = seg;
+			dec->segs[dec->seg_count].len = w - seg;
+			dec->held[dec->seg_count] = *chunk;
+			dec->seg_count++;
+			return;
+		}
+	}
+
+	dec->release(chunk);
+}
+
+void uart_frame_decoder_init(struct uart_frame_decoder *dec, enum uart_frame_format format,
+			     uart_frame_handler_t handler, uart_frame_release_t release,
+			     void *user_data)
+{
+	memset(dec, 0, sizeof(*dec));
+	dec->format = format;
+	dec->handler = handler;
+	dec->release = release;
+	dec->user_data = user_data;
+}
+
+void uart_frame_decoder_reset(struct uart_frame_decoder *dec)
+{
+	release_held(dec);
+	frame_reset(dec);
+	dec->skipping = false;
+}
+
+/* Appends COBS encoded bytes to out[*pos] */
+struct cobs_enc {
+	uint8_t *out;
+	size_t size;
+	size_t pos;
+	/* Where the code of the open group goes */
+	size_t code_pos;
+	uint8_t code;
+};
+
+static bool cobs_put(struct cobs_enc *enc, uint8_t c)
+{
+	if (c == COBS_DELIM) {
+		enc->out[enc->code_pos] = enc->code;
+		enc->code_pos = enc->pos++;
+		enc->code = 1;
+	} else {
+		enc->out[enc->pos++] = c;
+		if (++enc->code == COBS_GROUP_MAX) {
+			enc->out[enc->code_pos] = enc->code;
+			enc->code_pos = enc->pos++;
+			enc->code = 1;
+		}
+	}
+
+	/* Room for the next byte and the code of a new group */
+	return enc->pos + 1 < enc->size;
+}
+
+static size_t cobs_encode(const uint8_t *data, size_t len, const uint8_t *crc,
+			  uint8_t *out, size_t size)
+{
+	struct cobs_enc enc = { .out = out, .size = size, .pos = 1, .code_pos = 0, .code = 1 };
+
+	if (size < 3) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < len + UART_FRAME_CRC_LEN; i++) {
+		if (!cobs_put(&enc, i < len ? data[i] : crc[i - len])) {
+			return 0;
+		}
+	}
+
+	out[enc.code_pos] = enc.code;
+	out[enc.pos++] = COBS_DELIM;
+
+	return enc.pos;
+}
+
+static size_t slip_encode(const uint8_t *data, size_t len, const uint8_t *crc,
+			  uint8_t *out, size_t size)
+{
+	size_t pos = 0;
+
+	for (size_t i = 0; i < len + UART_FRAME_CRC_LEN; i++) {
+		uint8_t c = i < len ? data[i] : crc[i - len];
+
+		/* Room for an escaped byte and the delimiter */
+		if (pos + 3 > size) {
+			return 0;
+		}
+
+		if (c == SLIP_END) {
+			out[pos++] = SLIP_ESC;
+			out[pos++] = SLIP_ESC_END;
+		} else if (c == SLIP_ESC) {
+			out[pos++] = SLIP_ESC;
+			out[pos++] = SLIP_ESC_ESC;
+		} else {
+			out[pos++] = c;
+		}
+	}
+
+	out[pos++] = SLIP_END;
+
+	return pos;
+}
+
+size_t uart_frame_encode(enum uart_frame_format format, const uint8_t *data, size_t len,
+			 uint8_t *out, size_t size)
+{
+	uint16_t crc = crc16_ccitt(0, data, len);
+	uint8_t crc_le[UART_FRAME_CRC_LEN] = { crc & 0xFF, crc >> 8 };
+
+	if (format == UART_FRAME_COBS) {
+		return cobs_encode(data, len, crc_le, out, size);
+	}
+
+	return slip_encode(data, len, crc_le, out, size);
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Streaming COBS and SLIP frame decoder for RX ring chunks
+ */
+
+#ifndef UART_FRAME_H_
+#define UART_FRAME_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+#include "uart_rx_ring.h"
+
+/** CRC-16/KERMIT after the payload, least significant byte first. */
+#define UART_FRAME_CRC_LEN 2
+
+/** Longest encoding of a @p len byte payload, with its CRC and delimiter. */
+#define UART_FRAME_ENCODED_MAX(len) (2 * ((len) + UART_FRAME_CRC_LEN) + 1)
+
+enum uart_frame_format {
+	/** Consistent overhead byte stuffing, frames end with 0x00. */
+	UART_FRAME_COBS,
+	/** RFC 1055, frames end with 0xC0. */
+	UART_FRAME_SLIP,
+};
+
+/** @brief Part of a decoded frame, in place in its RX buffer. */
+struct uart_frame_seg
+{
+	const uint8_t *data;
+	size_t len;
+};
+
+/** @brief Called with each frame whose CRC matched.
+ *
+ *  A frame received over several chunks comes as one segment per chunk.
+ *  The segments are only valid until the handler returns.
+ *
+ *  @param len Payload length, the sum of the segment lengths.
+ */
+typedef void (*uart_frame_handler_t)(const struct uart_frame_seg *segs, size_t count,
+				     size_t len, void *user_data);
+
+/** @brief Called when the decoder no longer needs a chunk it was fed. */
+typedef void (*uart_frame_release_t)(const struct uart_rx_chunk *chunk);
+
+/** @brief Decoder counters. */
+struct uart_frame_stats
+{
+	/** Frames handed to the handler. */
+	uint32_t frames;
+	/** Payload bytes handed to the handler. */
+	uint32_t bytes;
+	/** Frames dropped on a CRC mismatch. */
+	uint32_t crc_errors;
+	/** Frames dropped on a bad encoding or shorter than their CRC. */
+	uint32_t format_errors;
+	/** Frames dropped because they spanned more than
+	 *  CONFIG_UART_FRAME_SEGMENTS chunks.
+	 */
+	uint32_t oversize;
+};
+
+/** @brief Decoder state, owned by the thread that feeds it. */
+struct uart_frame_decoder
+{
+	enum uart_frame_format format;
+	uart_frame_handler_t handler;
+	uart_frame_release_t release;
+	void *user_data;
+
+	/** Segments of the frame being decoded, and the chunks they are in. */
+	struct uart_frame_seg segs[CONFIG_UART_FRAME_SEGMENTS];
+	struct uart_rx_chunk held[CONFIG_UART_FRAME_SEGMENTS];
+	size_t seg_count;
+	/** Encoded bytes since the last delimiter. */
+	size_t encoded;
+	uint16_t crc;
+	/** COBS: code of the current group, 0 before the first one. */
+	uint8_t group_code;
+	/** COBS: data bytes left in the current group. */
+	uint8_t group_left;
+	/** SLIP: the last byte was an escape. */
+	bool escaped;
+	/** Discarding up to the next delimiter after an error. */
+	bool skipping;
+
+	struct uart_frame_stats stats;
+};
+
+void uart_frame_decoder_init(struct uart_frame_decoder *dec, enum uart_frame_format format,
+			     uart_frame_handler_t handler, uart_frame_release_t release,
+			     void *user_data);
+
+/** @brief Decode @p chunk in place.
+ *
+ *  Calls the handler for every frame that ends in @p chunk. The decoder
+ *  owns @p chunk from here on and releases it, right away or, when it
+ *  holds the start of a frame, once that frame has ended.
+ */
+void uart_frame_decoder_feed(struct uart_frame_decoder *dec, const struct uart_rx_chunk *chunk);
+
+/** @brief Drop the frame being decoded and release the chunks it holds. */
+void uart_frame_decoder_reset(struct uart_frame_decoder *dec);
+
+/** @brief Encode @p data with its CRC and a trailing delimiter.
+ *
+ *  @return Encoded length, 0 if it does not fit in @p size bytes.
+ */
+size_t uart_frame_encode(enum uart_frame_format format, const uint8_t *data, size_t len,
+			 uint8_t *out, size_t size);
+
+#endif /* UART_FRAME_H_ */
@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+	Emulated UART with TX looped back to RX.
+
+	The async API of a UARTE with its TX pin wired to its RX pin, for
+	boards without one, such as native_posix. A timer moves the bytes of
+	the transfer in flight to the RX buffer every
+	CONFIG_UART_LOOPBACK_EMUL_TICK_US, as many as the baud rate has put
+	on the wire by then, and raises the events a UARTE would: a buffer
+	request whenever RX moves to a new buffer, RX_RDY when a buffer fills
+	or the line has been idle for the timeout, and RX_DISABLED when no
+	next buffer was given. Bytes that arrive while RX is disabled are
+	lost, as on the wire. Back to back transfers follow each other
+	without a gap.
+
+	The timer handler runs in interrupt context and only the API calls
+	lock against it, which holds on the single core targets this is for.
+	Events are raised from the timer handler only.
+*/
+
+#define DT_DRV_COMPAT vnd_uart_loopback_emul
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <device.h>
+#include <drivers/uart.h>
+
+/* 10 bits a character, with start and stop bits */
+#define CHAR_BITS 10
+
+struct loopback_emul_data {
+	struct k_spinlock lock;
+	struct k_timer tick;
+	bool ticking;
+	uart_callback_t callback;
+	void *user_data;
+	struct uart_config cfg;
+
+	/* Transfer in flight, tx_len is 0 when there is none */
+	const uint8_t *tx_buf;
+	size_t tx_len;
+	size_t tx_sent;
+	uint64_t tx_start_us;
+	/* When the last byte queued on the wire will have left it */
+	uint64_t wire_free_us;
+	bool tx_abort;
+
+	uint8_t *rx_buf;
+	size_t rx_len;
+	size_t rx_off;
+	/* Bytes of rx_buf reported with UART_RX_RDY */
+	size_t rx_rdy;
+	uint8_t *rx_next;
+	size_t rx_next_len;
+	int32_t rx_timeout_us;
+	uint64_t rx_last_us;
+	bool rx_enabled;
+	bool rx_request;
+	bool rx_disable;
+};
+
+static uint64_t now_us(void)
+{
+	return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+static uint64_t wire_us(const struct loopback_emul_data *data, size_t len)
+{
+	return (uint64_t)len * CHAR_BITS * USEC_PER_SEC / MAX(data->cfg.baudrate, 1);
+}
+
+static void emul_raise(const struct device *dev, struct uart_event *evt)
+{
+	struct loopback_emul_data *data = dev->data;
+
+	if (data->callback) {
+		data->callback(dev, evt, data->user_data);
+	}
+}
+
+/* With @p data locked, or from the timer handler */
+static void emul_kick(struct loopback_emul_data *data)
+{
+	if (!data->ticking) {
+		data->ticking = true;
+		k_timer_start(&data->tick, K_USEC(CONFIG_UART_LOOPBACK_EMUL_TICK_US),
+			      K_USEC(CONFIG_UART_LOOPBACK_EMUL_TICK_US));
+	}
+}
+
+static void rx_report(const struct device *dev)
+{
+	struct loopback_emul_data *data = dev->data;
+	struct uart_event evt = { .type = UART_RX_RDY };
+
+	if (data->rx_off == data->rx_rdy) {
+		return;
+	}
+
+	evt.data.rx.buf = data->rx_buf;
+	evt.data.rx.offset = data->rx_rdy;
+	evt.data.rx.len = data->rx_off - data->rx_rdy;
+	data->rx_rdy = data->rx_off;
+	emul_raise(dev, &evt);
+}
+
+static void rx_release(const struct device *dev, uint8_t *buf)
+{
+	struct uart_event evt = { .type = UART_RX_BUF_RELEASED };
+
+	evt.data.rx_buf.buf = buf;
+	emul_raise(dev, &evt);
+}
+
+/* Flush, release both buffers and end RX */
+static void rx_finish(const struct device *dev)
+{
+	struct loopback_emul_data *data = dev->data;
+	struct uart_event evt = { .type = UART_RX_DISABLED };
+	uint8_t *next = data->rx_next;
+
+	rx_report(dev);
+	data->rx_enabled = false;
+	data->rx_disable = false;
+	data->rx_next = NULL;
+	rx_release(dev, data->rx_buf);
+	if (next) {
+		rx_release(dev, next);
+	}
+
+	emul_raise(dev, &evt);
+}
+
+/* Current buffer full, go on in the next one or stop */
+static void rx_switch(const struct device *dev)
+{
+	struct loopback_emul_data *data = dev->data;
+	struct uart_event evt = { .type = UART_RX_DISABLED };
+	uint8_t *full = data->rx_buf;
+
+	rx_report(dev);
+
+	if (!data->rx_next) {
+		data->rx_enabled = false;
+		rx_release(dev, full);
+		emul_raise(dev, &evt);
+		return;
+	}
+
+	data->rx_buf = data->rx_next;
+	data->rx_len = data->rx_next_len;
+	data->rx_off = 0;
+	data->rx_rdy = 0;
+	data->rx_next = NULL;
+	rx_release(dev, full);
+
+	evt.type = UART_RX_BUF_REQUEST;
+	emul_raise(dev, &evt);
+}
+
+static void rx_put(const struct device *dev, const uint8_t *src, size_t len, uint64_t now)
+{
+	struct loopback_emul_data *data = dev->data;
+
+	while (len && data->rx_enabled) {
+		size_t n = MIN(len, data->rx_len - data->rx_off);
+
+		memcpy(&data->rx_buf[data->rx_off], src, n);
+		data->rx_off += n;
+		data->rx_last_us = now;
+		src += n;
+		len -= n;
+
+		if (data->rx_off == data->rx_len) {
+			rx_switch(dev);
+		}
+	}
+}
+
+static void emul_tick(struct k_timer *timer)
+{
+	struct loopback_emul_data *data = CONTAINER_OF(timer, struct loopback_emul_data, tick);
+	const struct device *dev = k_timer_user_data_get(timer);
+	uint64_t now = now_us();
+
+	if (data->rx_request) {
+		struct uart_event evt = { .type = UART_RX_BUF_REQUEST };
+
+		data->rx_request = false;
+		emul_raise(dev, &evt);
+	}
+
+	if (data->tx_len) {
+		size_t due = 0;
+
+		if (now > data->tx_start_us) {
+			due = (now - data->tx_start_us) * data->cfg.baudrate /
+			      (CHAR_BITS * USEC_PER_SEC);
+		}
+		due = MIN(due, data->tx_len);
+
+		if (data->tx_abort) {
+			due = data->tx_sent;
+		}
+
+		rx_put(dev, &data->tx_buf[data->tx_sent], due - data->tx_sent, now);
+		data->tx_sent = due;
+
+		if (data->tx_sent == data->tx_len || data->tx_abort) {
+			struct uart_event evt = {
+				.type = data->tx_abort ? UART_TX_ABORTED : UART_TX_DONE,
+			};
+
+			evt.data.tx.buf = data->tx_buf;
+			evt.data.tx.len = data->tx_sent;
+			if (data->tx_abort) {
+				data->wire_free_us = now;
+			}
+			data->tx_len = 0;
+			data->tx_abort = false;
+			/* May start the next transfer */
+			emul_raise(dev, &evt);
+		}
+	}
+
+	if (data->rx_disable) {
+		rx_finish(dev);
+	} else if (data->rx_enabled && data->rx_off > data->rx_rdy &&
+		   data->rx_timeout_us != SYS_FOREVER_US &&
+		   now - data->rx_last_us >= data->rx_timeout_us) {
+		rx_report(dev);
+	}
+
+	if (!data->tx_len && !data->rx_request && !data->rx_disable &&
+	    !(data->rx_enabled && data->rx_off > data->rx_rdy)) {
+		data->ticking = false;
+		k_timer_stop(timer);
+	}
+}
+
+static int emul_callback_set(const struct device *dev, uart_callback_t callback,
+			     void *user_data)
+{
+	struct loopback_emul_data *data = dev->data;
+
+	data->callback = callback;
+	data->user_data = user_data;
+
+	return 0;
+}
+
+static int emul_tx(const struct device *dev, const uint8_t *buf, size_t len, int32_t timeout)
+{
+	struct loopback_emul_data *data = dev->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	if (data->tx_len) {
+		k_spin_unlock(&data->lock, key);
+		return -EBUSY;
+	}
+
+	if (len == 0) {
+		k_spin_unlock(&data->lock, key);
+		return -EINVAL;
+	}
+
+	data->tx_buf = buf;
+	data->tx_len = len;
+	data->tx_sent = 0;
+	data->tx_start_us = MAX(now_us(), data->wire_free_us);
+	data->wire_free_us = data->tx_start_us + wire_us(data, len);
+	emul_kick(data);
+
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+static int emul_tx_abort(const struct device *dev)
+{
+	struct loopback_emul_data *data = dev->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	int err = 0;
+
+	if (data->tx_len) {
+		data->tx_abort = true;
+	} else {
+		err = -EFAULT;
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	return err;
+}
+
+static int emul_rx_enable(const struct device *dev, uint8_t *buf, size_t len, int32_t timeout)
+{
+	struct loopback_emul_data *data = dev->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+
+	if (data->rx_enabled) {
+		k_spin_unlock(&data->lock, key);
+		return -EBUSY;
+	}
+
+	data->rx_buf = buf;
+	data->rx_len = len;
+	data->rx_off = 0;
+	data->rx_rdy = 0;
+	data->rx_next = NULL;
+	data->rx_timeout_us = timeout;
+	data->rx_enabled = true;
+	data->rx_request = true;
+	emul_kick(data);
+
+	k_spin_unlock(&data->lock, key);
+
+	return 0;
+}
+
+static int emul_rx_buf_rsp(const struct device *dev, uint8_t *buf, size_t len)
+{
+	struct loopback_emul_data *data = dev->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	int err = 0;
+
+	if (!data->rx_enabled || data->rx_disable) {
+		err = -EACCES;
+	} else if (data->rx_next) {
+		err = -EBUSY;
+	} else {
+		data->rx_next = buf;
+		data->rx_next_len = len;
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	return err;
+}
+
+static int emul_rx_disable(const struct device *dev)
+{
+	struct loopback_emul_data *data = dev->data;
+	k_spinlock_key_t key = k_spin_lock(&data->lock);
+	int err = 0;
+
+	if (!data->rx_enabled || data->rx_disable) {
+		err = -EFAULT;
+	} else {
+		data->rx_disable = true;
+		emul_kick(data);
+	}
+
+	k_spin_unlock(&data->lock, key);
+
+	return err;
+}
+
+static int emul_poll_in(const struct device *dev, unsigned char *c)
+{
+	return -1;
+}
+
+static void emul_poll_out(const struct device *dev, unsigned char c)
+{
+}
+
+#if defined(CONFIG_UART_USE_RUNTIME_CONFIGURE)
+static int emul_configure(const struct device *dev, const struct uart_config *cfg)
+{
+	struct loopback_emul_data *data = dev->data;
+
+	if (cfg->baudrate == 0 || cfg->flow_ctrl != UART_CFG_FLOW_CTRL_NONE) {
+		return -ENOTSUP;
+	}
+
+	data->cfg = *cfg;
+
+	return 0;
+}
+
+static int emul_config_get(const struct device *dev, struct uart_config *cfg)
+{
+	struct loopback_emul_data *data = dev->data;
+
+	*cfg = data->cfg;
+
+	return 0;
+}
+#endif
+
+static const struct uart_driver_api loopback_emul_api = {
+	.callback_set = emul_callback_set,
+	.tx = emul_tx,
+	.tx_abort = emul_tx_abort,
+	.rx_enable = emul_rx_enable,
+	.rx_buf_rsp = emul_rx_buf_rsp,
+	.rx_disable = emul_rx_disable,
+	.poll_in = emul_poll_in,
+	.poll_out = emul_poll_out,
+#if defined(CONFIG_UART_USE_RUNTIME_CONFIGURE)
+	.configure = emul_configure,
+	.config_get = emul_config_get,
+#endif
+};
+
+static int loopback_emul_init(const struct device *dev)
+{
+	struct loopback_emul_data *data = dev->data;
+
+	k_timer_init(&data->tick, emul_tick, NULL);
+	k_timer_user_data_set(&data->tick, (void *)dev);
+
+	return 0;
+}
+
+#define LOOPBACK_EMUL_DEFINE(n)							\
+	static struct loopback_emul_data loopback_emul_data_##n = {		\
+		.cfg = {							\
+			.baudrate = DT_INST_PROP(n, current_speed),		\
+			.parity = UART_CFG_PARITY_NONE,				\
+			.stop_bits = UART_CFG_STOP_BITS_1,			\
+			.data_bits = UART_CFG_DATA_BITS_8,			\
+			.flow_ctrl = UART_CFG_FLOW_CTRL_NONE,			\
+		},								\
+	};									\
+	DEVICE_DT_INST_DEFINE(n, loopback_emul_init, NULL,			\
+			      &loopback_emul_data_##n, NULL, PRE_KERNEL_1,	\
+			      CONFIG_SERIAL_INIT_PRIORITY, &loopback_emul_api);
+
+DT_INST_FOREACH_STATUS_OKAY(LOOPBACK_EMUL_DEFINE)
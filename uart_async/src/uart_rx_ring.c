@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+	Zero-copy RX ring.
+
+	The driver calls back with UART_RX_RDY from interrupt context, and may
+	do so again before the consumer thread has run. Each event is
+	therefore stored as (buffer, offset, len) in a single producer, single
+	consumer ring: only the callback moves the head and only the consumer
+	moves the tail, so neither side takes a lock. The counting semaphore
+	wakes the consumer once per event.
+
+	A slab buffer is referenced by the driver, from the time it is handed
+	out until UART_RX_BUF_RELEASED, and by every queued chunk of it. It
+	goes back to the slab when the last of them lets go, so the consumer
+	never reads a buffer the driver has already reused.
+
+	Sizing. The slab is laid out over CONFIG_UART_RX_RING_POOL_SIZE bytes
+	when RX starts, with buffers that hold CONFIG_UART_RX_RING_FILL_US of
+	line time at the baud rate of the UART: many small buffers at low
+	rates, so a chunk held by the consumer pins little memory, and fewer
+	larger ones at high rates, so the driver does not ask for a buffer
+	every few bytes. The inactivity timeout starts at
+	CONFIG_UART_RX_RING_TIMEOUT_CHARS character times, short enough that
+	a short message is not held back.
+
+	Traffic. When timeout flushes come faster than the consumer takes
+	them, and fill half the ring, the timeout doubles, up to the fill time
+	of a buffer, so a bursty line gives fewer, larger chunks. After
+	CONFIG_UART_RX_RING_CALM_FLUSHES flushes that found the ring empty it
+	halves again, down to the start value. The driver takes the timeout
+	only when RX is enabled, so once the new one differs from the one in
+	use by more than CONFIG_UART_RX_RING_TIMEOUT_HYSTERESIS percent, RX
+	is disabled and enabled again with it (a retime). That happens right
+	after a timeout flush, when the line has just been idle for a
+	timeout, and RX is enabled again from the UART_RX_DISABLED callback.
+	A byte that still arrives in between is lost unless hardware flow
+	control holds the sender, so retimes are counted.
+
+	When the consumer holds all buffers the driver gets no new one,
+	finishes the current one and disables RX. This is counted as
+	starvation, and RX restarts as soon as a buffer is back. RX also
+	restarts after a line error.
+
+	The counters are written from the callback and from the threads that
+	release chunks, under stats_lock.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <drivers/uart.h>
+
+#include "uart_rx_ring.h"
+
+#define RING_MASK (CONFIG_UART_RX_RING_DEPTH - 1)
+
+#define BUF_COUNT_MAX (CONFIG_UART_RX_RING_POOL_SIZE / CONFIG_UART_RX_RING_BUF_MIN)
+
+/* 10 bits a character, with start and stop bits */
+#define CHAR_BITS 10
+
+BUILD_ASSERT((CONFIG_UART_RX_RING_DEPTH & RING_MASK) == 0,
+	     "CONFIG_UART_RX_RING_DEPTH must be a power of two");
+BUILD_ASSERT(CONFIG_UART_RX_RING_POOL_SIZE >= 3 * CONFIG_UART_RX_RING_BUF_MAX,
+	     "The pool must hold three of the largest buffers");
+
+static uint8_t __aligned(4) pool_mem[CONFIG_UART_RX_RING_POOL_SIZE];
+static struct k_mem_slab rx_slab;
+static atomic_t buf_refs[BUF_COUNT_MAX];
+static size_t buf_len;
+
+static struct uart_rx_chunk ring[CONFIG_UART_RX_RING_DEPTH];
+static atomic_t ring_head;
+static atomic_t ring_tail;
+static K_SEM_DEFINE(ring_sem, 0, CONFIG_UART_RX_RING_DEPTH);
+
+static const struct device *ring_dev;
+static atomic_t started;
+/* uart_rx_ring_stop() waits for UART_RX_DISABLED, no restart */
+static atomic_t stopping;
+static K_SEM_DEFINE(stop_sem, 0, 1);
+/* RX is disabled and waits for a buffer to come back */
+static atomic_t stalled;
+
+static uint32_t timeout_us;
+static uint32_t timeout_min_us;
+static uint32_t timeout_max_us;
+static uint32_t timeout_target_us;
+static uint32_t calm_flushes;
+/* RX is being disabled to take timeout_target_us */
+static atomic_t retiming;
+
+static struct uart_rx_ring_stats stats;
+static struct k_spinlock stats_lock;
+
+static atomic_t *buf_ref(uint8_t *buf)
+{
+	return &buf_refs[(buf - pool_mem) / buf_len];
+}
+
+static uint8_t *buf_alloc(void)
+{
+	uint8_t *buf;
+
+	if (k_mem_slab_alloc(&rx_slab, (void **)&buf, K_NO_WAIT)) {
+		return NULL;
+	}
+
+	/* The driver's reference */
+	atomic_set(buf_ref(buf), 1);
+
+	return buf;
+}
+
+static void rx_restart(void);
+
+static void stats_inc(uint32_t *counter)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	(*counter)++;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+static void buf_unref(uint8_t *buf)
+{
+	if (atomic_dec(buf_ref(buf)) != 1) {
+		return;
+	}
+
+	k_mem_slab_free(&rx_slab, (void **)&buf);
+
+	if (atomic_cas(&stalled, true, false)) {
+		rx_restart();
+	}
+}
+
+static void rx_restart(void)
+{
+	uint8_t *buf = buf_alloc();
+	k_spinlock_key_t key;
+	int err;
+
+	if (!buf) {
+		atomic_set(&stalled, true);
+		return;
+	}
+
+	key = k_spin_lock(&stats_lock);
+	timeout_us = timeout_target_us;
+	stats.timeout_us = timeout_us;
+	k_spin_unlock(&stats_lock, key);
+
+	err = uart_rx_enable(ring_dev, buf, buf_len, timeout_us);
+
+	key = k_spin_lock(&stats_lock);
+	if (err) {
+		stats.errors++;
+	} else {
+		stats.restarts++;
+	}
+	k_spin_unlock(&stats_lock, key);
+
+	if (err) {
+		buf_unref(buf);
+	}
+}
+
+/* Producer side, from the UART callback */
+static void ring_put(struct uart_rx_chunk *chunk)
+{
+	atomic_val_t head = atomic_get(&ring_head);
+	atomic_val_t queued = head - atomic_get(&ring_tail);
+	k_spinlock_key_t key;
+
+	if (queued == CONFIG_UART_RX_RING_DEPTH) {
+		key = k_spin_lock(&stats_lock);
+		stats.lost += chunk->len;
+		k_spin_unlock(&stats_lock, key);
+		return;
+	}
+
+	atomic_inc(buf_ref(chunk->buf));
+	ring[head & RING_MASK] = *chunk;
+	/* Publishes the entry, atomic_set() is a full barrier */
+	atomic_set(&ring_head, head + 1);
+
+	key = k_spin_lock(&stats_lock);
+	stats.chunks++;
+	stats.bytes += chunk->len;
+	stats.queued_max = MAX(stats.queued_max, queued + 1);
+	k_spin_unlock(&stats_lock, key);
+
+	k_sem_give(&ring_sem);
+}
+
+/* A chunk that ends before its buffer does was flushed by the timeout.
+ * The new timeout is taken by rx_restart(), after a retime if it moved
+ * far enough from the one in use.
+ */
+static void timeout_flushed(void)
+{
+	atomic_val_t queued = atomic_get(&ring_head) - atomic_get(&ring_tail);
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	uint32_t diff;
+	bool retime;
+
+	stats.timeout_flushes++;
+
+	if (IS_ENABLED(CONFIG_UART_RX_RING_ADAPTIVE_TIMEOUT)) {
+		if (queued >= CONFIG_UART_RX_RING_DEPTH / 2) {
+			calm_flushes = 0;
+			timeout_target_us = MIN(timeout_target_us * 2, timeout_max_us);
+		} else if (queued <= 1 && ++calm_flushes >= CONFIG_UART_RX_RING_CALM_FLUSHES) {
+			calm_flushes = 0;
+			timeout_target_us = MAX(timeout_target_us / 2, timeout_min_us);
+		}
+	}
+
+	diff = timeout_target_us > timeout_us ? timeout_target_us - timeout_us :
+						timeout_us - timeout_target_us;
+	retime = (uint64_t)diff * 100 > (uint64_t)timeout_us * CONFIG_UART_RX_RING_TIMEOUT_HYSTERESIS;
+
+	k_spin_unlock(&stats_lock, key);
+
+	if (!retime || atomic_get(&stopping) || !atomic_cas(&retiming, false, true)) {
+		return;
+	}
+
+	if (uart_rx_disable(ring_dev)) {
+		/* Already being disabled, the restart takes the timeout anyway */
+		atomic_set(&retiming, false);
+		return;
+	}
+
+	stats_inc(&stats.retimes);
+}
+
+void uart_rx_ring_event(const struct device *dev, struct uart_event *evt)
+{
+	struct uart_rx_chunk chunk;
+	uint8_t *buf;
+	int err;
+
+	switch (evt->type) {
+	case UART_RX_RDY:
+		chunk.buf = evt->data.rx.buf;
+		chunk.offset = evt->data.rx.offset;
+		chunk.len = evt->data.rx.len;
+		chunk.cycles = k_cycle_get_32();
+		ring_put(&chunk);
+
+		if (chunk.offset + chunk.len < buf_len) {
+			timeout_flushed();
+		}
+		break;
+	case UART_RX_BUF_REQUEST:
+		buf = buf_alloc();
+		if (!buf) {
+			/* The driver disables RX once the current buffer is full */
+			stats_inc(&stats.starved);
+			break;
+		}
+
+		err = uart_rx_buf_rsp(dev, buf, buf_len);
+		if (err) {
+			buf_unref(buf);
+		}
+		break;
+	case UART_RX_BUF_RELEASED:
+		buf_unref(evt->data.rx_buf.buf);
+		break;
+	case UART_RX_STOPPED:
+		stats_inc(&stats.errors);
+		break;
+	case UART_RX_DISABLED:
+		atomic_set(&retiming, false);
+		if (atomic_get(&stopping)) {
+			k_sem_give(&stop_sem);
+		} else {
+			rx_restart();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static uint32_t baudrate_get(const struct device *dev)
+{
+	struct uart_config cfg;
+
+	if (uart_config_get(dev, &cfg) || cfg.baudrate == 0) {
+		return CONFIG_UART_RX_RING_BAUDRATE;
+	}
+
+	return cfg.baudrate;
+}
+
+/* Lay the slab out and pick the timeouts for @p baudrate */
+static int pool_size(uint32_t baudrate, uint32_t fill_us)
+{
+	uint32_t bytes_per_sec = baudrate / CHAR_BITS;
+
+	buf_len = (uint64_t)bytes_per_sec * fill_us / USEC_PER_SEC;
+	buf_len = ROUND_UP(buf_len, sizeof(void *));
+	buf_len = CLAMP(buf_len, CONFIG_UART_RX_RING_BUF_MIN, CONFIG_UART_RX_RING_BUF_MAX);
+
+	fill_us = (uint64_t)buf_len * USEC_PER_SEC / MAX(bytes_per_sec, 1);
+
+	timeout_min_us = DIV_ROUND_UP((uint64_t)CONFIG_UART_RX_RING_TIMEOUT_CHARS * CHAR_BITS *
+				      USEC_PER_SEC, baudrate);
+	timeout_max_us = MAX(fill_us, timeout_min_us);
+	timeout_us = timeout_target_us = timeout_min_us;
+
+	stats.baudrate = baudrate;
+	stats.buf_len = buf_len;
+	stats.buf_count = sizeof(pool_mem) / buf_len;
+	stats.timeout_us = timeout_us;
+
+	return k_mem_slab_init(&rx_slab, pool_mem, buf_len, stats.buf_count);
+}
+
+int uart_rx_ring_start(const struct device *dev, uint32_t fill_us)
+{
+	uint8_t *buf;
+	int err;
+
+	if (!atomic_cas(&started, false, true)) {
+		return -EALREADY;
+	}
+
+	/* The pool is laid out again, nothing may point into it */
+	if ((rx_slab.num_blocks && k_mem_slab_num_used_get(&rx_slab)) ||
+	    atomic_get(&ring_head) != atomic_get(&ring_tail)) {
+		atomic_set(&started, false);
+		return -EBUSY;
+	}
+
+	ring_dev = dev;
+
+	err = pool_size(baudrate_get(dev), fill_us ? fill_us : CONFIG_UART_RX_RING_FILL_US);
+	if (err) {
+		atomic_set(&started, false);
+		return err;
+	}
+
+	/* The pool is fresh, it has a buffer */
+	buf = buf_alloc();
+	err = uart_rx_enable(dev, buf, buf_len, timeout_us);
+	if (err) {
+		buf_unref(buf);
+		atomic_set(&started, false);
+	}
+
+	return err;
+}
+
+int uart_rx_ring_stop(k_timeout_t timeout)
+{
+	int err = 0;
+
+	if (!atomic_get(&started)) {
+		return -EALREADY;
+	}
+
+	k_sem_reset(&stop_sem);
+	atomic_set(&stopping, true);
+
+	/* A stalled RX is already disabled, otherwise wait for the driver
+	 * to flush and release its buffers.
+	 */
+	if (!atomic_cas(&stalled, true, false)) {
+		uart_rx_disable(ring_dev);
+		if (k_sem_take(&stop_sem, timeout)) {
+			err = -EAGAIN;
+		}
+	}
+
+	atomic_set(&stopping, false);
+	atomic_set(&started, false);
+
+	return err;
+}
+
+int uart_rx_ring_get(struct uart_rx_chunk *chunk, k_timeout_t timeout)
+{
+	atomic_val_t tail;
+
+	if (k_sem_take(&ring_sem, timeout)) {
+		return -EAGAIN;
+	}
+
+	tail = atomic_get(&ring_tail);
+	*chunk = ring[tail & RING_MASK];
+	/* Frees the entry for the producer only after it has been read */
+	atomic_set(&ring_tail, tail + 1);
+
+	return 0;
+}
+
+void uart_rx_ring_release(const struct uart_rx_chunk *chunk)
+{
+	buf_unref(chunk->buf);
+}
+
+uint32_t uart_rx_ring_free(void)
+{
+	return rx_slab.num_blocks ? k_mem_slab_num_free_get(&rx_slab) : 0;
+}
+
+void uart_rx_ring_stats_get(struct uart_rx_ring_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+void uart_rx_ring_stats_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.chunks = 0;
+	stats.bytes = 0;
+	stats.lost = 0;
+	stats.queued_max = 0;
+	stats.errors = 0;
+	stats.starved = 0;
+	stats.timeout_flushes = 0;
+	stats.restarts = 0;
+	stats.retimes = 0;
+
+	k_spin_unlock(&stats_lock, key);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Zero-copy RX ring on top of the UART async API
+ */
+
+#ifndef UART_RX_RING_H_
+#define UART_RX_RING_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <kernel.h>
+#include <device.h>
+#include <drivers/uart.h>
+
+/** @brief Bytes of one UART_RX_RDY event, owned by the consumer between
+ *  uart_rx_ring_get() and uart_rx_ring_release().
+ */
+struct uart_rx_chunk
+{
+	/** Slab buffer the driver received into. */
+	uint8_t *buf;
+	/** Offset of the first new byte in @p buf. */
+	uint16_t offset;
+	/** Number of new bytes. */
+	uint16_t len;
+	/** k_cycle_get_32() at the UART_RX_RDY event. */
+	uint32_t cycles;
+};
+
+/** @brief RX ring counters. */
+struct uart_rx_ring_stats
+{
+	/** UART_RX_RDY events queued. */
+	uint32_t chunks;
+	/** Bytes queued. */
+	uint32_t bytes;
+	/** Bytes of events dropped because the ring was full. */
+	uint32_t lost;
+	/** Most events ever waiting for the consumer. */
+	uint32_t queued_max;
+	/** Times the driver stopped receiving on a line error. */
+	uint32_t errors;
+	/** Times the driver asked for a buffer while the consumer held them
+	 *  all. RX stops after the current buffer until one comes back.
+	 */
+	uint32_t starved;
+	/** Chunks flushed by the inactivity timeout before their buffer
+	 *  was full.
+	 */
+	uint32_t timeout_flushes;
+	/** Times RX was enabled again, after starvation, a line error or a
+	 *  retime.
+	 */
+	uint32_t restarts;
+	/** Times RX was disabled to take a new inactivity timeout. A byte
+	 *  arriving before it is enabled again is lost without flow control.
+	 */
+	uint32_t retimes;
+	/** Baud rate the pool was sized for. */
+	uint32_t baudrate;
+	/** Length of each buffer. */
+	uint32_t buf_len;
+	/** Buffers in the pool. */
+	uint32_t buf_count;
+	/** Inactivity timeout RX was last enabled with. */
+	uint32_t timeout_us;
+};
+
+/** @brief Start receiving on @p dev.
+ *
+ *  The UART callback must pass RX events to uart_rx_ring_event(). The
+ *  buffer pool and the inactivity timeout are sized for the baud rate
+ *  @p dev reports, or CONFIG_UART_RX_RING_BAUDRATE if it can't.
+ *
+ *  @param fill_us Line time one buffer holds, 0 for
+ *                 CONFIG_UART_RX_RING_FILL_US.
+ *
+ *  @return 0 on success, -EALREADY if already started, -EBUSY if chunks
+ *          of an earlier run are still queued or held, or the error of
+ *          k_mem_slab_init() or uart_rx_enable().
+ */
+int uart_rx_ring_start(const struct device *dev, uint32_t fill_us);
+
+/** @brief Disable RX and wait until the driver has let go of its buffers.
+ *
+ *  The chunks still queued have to be taken and released before the
+ *  ring can start again.
+ *
+ *  @return 0 on success, -EALREADY if not started, -EAGAIN on timeout.
+ */
+int uart_rx_ring_stop(k_timeout_t timeout);
+
+/** @brief Pass the UART_RX_* events to the ring. */
+void uart_rx_ring_event(const struct device *dev, struct uart_event *evt);
+
+/** @brief Wait for the next chunk.
+ *
+ *  @return 0 on success, -EAGAIN on timeout.
+ */
+int uart_rx_ring_get(struct uart_rx_chunk *chunk, k_timeout_t timeout);
+
+/** @brief Done with a chunk from uart_rx_ring_get().
+ *
+ *  Its buffer goes back to the slab once the driver has released it
+ *  and no other chunk of it is held.
+ */
+void uart_rx_ring_release(const struct uart_rx_chunk *chunk);
+
+/** @brief Buffers of the pool neither with the driver nor held by a chunk. */
+uint32_t uart_rx_ring_free(void);
+
+void uart_rx_ring_stats_get(struct uart_rx_ring_stats *stats);
+
+/** @brief Zero the counters, the sizing fields are kept. */
+void uart_rx_ring_stats_reset(void);
+
+#endif /* UART_RX_RING_H_ */
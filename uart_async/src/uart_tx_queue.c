@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+	Non-blocking TX queue.
+
+	uart_tx() takes one buffer at a time and fails while a transfer is in
+	flight, so a caller that logs through it either waits or loses data.
+	Here callers only queue a descriptor (buffer, len) and return; the
+	UART_TX_DONE of one transfer starts the next one right from the
+	interrupt, so the line does not go idle while anything is queued.
+
+	Short writes are copied to a staging ring. A write that lands right
+	after the last queued staged transfer, which is not in flight yet, is
+	appended to it, so a burst of small log lines goes out as one DMA
+	transfer of up to CONFIG_UART_TX_QUEUE_MERGE_MAX bytes. Larger
+	buffers can be queued without copying with uart_tx_queue_send(), and
+	are handed back through their done callback. Transfers complete in
+	order, so the staging ring is freed from its tail.
+	uart_tx_queue_send_first() puts a buffer behind the transfer in
+	flight and the earlier ones queued that way, for flow control
+	characters. The staging ring only counts its used bytes, so that
+	order change does not matter to it.
+
+	The descriptors and the staging ring are shared by all callers and
+	the interrupt, under tx_lock, which is never held across uart_tx().
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <drivers/uart.h>
+
+#include "uart_tx_queue.h"
+
+struct uart_tx_desc {
+	const uint8_t *buf;
+	size_t len;
+	/* Copied to the staging ring, done is NULL */
+	bool staged;
+	/* Queued with uart_tx_queue_send_first() */
+	bool first;
+	uart_tx_queue_done_t done;
+	void *user_data;
+};
+
+static const struct device *tx_dev;
+static uint32_t tx_baudrate;
+
+static struct k_spinlock tx_lock;
+static struct uart_tx_desc descs[CONFIG_UART_TX_QUEUE_DEPTH];
+static size_t desc_tail;
+static size_t desc_count;
+/* descs[desc_tail] is in flight */
+static bool tx_busy;
+/* Descriptors of uart_tx_queue_send_first() waiting right behind it */
+static size_t first_count;
+
+static uint8_t stage[CONFIG_UART_TX_QUEUE_STAGE_SIZE];
+static size_t stage_head;
+static size_t stage_used;
+
+/* Given when the queue drains, and when a transfer is aborted */
+static K_SEM_DEFINE(tx_done, 0, 1);
+static K_SEM_DEFINE(tx_aborted, 0, 1);
+
+static struct uart_tx_queue_stats stats;
+static uint32_t tx_start_cycles;
+static uint64_t busy_cycles;
+static int64_t period_start_ms;
+
+int uart_tx_queue_init(const struct device *dev)
+{
+	struct uart_config cfg;
+
+	if (tx_dev) {
+		return -EALREADY;
+	}
+
+	tx_baudrate = uart_config_get(dev, &cfg) ? 0 : cfg.baudrate;
+	period_start_ms = k_uptime_get();
+	tx_dev = dev;
+
+	return 0;
+}
+
+static struct uart_tx_desc *desc_last(void)
+{
+	return desc_count ? &descs[(desc_tail + desc_count - 1) % ARRAY_SIZE(descs)] : NULL;
+}
+
+static struct uart_tx_desc *desc_push(void)
+{
+	struct uart_tx_desc *desc;
+
+	if (desc_count == ARRAY_SIZE(descs)) {
+		return NULL;
+	}
+
+	desc = &descs[(desc_tail + desc_count) % ARRAY_SIZE(descs)];
+	desc_count++;
+	stats.queued_max = MAX(stats.queued_max, desc_count);
+
+	return desc;
+}
+
+/* Retire the transfer in flight after @p len of its bytes went out */
+static void tx_complete(size_t len, int err)
+{
+	struct uart_tx_desc desc;
+	k_spinlock_key_t key;
+	bool drained;
+
+	key = k_spin_lock(&tx_lock);
+
+	desc = descs[desc_tail];
+	desc_tail = (desc_tail + 1) % ARRAY_SIZE(descs);
+	desc_count--;
+	if (desc.staged) {
+		stage_used -= desc.len;
+	}
+
+	tx_busy = false;
+	busy_cycles += k_cycle_get_32() - tx_start_cycles;
+	stats.bytes += len;
+	if (err) {
+		stats.aborted++;
+	}
+	drained = desc_count == 0;
+
+	k_spin_unlock(&tx_lock, key);
+
+	if (desc.done) {
+		desc.done(desc.buf, desc.len, err, desc.user_data);
+	}
+
+	if (err) {
+		k_sem_give(&tx_aborted);
+	}
+	if (drained) {
+		k_sem_give(&tx_done);
+	}
+}
+
+/* Start the oldest transfer unless one is in flight, skipping the ones
+ * the driver refuses.
+ */
+static void tx_start_next(void)
+{
+	struct uart_tx_desc *desc;
+	k_spinlock_key_t key;
+	int err;
+
+	do {
+		key = k_spin_lock(&tx_lock);
+
+		if (tx_busy || desc_count == 0) {
+			k_spin_unlock(&tx_lock, key);
+			return;
+		}
+
+		/* Seals the descriptor, writes no longer append to it */
+		desc = &descs[desc_tail];
+		if (desc->first) {
+			first_count--;
+		}
+		tx_busy = true;
+		tx_start_cycles = k_cycle_get_32();
+		stats.transfers++;
+
+		k_spin_unlock(&tx_lock, key);
+
+		err = uart_tx(tx_dev, desc->buf, desc->len, SYS_FOREVER_US);
+		if (err) {
+			tx_complete(0, -ECANCELED);
+		}
+	} while (err);
+}
+
+/* Copy @p len bytes, which fit in one piece, to the staging ring */
+static void stage_put(const uint8_t *data, size_t len)
+{
+	struct uart_tx_desc *last = desc_last();
+	uint8_t *dst = &stage[stage_head];
+
+	memcpy(dst, data, len);
+	stage_head = (stage_head + len) % sizeof(stage);
+	stage_used += len;
+	stats.staged_max = MAX(stats.staged_max, stage_used);
+
+	if (last && last->staged && last->buf + last->len == dst &&
+	    last->len + len <= CONFIG_UART_TX_QUEUE_MERGE_MAX &&
+	    !(tx_busy && last == &descs[desc_tail])) {
+		last->len += len;
+		stats.coalesced++;
+		return;
+	}
+
+	/* Room was checked by the caller */
+	last = desc_push();
+	last->buf = dst;
+	last->len = len;
+	last->staged = true;
+	last->first = false;
+	last->done = NULL;
+	last->user_data = NULL;
+}
+
+int uart_tx_queue_write(const uint8_t *data, size_t len)
+{
+	k_spinlock_key_t key;
+	size_t first;
+	size_t descs_needed;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	key = k_spin_lock(&tx_lock);
+
+	/* At most two pieces when the write wraps, and a piece may need a
+	 * descriptor of its own.
+	 */
+	first = MIN(len, sizeof(stage) - stage_head);
+	descs_needed = (first < len) ? 2 : 1;
+
+	if (len > sizeof(stage) - stage_used ||
+	    desc_count + descs_needed > ARRAY_SIZE(descs)) {
+		stats.rejected++;
+		k_spin_unlock(&tx_lock, key);
+		return -ENOMEM;
+	}
+
+	stage_put(data, first);
+	if (first < len) {
+		stage_put(data + first, len - first);
+	}
+	stats.writes++;
+
+	k_spin_unlock(&tx_lock, key);
+
+	tx_start_next();
+
+	return 0;
+}
+
+int uart_tx_queue_send(const uint8_t *buf, size_t len, uart_tx_queue_done_t done,
+		       void *user_data)
+{
+	struct uart_tx_desc *desc;
+	k_spinlock_key_t key;
+
+	key = k_spin_lock(&tx_lock);
+
+	desc = desc_push();
+	if (!desc) {
+		stats.rejected++;
+		k_spin_unlock(&tx_lock, key);
+		return -ENOMEM;
+	}
+
+	desc->buf = buf;
+	desc->len = len;
+	desc->staged = false;
+	desc->first = false;
+	desc->done = done;
+	desc->user_data = user_data;
+	stats.sends++;
+
+	k_spin_unlock(&tx_lock, key);
+
+	tx_start_next();
+
+	return 0;
+}
+
+int uart_tx_queue_send_first(const uint8_t *buf, size_t len, uart_tx_queue_done_t done,
+			     void *user_data)
+{
+	struct uart_tx_desc *desc;
+	k_spinlock_key_t key;
+	size_t pos;
+
+	key = k_spin_lock(&tx_lock);
+
+	if (desc_count == ARRAY_SIZE(descs)) {
+		stats.rejected++;
+		k_spin_unlock(&tx_lock, key);
+		return -ENOMEM;
+	}
+
+	/* Behind the one in flight and the earlier ones sent first, the
+	 * rest move up one slot.
+	 */
+	pos = (tx_busy ? 1 : 0) + first_count;
+	for (size_t i = desc_count; i > pos; i--) {
+		descs[(desc_tail + i) % ARRAY_SIZE(descs)] =
+			descs[(desc_tail + i - 1) % ARRAY_SIZE(descs)];
+	}
+	desc_count++;
+	first_count++;
+	stats.queued_max = MAX(stats.queued_max, desc_count);
+
+	desc = &descs[(desc_tail + pos) % ARRAY_SIZE(descs)];
+	desc->buf = buf;
+	desc->len = len;
+	desc->staged = false;
+	desc->first = true;
+	desc->done = done;
+	desc->user_data = user_data;
+	stats.sends++;
+
+	k_spin_unlock(&tx_lock, key);
+
+	tx_start_next();
+
+	return 0;
+}
+
+int uart_tx_queue_flush(k_timeout_t timeout)
+{
+	k_sem_reset(&tx_done);
+	k_sem_reset(&tx_aborted);
+
+	if (desc_count && k_sem_take(&tx_done, timeout)) {
+		return -EAGAIN;
+	}
+
+	return k_sem_take(&tx_aborted, K_NO_WAIT) ? 0 : -ECANCELED;
+}
+
+void uart_tx_queue_event(const struct device *dev, struct uart_event *evt)
+{
+	switch (evt->type) {
+	case UART_TX_DONE:
+		tx_complete(evt->data.tx.len, 0);
+		tx_start_next();
+		break;
+	case UART_TX_ABORTED:
+		tx_complete(evt->data.tx.len, -ECANCELED);
+		tx_start_next();
+		break;
+	default:
+		break;
+	}
+}
+
+void uart_tx_queue_stats_get(struct uart_tx_queue_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+	uint64_t busy = busy_cycles + (tx_busy ? k_cycle_get_32() - tx_start_cycles : 0);
+	uint64_t elapsed_ms = k_uptime_get() - period_start_ms;
+
+	*out = stats;
+	out->queued = desc_count;
+
+	k_spin_unlock(&tx_lock, key);
+
+	if (elapsed_ms == 0) {
+		return;
+	}
+
+	out->busy_permille = busy * MSEC_PER_SEC * 1000 /
+			     (elapsed_ms * sys_clock_hw_cycles_per_sec());
+
+	if (tx_baudrate) {
+		/* 10 bits a character, with start and stop bits */
+		uint64_t wire_bits = elapsed_ms * tx_baudrate / MSEC_PER_SEC;
+
+		out->wire_permille = (uint64_t)out->bytes * 10 * 1000 / MAX(wire_bits, 1);
+	}
+}
+
+void uart_tx_queue_stats_reset(void)
+{
+	struct uart_config cfg;
+	uint32_t baudrate = uart_config_get(tx_dev, &cfg) ? 0 : cfg.baudrate;
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+
+	memset(&stats, 0, sizeof(stats));
+	tx_baudrate = baudrate;
+	busy_cycles = 0;
+	period_start_ms = k_uptime_get();
+	if (tx_busy) {
+		tx_start_cycles = k_cycle_get_32();
+	}
+
+	k_spin_unlock(&tx_lock, key);
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/**
+ * @file
+ * @brief Non-blocking TX queue on top of the UART async API
+ */
+
+#ifndef UART_TX_QUEUE_H_
+#define UART_TX_QUEUE_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <kernel.h>
+#include <device.h>
+#include <drivers/uart.h>
+
+/** @brief Called, from the UART interrupt, when a buffer queued with
+ *  uart_tx_queue_send() is sent or aborted.
+ *
+ *  @param err 0 if the whole buffer went out, -ECANCELED otherwise.
+ */
+typedef void (*uart_tx_queue_done_t)(const uint8_t *buf, size_t len, int err,
+				     void *user_data);
+
+/** @brief TX queue counters. */
+struct uart_tx_queue_stats
+{
+	/** Writes copied to the staging area. */
+	uint32_t writes;
+	/** Buffers queued without copying. */
+	uint32_t sends;
+	/** Writes appended to a transfer already queued. */
+	uint32_t coalesced;
+	/** uart_tx() calls. */
+	uint32_t transfers;
+	/** Bytes sent. */
+	uint32_t bytes;
+	/** Writes and buffers refused because the queue or the staging
+	 *  area was full.
+	 */
+	uint32_t rejected;
+	/** Transfers that timed out or failed to start. */
+	uint32_t aborted;
+	/** Transfers queued now, including the one in flight. */
+	uint32_t queued;
+	/** Most transfers ever queued. */
+	uint32_t queued_max;
+	/** Most bytes ever used in the staging area. */
+	uint32_t staged_max;
+	/** Share of the time since the last reset a transfer was in flight,
+	 *  in permille.
+	 */
+	uint32_t busy_permille;
+	/** Bits sent over the bits the line could have carried since the
+	 *  last reset, in permille.
+	 */
+	uint32_t wire_permille;
+};
+
+/** @brief Send through @p dev.
+ *
+ *  The UART callback must pass TX events to uart_tx_queue_event().
+ *
+ *  @return 0 on success, -EALREADY if already initialized.
+ */
+int uart_tx_queue_init(const struct device *dev);
+
+/** @brief Queue a copy of @p data.
+ *
+ *  Never blocks and may be called from an interrupt. Writes queued while
+ *  a transfer is in flight are merged into one transfer of up to
+ *  CONFIG_UART_TX_QUEUE_MERGE_MAX bytes.
+ *
+ *  @return 0 on success, -ENOMEM if the queue or the staging area is full.
+ */
+int uart_tx_queue_write(const uint8_t *data, size_t len);
+
+/** @brief Queue @p buf without copying.
+ *
+ *  @p buf has to stay valid until @p done is called. Never blocks and may
+ *  be called from an interrupt.
+ *
+ *  @return 0 on success, -ENOMEM if the queue is full.
+ */
+int uart_tx_queue_send(const uint8_t *buf, size_t len, uart_tx_queue_done_t done,
+		       void *user_data);
+
+/** @brief Queue @p buf without copying, ahead of everything not yet in
+ *  flight.
+ *
+ *  For flow control characters, which must not wait for the data already
+ *  queued. Otherwise as uart_tx_queue_send().
+ *
+ *  @return 0 on success, -ENOMEM if the queue is full.
+ */
+int uart_tx_queue_send_first(const uint8_t *buf, size_t len, uart_tx_queue_done_t done,
+			     void *user_data);
+
+/** @brief Wait until everything queued has been sent.
+ *
+ *  @return 0 when the queue is empty, -ECANCELED if a transfer was aborted
+ *          meanwhile, -EAGAIN on timeout.
+ */
+int uart_tx_queue_flush(k_timeout_t timeout);
+
+/** @brief Pass UART_TX_DONE and UART_TX_ABORTED events to the queue. */
+void uart_tx_queue_event(const struct device *dev, struct uart_event *evt);
+
+void uart_tx_queue_stats_get(struct uart_tx_queue_stats *stats);
+
+/** @brief Zero the counters and restart the utilisation period, at the
+ *  baud rate the device reports now.
+ */
+void uart_tx_queue_stats_reset(void);
+
+#endif /* UART_TX_QUEUE_H_ */
@@ -0,0 +1,545 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	UART to BLE bridge.
+
+	UART to BLE: the RX ring of uart_async receives into a slab of
+	buffers sized for the baud rate. The bridge thread notifies each
+	chunk straight from its slab buffer, so the only copy is the one into
+	the stack's ACL buffer within bt_gatt_notify_cb(), and releases the
+	chunk right after.
+
+	At most CONFIG_UART_BRIDGE_TX_CREDITS notifications are in the
+	stack, a credit comes back when the stack reports one sent. When they
+	are all taken the thread waits with the chunk, and the ring keeps
+	receiving into the rest of the slab. Once the slab is used up the
+	UARTE stops receiving after its current buffer, which with RTS/CTS
+	deasserts RTS, and the peer holds off until a buffer comes back. The
+	same happens while no central is subscribed. With
+	CONFIG_UART_BRIDGE_XON_XOFF the bridge sends XOFF instead once the
+	slab is down to CONFIG_UART_BRIDGE_XOFF_BUFFERS free buffers, and
+	XON once it is above again. The slab alone decides, a credit wait
+	that the free buffers absorb does not toggle the peer. The thread
+	waits for a credit at most one buffer fill time at a time and checks
+	the slab in between, so the peer gets XOFF while no central takes
+	the data, before the slab runs out. The flow
+	control byte is queued ahead of the data staged for the UART, so it
+	waits only for the transfer in flight.
+
+	BLE to UART: a write of the RX characteristic is copied once, from
+	the stack's buffer into the staging ring of the TX queue, which the
+	UARTE sends from. When the peer holds CTS the ring fills, and the
+	write waits for room in the BT RX thread, which holds the central
+	off at the link layer, before it is refused.
+
+	Latency is measured both ways: from the UART_RX_RDY of a chunk to
+	the stack reporting its notification sent, and from a write to the
+	UART reporting its last byte sent.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/printk.h>
+#include <drivers/uart.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/gatt.h>
+
+#include "uart_rx_ring.h"
+#include "uart_tx_queue.h"
+#include "bridge.h"
+
+#define CREDITS CONFIG_UART_BRIDGE_TX_CREDITS
+
+#define XON  0x11
+#define XOFF 0x13
+
+/* Start, 8 data and stop bits */
+#define CHAR_BITS 10
+
+/* Sent without copying, indexed by the stop flag */
+static const uint8_t flow_chars[] = { XON, XOFF };
+
+/* Writes whose last byte is not sent yet, timed for the latency. Further
+ * ones are not timed.
+ */
+#define WRITES_TIMED 16
+
+struct latency
+{
+	uint32_t count;
+	uint64_t sum_us;
+	uint32_t max_us;
+};
+
+static const struct bt_gatt_attr *notify_attr;
+
+static K_SEM_DEFINE(bridge_start_sem, 0, 1);
+static K_SEM_DEFINE(credit_sem, 0, 1);
+/* Orders writes of the central to the TX queue */
+static K_MUTEX_DEFINE(write_lock);
+static struct k_spinlock lock;
+
+/* Under the lock. conn_gen changes with the connection, so credits of an
+ * earlier connection are not returned to this one.
+ */
+static struct bt_conn *bridge_conn;
+static uint32_t conn_gen;
+static bool subscribed;
+static uint32_t in_flight;
+static bool waiting;
+/* UART_RX_RDY cycles of the notifications in the stack, oldest first */
+static uint32_t notify_cyc[CREDITS];
+static uint32_t notify_tail;
+static struct bridge_stats stats;
+static struct latency up_latency;
+static struct latency down_latency;
+
+/* Bytes queued to and sent by the UART, and the end of each timed write,
+ * under the lock
+ */
+static uint32_t tx_queued;
+static uint32_t tx_sent;
+static struct {
+	uint32_t end;
+	uint32_t cycles;
+} timed[WRITES_TIMED];
+static uint32_t timed_tail;
+static uint32_t timed_count;
+
+/* Under flow_lock */
+static K_MUTEX_DEFINE(flow_lock);
+static bool xoff_sent;
+/* Line time of one RX buffer, the slab is checked that often while the
+ * thread waits for a credit
+ */
+static k_timeout_t credit_wait = K_FOREVER;
+
+static void latency_add(struct latency *latency, uint32_t start_cyc)
+{
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cyc);
+
+	latency->count++;
+	latency->sum_us += us;
+	latency->max_us = MAX(latency->max_us, us);
+}
+
+/* With write_lock held */
+static int tx_write(const uint8_t *data, size_t len, bool timed_write)
+{
+	uint32_t start_cyc = k_cycle_get_32();
+	k_spinlock_key_t key;
+	int err;
+
+	err = uart_tx_queue_write(data, len);
+	if (err) {
+		return err;
+	}
+
+	key = k_spin_lock(&lock);
+
+	tx_queued += len;
+
+	/* The UART may have sent it all already */
+	if (timed_write) {
+		if ((int32_t)(tx_sent - tx_queued) >= 0) {
+			latency_add(&down_latency, start_cyc);
+		} else if (timed_count < WRITES_TIMED) {
+			uint32_t i = (timed_tail + timed_count++) % WRITES_TIMED;
+
+			timed[i].end = tx_queued;
+			timed[i].cycles = start_cyc;
+		}
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return 0;
+}
+
+static void tx_done(size_t len)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	tx_sent += len;
+
+	while (timed_count && (int32_t)(tx_sent - timed[timed_tail].end) >= 0) {
+		latency_add(&down_latency, timed[timed_tail].cycles);
+		timed_tail = (timed_tail + 1) % WRITES_TIMED;
+		timed_count--;
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+static void uart_callback(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	switch (evt->type) {
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		uart_tx_queue_event(dev, evt);
+		tx_done(evt->data.tx.len);
+		break;
+	default:
+		uart_rx_ring_event(dev, evt);
+		break;
+	}
+}
+
+/* Called ahead of tx_done() for the same transfer. The flow control
+ * bytes are not in tx_queued, and would move the timed writes' ends.
+ */
+static void flow_sent(const uint8_t *buf, size_t len, int err, void *user_data)
+{
+	k_spinlock_key_t key;
+
+	if (err) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	tx_sent -= len;
+	k_spin_unlock(&lock, key);
+}
+
+/* Tell the peer to stop while the slab runs out */
+static void flow_update(void)
+{
+	bool stop;
+	k_spinlock_key_t key;
+
+	if (!IS_ENABLED(CONFIG_UART_BRIDGE_XON_XOFF)) {
+		return;
+	}
+
+	stop = uart_rx_ring_free() <= CONFIG_UART_BRIDGE_XOFF_BUFFERS;
+
+	k_mutex_lock(&flow_lock, K_FOREVER);
+
+	/* Ahead of the staged data, behind the transfer in flight. If the
+	 * queue is full, the next update tries again.
+	 */
+	if (stop != xoff_sent &&
+	    uart_tx_queue_send_first(&flow_chars[stop], 1, flow_sent, NULL) == 0) {
+		xoff_sent = stop;
+
+		key = k_spin_lock(&lock);
+		stats.xoffs += stop;
+		k_spin_unlock(&lock, key);
+	}
+
+	k_mutex_unlock(&flow_lock);
+}
+
+/* A referenced connection with a credit taken, or NULL to wait */
+static struct bt_conn *credit_take(uint32_t *gen, uint32_t rx_cyc)
+{
+	struct bt_conn *conn = NULL;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (subscribed && in_flight < CREDITS) {
+		notify_cyc[(notify_tail + in_flight) % CREDITS] = rx_cyc;
+		in_flight++;
+		conn = bt_conn_ref(bridge_conn);
+		*gen = conn_gen;
+		waiting = false;
+	} else {
+		if (!waiting && subscribed) {
+			stats.busy_events++;
+		}
+		waiting = true;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return conn;
+}
+
+/* The notification the credit was taken for was not sent */
+static void credit_put(uint32_t gen)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (gen == conn_gen && in_flight) {
+		in_flight--;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	k_sem_give(&credit_sem);
+}
+
+static void on_sent(struct bt_conn *conn, void *user_data)
+{
+	uint32_t gen = POINTER_TO_UINT(user_data);
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	/* Notifications are reported sent in order */
+	if (gen == conn_gen && in_flight) {
+		latency_add(&up_latency, notify_cyc[notify_tail]);
+		notify_tail = (notify_tail + 1) % CREDITS;
+		in_flight--;
+		stats.sent++;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	k_sem_give(&credit_sem);
+}
+
+/* Chunks larger than the ATT MTU allows go out as several notifications */
+static void bridge_send(const struct uart_rx_chunk *chunk)
+{
+	const uint8_t *data = &chunk->buf[chunk->offset];
+	uint32_t start_cyc = k_cycle_get_32();
+	uint32_t wait_us;
+	uint16_t offset = 0;
+	k_spinlock_key_t key;
+
+	while (offset < chunk->len) {
+		struct bt_gatt_notify_params params = {
+			.attr = notify_attr,
+			.data = data + offset,
+			.func = on_sent,
+		};
+		struct bt_conn *conn;
+		uint32_t gen;
+		int err;
+
+		conn = credit_take(&gen, chunk->cycles);
+		if (!conn) {
+			flow_update();
+			k_sem_take(&credit_sem, credit_wait);
+			continue;
+		}
+
+		params.len = MIN(chunk->len - offset, bt_gatt_get_mtu(conn) - 3);
+		params.user_data = UINT_TO_POINTER(gen);
+
+		err = bt_gatt_notify_cb(conn, &params);
+		bt_conn_unref(conn);
+
+		if (err) {
+			/* Tried again, on this connection or the next one */
+			credit_put(gen);
+			k_sleep(K_MSEC(1));
+			continue;
+		}
+
+		key = k_spin_lock(&lock);
+		stats.notified++;
+		stats.bytes += params.len;
+		k_spin_unlock(&lock, key);
+
+		offset += params.len;
+	}
+
+	wait_us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cyc);
+
+	key = k_spin_lock(&lock);
+	stats.chunks++;
+	stats.wait_max_us = MAX(stats.wait_max_us, wait_us);
+	k_spin_unlock(&lock, key);
+}
+
+/* RTS/CTS unless XON/XOFF is configured, which then needs the pins free */
+static int flow_configure(const struct device *dev)
+{
+	struct uart_config cfg;
+	int err;
+
+	err = uart_config_get(dev, &cfg);
+	if (err) {
+		return err;
+	}
+
+	cfg.flow_ctrl = IS_ENABLED(CONFIG_UART_BRIDGE_XON_XOFF) ?
+			UART_CFG_FLOW_CTRL_NONE : UART_CFG_FLOW_CTRL_RTS_CTS;
+
+	err = uart_configure(dev, &cfg);
+	if (err) {
+		printk("Error %d: %s flow control not supported\n", err,
+		       IS_ENABLED(CONFIG_UART_BRIDGE_XON_XOFF) ? "no" : "RTS/CTS");
+		return err;
+	}
+
+	printk("UART %s at %u baud, %s flow control\n", dev->name, cfg.baudrate,
+	       IS_ENABLED(CONFIG_UART_BRIDGE_XON_XOFF) ? "XON/XOFF" : "RTS/CTS");
+
+	return 0;
+}
+
+int bridge_start(const struct device *dev, const struct bt_gatt_attr *attr)
+{
+	int err;
+
+	if (!device_is_ready(dev)) {
+		return -ENODEV;
+	}
+
+	err = flow_configure(dev);
+	if (err) {
+		return err;
+	}
+
+	notify_attr = attr;
+
+	err = uart_callback_set(dev, uart_callback, NULL);
+	if (err) {
+		return err;
+	}
+
+	err = uart_tx_queue_init(dev);
+	if (err) {
+		return err;
+	}
+
+	/* Buffers sized for the baud rate the UART reports */
+	err = uart_rx_ring_start(dev, 0);
+	if (err) {
+		return err;
+	}
+
+	if (IS_ENABLED(CONFIG_UART_BRIDGE_XON_XOFF)) {
+		struct uart_rx_ring_stats ring;
+
+		uart_rx_ring_stats_get(&ring);
+		credit_wait = K_USEC(DIV_ROUND_UP((uint64_t)ring.buf_len * CHAR_BITS *
+						  USEC_PER_SEC, MAX(ring.baudrate, 1)));
+	}
+
+	k_sem_give(&bridge_start_sem);
+
+	return 0;
+}
+
+int bridge_write(const uint8_t *data, uint16_t len)
+{
+	int64_t deadline = k_uptime_get() + CONFIG_UART_BRIDGE_WRITE_WAIT_MS;
+	bool waited = false;
+	k_spinlock_key_t key;
+	int err;
+
+	for (;;) {
+		k_mutex_lock(&write_lock, K_FOREVER);
+		err = tx_write(data, len, true);
+		k_mutex_unlock(&write_lock);
+
+		if (err != -ENOMEM || k_uptime_get() >= deadline) {
+			break;
+		}
+
+		/* Holds up the BT RX thread, and with it the central */
+		waited = true;
+		k_sleep(K_MSEC(1));
+	}
+
+	key = k_spin_lock(&lock);
+
+	stats.writes++;
+	stats.write_waits += waited;
+	if (err) {
+		stats.write_dropped++;
+	} else {
+		stats.write_bytes += len;
+	}
+
+	k_spin_unlock(&lock, key);
+
+	return err;
+}
+
+void bridge_conn_set(struct bt_conn *conn)
+{
+	struct bt_conn *old;
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	old = bridge_conn;
+	bridge_conn = conn ? bt_conn_ref(conn) : NULL;
+	conn_gen++;
+	in_flight = 0;
+	notify_tail = 0;
+	subscribed = conn && bt_gatt_is_subscribed(conn, notify_attr, BT_GATT_CCC_NOTIFY);
+
+	k_spin_unlock(&lock, key);
+
+	if (old) {
+		bt_conn_unref(old);
+	}
+
+	flow_update();
+	k_sem_give(&credit_sem);
+}
+
+void bridge_subscription_changed(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	subscribed = bridge_conn &&
+		     bt_gatt_is_subscribed(bridge_conn, notify_attr, BT_GATT_CCC_NOTIFY);
+
+	k_spin_unlock(&lock, key);
+
+	flow_update();
+	k_sem_give(&credit_sem);
+}
+
+static uint32_t latency_avg(const struct latency *latency)
+{
+	return latency->count ? latency->sum_us / latency->count : 0;
+}
+
+void bridge_stats_get(struct bridge_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*out = stats;
+	out->up_latency_us = latency_avg(&up_latency);
+	out->up_latency_max_us = up_latency.max_us;
+	out->down_latency_us = latency_avg(&down_latency);
+	out->down_latency_max_us = down_latency.max_us;
+
+	k_spin_unlock(&lock, key);
+}
+
+void bridge_stats_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(&stats, 0, sizeof(stats));
+	memset(&up_latency, 0, sizeof(up_latency));
+	memset(&down_latency, 0, sizeof(down_latency));
+
+	k_spin_unlock(&lock, key);
+
+	uart_rx_ring_stats_reset();
+	uart_tx_queue_stats_reset();
+}
+
+static void bridge_thread(void *p1, void *p2, void *p3)
+{
+	ARG_UNUSED(p1);
+	ARG_UNUSED(p2);
+	ARG_UNUSED(p3);
+
+	k_sem_take(&bridge_start_sem, K_FOREVER);
+
+	for (;;) {
+		struct uart_rx_chunk chunk;
+
+		if (uart_rx_ring_get(&chunk, K_FOREVER)) {
+			continue;
+		}
+
+		bridge_send(&chunk);
+		uart_rx_ring_release(&chunk);
+		flow_update();
+	}
+}
+
+K_THREAD_DEFINE(bridge_tid, CONFIG_UART_BRIDGE_STACK_SIZE, bridge_thread,
+		NULL, NULL, NULL, CONFIG_UART_BRIDGE_THREAD_PRIORITY, 0, 0);
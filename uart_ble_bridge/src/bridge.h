@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef BRIDGE_H_
+#define BRIDGE_H_
+
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <device.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+/** @brief Bridge counters, since the last bridge_stats_reset(). */
+struct bridge_stats
+{
+	/** UART RX chunks, each sent as one notification or more. */
+	uint32_t chunks;
+	/** Payload bytes handed to the stack. */
+	uint32_t bytes;
+	/** Notifications handed to the stack, and reported sent. */
+	uint32_t notified;
+	uint32_t sent;
+	/** Times the BLE credits ran out with a chunk waiting. */
+	uint32_t busy_events;
+	/** Longest time a chunk waited for a credit. */
+	uint32_t wait_max_us;
+	/** XOFF sent to the UART peer, with CONFIG_UART_BRIDGE_XON_XOFF. */
+	uint32_t xoffs;
+	/** Writes of the RX characteristic, and their bytes queued for the UART. */
+	uint32_t writes;
+	uint32_t write_bytes;
+	/** Writes that waited for room in the TX queue, and that were refused. */
+	uint32_t write_waits;
+	uint32_t write_dropped;
+	/** From UART_RX_RDY to the notification reported sent, average and
+	 *  longest.
+	 */
+	uint32_t up_latency_us;
+	uint32_t up_latency_max_us;
+	/** From the write to its last byte sent by the UART. */
+	uint32_t down_latency_us;
+	uint32_t down_latency_max_us;
+};
+
+/** @brief Bridge @p dev and notifications of @p attr, both ways.
+ *
+ *  @return 0 on success, -ENODEV if @p dev is not ready, or the error of
+ *          uart_configure() when @p dev has no RTS/CTS, or of starting
+ *          the RX ring.
+ */
+int bridge_start(const struct device *dev, const struct bt_gatt_attr *attr);
+
+/** @brief Notify on @p conn from now on, NULL after it disconnected. */
+void bridge_conn_set(struct bt_conn *conn);
+
+/** @brief Called when the central changed the CCC of the attribute. */
+void bridge_subscription_changed(void);
+
+/** @brief Queue data the central wrote for the UART.
+ *
+ *  Waits up to CONFIG_UART_BRIDGE_WRITE_WAIT_MS for room in the TX queue.
+ *
+ *  @return 0 on success, -ENOMEM if there was none.
+ */
+int bridge_write(const uint8_t *data, uint16_t len);
+
+void bridge_stats_get(struct bridge_stats *stats);
+
+/** @brief Zero the bridge, RX ring and TX queue counters. */
+void bridge_stats_reset(void);
+
+#endif /* BRIDGE_H_ */
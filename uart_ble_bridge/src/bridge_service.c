@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	GATT side of the bridge.
+
+	The custom service of ble_peripheral_cus_service with its TX
+	characteristic, notified with what the UART receives, and its RX
+	characteristic, whose writes go out on the UART. A write the TX queue
+	has no room for is refused with Insufficient Resources, which a
+	central only sees for writes with response.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "my_service.h"
+#include "bridge.h"
+#include "bridge_service.h"
+
+#define BT_UUID_MY_SERVICE      BT_UUID_DECLARE_128(MY_SERVICE_UUID)
+#define BT_UUID_MY_SERVICE_RX   BT_UUID_DECLARE_128(RX_CHARACTERISTIC_UUID)
+#define BT_UUID_MY_SERVICE_TX   BT_UUID_DECLARE_128(TX_CHARACTERISTIC_UUID)
+
+static void on_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	printk("Notifications %s\n", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+
+	bridge_subscription_changed();
+}
+
+static ssize_t on_rx_write(struct bt_conn *conn,
+			   const struct bt_gatt_attr *attr,
+			   const void *buf,
+			   uint16_t len,
+			   uint16_t offset,
+			   uint8_t flags)
+{
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (bridge_write(buf, len)) {
+		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	}
+
+	return len;
+}
+
+BT_GATT_SERVICE_DEFINE(bridge_service,
+BT_GATT_PRIMARY_SERVICE(BT_UUID_MY_SERVICE),
+BT_GATT_CHARACTERISTIC(BT_UUID_MY_SERVICE_TX,
+		       BT_GATT_CHRC_NOTIFY,
+		       BT_GATT_PERM_READ,
+		       NULL, NULL, NULL),
+BT_GATT_CCC(on_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+BT_GATT_CHARACTERISTIC(BT_UUID_MY_SERVICE_RX,
+		       BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+		       BT_GATT_PERM_WRITE,
+		       NULL, on_rx_write, NULL),
+);
+
+const struct bt_gatt_attr *bridge_service_tx_attr(void)
+{
+	/* 0 = Primary service, 1 = characteristic declaration, 2 = value */
+	return &bridge_service.attrs[2];
+}
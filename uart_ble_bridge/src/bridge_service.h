@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+#ifndef BRIDGE_SERVICE_H_
+#define BRIDGE_SERVICE_H_
+
+#include <bluetooth/gatt.h>
+
+/** @brief Value attribute of the TX characteristic, which carries the
+ *  data received from the UART.
+ */
+const struct bt_gatt_attr *bridge_service_tx_attr(void);
+
+#endif /* BRIDGE_SERVICE_H_ */
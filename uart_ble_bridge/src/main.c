@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2022 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-BSD-5-Clause-Nordic
+ */
+
+/*
+	UART to BLE bridge.
+
+	What the serial device sends on the UART goes out as notifications
+	of the TX characteristic of the custom service, and what the central
+	writes to its RX characteristic goes out on the UART, see bridge.c.
+	The connection is moved to the 2M PHY and the longest data length,
+	a 1 Mbaud UART carries 800 kbps.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <sys/printk.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+#include "my_service.h"
+#include "uart_rx_ring.h"
+#include "uart_tx_queue.h"
+#include "bridge.h"
+#include "bridge_service.h"
+
+#define DEVICE_NAME     CONFIG_BT_DEVICE_NAME
+#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
+
+static const struct device *uart_dev = DEVICE_DT_GET(DT_NODELABEL(bridge_uart));
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+};
+
+static const struct bt_data sd[] = {
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL, MY_SERVICE_UUID),
+};
+
+static void adv_work_handler(struct k_work *work);
+
+/* The connection is only released after disconnected() returns, so
+ * advertising is restarted a little later, and retried until it starts.
+ */
+static K_WORK_DELAYABLE_DEFINE(adv_work, adv_work_handler);
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	int ret;
+
+	if (err) {
+		printk("Connection failed (err %u)\n", err);
+		k_work_schedule(&adv_work, K_MSEC(100));
+		return;
+	}
+
+	printk("Connected\n");
+	/* The counters cover one connection */
+	bridge_stats_reset();
+	bridge_conn_set(conn);
+
+	ret = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+	if (ret) {
+		printk("PHY update failed (err %d)\n", ret);
+	}
+
+	ret = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (ret) {
+		printk("Data length update failed (err %d)\n", ret);
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	printk("Disconnected (reason %u)\n", reason);
+
+	bridge_conn_set(NULL);
+	k_work_schedule(&adv_work, K_MSEC(100));
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+static void adv_work_handler(struct k_work *work)
+{
+	int err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+
+	if (err == -ENOMEM) {
+		k_work_schedule(&adv_work, K_MSEC(100));
+	} else if (err) {
+		printk("Advertising failed to start (err %d)\n", err);
+	} else {
+		printk("Advertising successfully started\n");
+	}
+}
+
+static void bridge_report(void)
+{
+	struct bridge_stats stats;
+	struct uart_rx_ring_stats rx;
+	struct uart_tx_queue_stats tx;
+
+	bridge_stats_get(&stats);
+	uart_rx_ring_stats_get(&rx);
+	uart_tx_queue_stats_get(&tx);
+
+	printk("BRIDGE UP: uart_bytes=%u chunks=%u notified=%u sent=%u bytes=%u busy_events=%u "
+	       "wait_max_us=%u xoffs=%u latency_us=%u latency_max_us=%u\n",
+	       rx.bytes, stats.chunks, stats.notified, stats.sent, stats.bytes,
+	       stats.busy_events, stats.wait_max_us, stats.xoffs, stats.up_latency_us,
+	       stats.up_latency_max_us);
+	printk("BRIDGE DOWN: writes=%u write_bytes=%u write_waits=%u write_dropped=%u "
+	       "uart_bytes=%u latency_us=%u latency_max_us=%u\n",
+	       stats.writes, stats.write_bytes, stats.write_waits, stats.write_dropped,
+	       tx.bytes, stats.down_latency_us, stats.down_latency_max_us);
+	printk("BRIDGE UART: buf_len=%u buf_count=%u lost=%u starved=%u errors=%u "
+	       "tx_busy=%u.%u%% tx_wire=%u.%u%%\n",
+	       rx.buf_len, rx.buf_count, rx.lost, rx.starved, rx.errors,
+	       tx.busy_permille / 10, tx.busy_permille % 10,
+	       tx.wire_permille / 10, tx.wire_permille % 10);
+}
+
+void main(void)
+{
+	int err;
+
+	printk("Starting UART to BLE bridge\n");
+
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	err = bridge_start(uart_dev, bridge_service_tx_attr());
+	if (err) {
+		printk("Bridge failed to start (err %d)\n", err);
+		return;
+	}
+
+	k_work_schedule(&adv_work, K_NO_WAIT);
+
+	for (;;) {
+		k_sleep(K_SECONDS(CONFIG_UART_BRIDGE_REPORT_SEC));
+		bridge_report();
+	}
+}